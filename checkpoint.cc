@@ -14,17 +14,243 @@
  * is legally binding.
  */
 #include "checkpoint.hh"
+#include "iouring.hh"
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+// O_DIRECT transfers must be aligned to the device block size.
+static constexpr size_t ckwriter_align = 4096;
+// room for the record that crosses a chunk boundary
+static constexpr size_t ckwriter_slack = 64 << 10;
+
+static kvout* new_ckbuf(size_t chunk_size) {
+    kvout* kv = new_bufkvout();
+    free(kv->buf);
+    kv->capacity = chunk_size + ckwriter_slack;
+    int r = posix_memalign((void**) &kv->buf, ckwriter_align, kv->capacity);
+    always_assert(r == 0);
+    return kv;
+}
+
+ckwriter::ckwriter(int fd, size_t chunk_size, bool direct)
+    : fd_(fd), direct_(direct), flush_len_(0), offset_(0),
+      busy_(false), quit_(false), stall_time_(0) {
+#ifndef O_DIRECT
+    direct_ = false;
+#endif
+    chunk_size_ = std::max(chunk_size, ckwriter_align);
+    chunk_size_ = (chunk_size_ + ckwriter_align - 1) & ~(ckwriter_align - 1);
+    fill_ = new_ckbuf(chunk_size_);
+    flush_ = new_ckbuf(chunk_size_);
+    pthread_mutex_init(&mu_, 0);
+    pthread_cond_init(&cond_, 0);
+    ring_ = io_ring::make(4);
+    if (ring_) {
+        struct iovec iov[2];
+        iov[0].iov_base = ring_buf_[0] = fill_->buf;
+        iov[1].iov_base = ring_buf_[1] = flush_->buf;
+        iov[0].iov_len = iov[1].iov_len = fill_->capacity;
+        ring_->register_buffers(iov, 2);
+    } else {
+        int r = pthread_create(&thread_, 0, trampoline, this);
+        always_assert(r == 0);
+    }
+}
+
+ckwriter::~ckwriter() {
+    assert(quit_);
+    delete ring_;
+    free_kvout(fill_);
+    free_kvout(flush_);
+    pthread_mutex_destroy(&mu_);
+    pthread_cond_destroy(&cond_);
+}
+
+// pass the filled chunk to the writer, waiting for it to finish with the
+// previous one.
+void ckwriter::handoff(bool last) {
+    double t0 = now();
+    if (ring_)
+        ring_wait();
+    else {
+        pthread_mutex_lock(&mu_);
+        while (busy_)
+            pthread_cond_wait(&cond_, &mu_);
+    }
+    stall_time_ += now() - t0;
+
+    // keep an unaligned tail for the next chunk unless this is the end
+    size_t len = fill_->n;
+    if (direct_ && !last)
+        len &= ~(ckwriter_align - 1);
+    size_t tail = fill_->n - len;
+    memcpy(flush_->buf, fill_->buf + len, tail);
+    flush_->n = tail;
+    std::swap(fill_, flush_);
+    flush_len_ = len;
+
+    busy_ = true;
+    if (ring_)
+        ring_submit();
+    else {
+        pthread_cond_broadcast(&cond_);
+        pthread_mutex_unlock(&mu_);
+    }
+}
+
+static void ckwriter_clear_direct(int fd) {
+#ifdef O_DIRECT
+    int flags = fcntl(fd, F_GETFL);
+    int r = fcntl(fd, F_SETFL, flags & ~O_DIRECT);
+    always_assert(r == 0);
+#else
+    (void) fd;
+#endif
+}
+
+// write flush_[0, flush_len_) at offset_ with ordinary syscalls.
+void ckwriter::write_chunk() {
+    const char* buf = flush_->buf;
+    size_t len = flush_len_;
+    while (len) {
+        ssize_t w = pwrite(fd_, buf, len, offset_);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0) {
+            perror("checkpoint write");
+            always_assert(0);
+        }
+        buf += w;
+        len -= w;
+        offset_ += w;
+    }
+}
+
+void ckwriter::ring_submit() {
+    // a grown buffer or the final partial chunk can't go O_DIRECT
+    if (direct_ && ((flush_len_ | (uintptr_t) flush_->buf) & (ckwriter_align - 1))) {
+        ckwriter_clear_direct(fd_);
+        direct_ = false;
+    }
+    int index = -1;
+    for (int i = 0; i != 2; ++i)
+        if (flush_->buf == ring_buf_[i])
+            index = i;
+    ring_->write(fd_, flush_->buf, flush_len_, offset_, index, 0);
+    int r = ring_->submit();
+    if (r < 0) {
+        errno = -r;
+        perror("checkpoint submit");
+        always_assert(0);
+    }
+}
+
+void ckwriter::ring_wait() {
+    if (!busy_)
+        return;
+    io_ring::completion c;
+    if (!ring_->wait(c) || c.result < 0) {
+        errno = c.result < 0 ? -c.result : errno;
+        perror("checkpoint write");
+        always_assert(0);
+    }
+    // finish a short write synchronously
+    offset_ += c.result;
+    if (size_t(c.result) < flush_len_) {
+        if (direct_) {
+            ckwriter_clear_direct(fd_);
+            direct_ = false;
+        }
+        memmove(flush_->buf, flush_->buf + c.result, flush_len_ - c.result);
+        flush_len_ -= c.result;
+        write_chunk();
+    }
+    busy_ = false;
+}
+
+void* ckwriter::run() {
+    pthread_mutex_lock(&mu_);
+    while (1) {
+        while (!busy_ && !quit_)
+            pthread_cond_wait(&cond_, &mu_);
+        if (!busy_)
+            break;
+        // a grown buffer or the final partial chunk can't go O_DIRECT
+        if (direct_ && ((flush_len_ | (uintptr_t) flush_->buf) & (ckwriter_align - 1))) {
+            ckwriter_clear_direct(fd_);
+            direct_ = false;
+        }
+        pthread_mutex_unlock(&mu_);
+
+        write_chunk();
+
+        pthread_mutex_lock(&mu_);
+        busy_ = false;
+        pthread_cond_broadcast(&cond_);
+    }
+    pthread_mutex_unlock(&mu_);
+    return 0;
+}
+
+void* ckwriter::trampoline(void* x) {
+    return static_cast<ckwriter*>(x)->run();
+}
+
+// flush the last chunk and stop the writer.
+// returns the number of bytes written; afterwards the file descriptor
+// is no longer in O_DIRECT mode.
+uint64_t ckwriter::finish() {
+    handoff(true);
+    if (ring_) {
+        ring_wait();
+        quit_ = true;
+    } else {
+        pthread_mutex_lock(&mu_);
+        quit_ = true;
+        pthread_cond_broadcast(&cond_);
+        pthread_mutex_unlock(&mu_);
+        pthread_join(thread_, 0);
+    }
+    if (direct_) {
+        ckwriter_clear_direct(fd_);
+        direct_ = false;
+    }
+    return offset_;
+}
 
 // add one key/value to a checkpoint.
 // called by checkpoint_tree() for each node.
-bool ckstate::visit_value(Str key, const row_type* value, threadinfo&) {
+bool ckstate::visit_value(Str key, const row_slot<row_type>::type& value,
+                          threadinfo&) {
     if (endkey && key >= endkey)
         return false;
-    if (!row_is_marker(value)) {
-        msgpack::unparser<kvout> up(*vals);
+    const row_type* row = row_slot<row_type>::row(value);
+    if (!row_is_marker(row)
+        && (!min_ts
+            || !circular_int<kvtimestamp_t>::less(row->timestamp(), min_ts)))
+        write(key, row);
+    return true;
+}
+
+void ckstate::write(Str key, const row_type* value) {
+    if (row_is_marker(value))
+        write_tombstone(key, value->timestamp());
+    else {
+        msgpack::unparser<kvout> up(*writer->out());
         up.write(key).write_wide(value->timestamp());
         value->checkpoint_write(up);
         ++count;
+        writer->check_flush();
     }
-    return true;
+}
+
+void ckstate::write_tombstone(Str key, kvtimestamp_t ts) {
+    msgpack::unparser<kvout> up(*writer->out());
+    up.write(key).write_wide(ts | 1).null();
+    ++count;
+    writer->check_flush();
 }
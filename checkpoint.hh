@@ -18,9 +18,54 @@
 #include "kvrow.hh"
 #include "kvio.hh"
 #include "msgpack.hh"
+#include <pthread.h>
+class io_ring;
+
+// Streams one checkpoint file to disk in fixed-size chunks. The scanning
+// thread fills one chunk while the other is written, so memory use is
+// bounded by about twice the chunk size and disk writes overlap the scan.
+// Chunks are written asynchronously through io_uring when available, and
+// by a writer thread otherwise.
+class ckwriter {
+  public:
+    ckwriter(int fd, size_t chunk_size, bool direct);
+    ~ckwriter();
+
+    inline kvout* out() const;
+    inline void check_flush();
+    uint64_t finish();
+
+    double stall_time() const {
+        return stall_time_;
+    }
+
+  private:
+    int fd_;
+    size_t chunk_size_;
+    bool direct_;
+    kvout* fill_;               // chunk being filled by the scanner
+    kvout* flush_;              // chunk owned by the writer thread
+    size_t flush_len_;
+    uint64_t offset_;
+    bool busy_;
+    bool quit_;
+    double stall_time_;
+    io_ring* ring_;
+    char* ring_buf_[2];         // registered buffers
+    pthread_t thread_;
+    pthread_mutex_t mu_;
+    pthread_cond_t cond_;
+
+    void handoff(bool last);
+    void write_chunk();
+    void ring_submit();
+    void ring_wait();
+    void* run();
+    static void* trampoline(void*);
+};
 
 struct ckstate {
-    kvout *vals; // key, val, timestamp in msgpack
+    ckwriter *writer; // key, val, timestamp in msgpack
     uint64_t count; // total nodes written
     uint64_t bytes;
     pthread_cond_t state_cond;
@@ -28,29 +73,42 @@ struct ckstate {
     threadinfo *ti;
     Str startkey;
     Str endkey;
+    kvtimestamp_t min_ts; // nonzero for a delta: skip rows older than this
 
     template <typename SS, typename K>
     void visit_leaf(const SS&, const K&, threadinfo&) {
     }
-    bool visit_value(Str key, const row_type* value, threadinfo& ti);
+    bool visit_value(Str key, const row_slot<row_type>::type& value,
+                     threadinfo& ti);
+    // Write one row; remove markers are written as tombstones.
+    void write(Str key, const row_type* value);
+    void write_tombstone(Str key, kvtimestamp_t ts);
 
-    template <typename T>
-    static void insert(T& table, msgpack::parser& par, threadinfo& ti);
+    static row_slot<row_type>::type read(msgpack::parser& par, Str& key,
+                                         threadinfo& ti);
 };
 
-template <typename T>
-void ckstate::insert(T& table, msgpack::parser& par, threadinfo& ti) {
-    Str key;
+inline kvout* ckwriter::out() const {
+    return fill_;
+}
+
+inline void ckwriter::check_flush() {
+    if (fill_->n >= chunk_size_)
+        handoff(false);
+}
+
+// read one key/value written by write(). A tombstone, which has an odd
+// timestamp and a null value, is read as a remove marker.
+inline row_slot<row_type>::type ckstate::read(msgpack::parser& par, Str& key,
+                                              threadinfo& ti) {
     kvtimestamp_t ts{};
     par >> key >> ts;
-    row_type* row = row_type::checkpoint_read(par, ts, ti);
-
-    typename T::cursor_type lp(table, key);
-    bool found = lp.find_insert(ti);
-    masstree_invariant(!found); (void) found;
-    ti.observe_phantoms(lp.node());
-    lp.value() = row;
-    lp.finish(1, ti);
+    if ((ts & 1) && par.try_read_null()) {
+        row_marker m;
+        m.marker_type_ = row_marker::mt_remove;
+        return row_type::create1(Str((const char*) &m, sizeof(m)), ts, ti);
+    }
+    return row_type::checkpoint_read(par, ts, ti);
 }
 
 #endif
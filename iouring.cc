@@ -0,0 +1,232 @@
+/* Masstree
+ * Eddie Kohler, Yandong Mao, Robert Morris
+ * Copyright (c) 2012-2014 President and Fellows of Harvard College
+ * Copyright (c) 2012-2014 Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Masstree LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Masstree LICENSE file; the license in that file
+ * is legally binding.
+ */
+#include "iouring.hh"
+#include "compiler.hh"
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#if HAVE_LINUX_IO_URING_H
+# include <linux/io_uring.h>
+# include <sys/syscall.h>
+#endif
+
+bool io_ring::enabled = true;
+
+io_ring::io_ring()
+    : fd_(-1), registered_(false), to_submit_(0),
+      sq_map_(MAP_FAILED), cq_map_(MAP_FAILED), sqe_map_(MAP_FAILED) {
+}
+
+#if HAVE_LINUX_IO_URING_H && defined(__NR_io_uring_setup)
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params* p) {
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit,
+                              unsigned min_complete, unsigned flags) {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                   flags, (void*) 0, (size_t) 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode,
+                                 const void* arg, unsigned nargs) {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nargs);
+}
+
+template <typename T>
+static inline T* ring_field(void* map, unsigned offset) {
+    return reinterpret_cast<T*>(static_cast<char*>(map) + offset);
+}
+
+io_ring* io_ring::make(unsigned entries) {
+    if (!enabled)
+        return 0;
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = sys_io_uring_setup(entries, &p);
+    if (fd < 0)
+        return 0;
+
+    io_ring* r = new io_ring;
+    r->fd_ = fd;
+    r->sq_entries_ = p.sq_entries;
+    r->cq_entries_ = p.cq_entries;
+    r->sq_map_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_map_size_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        r->sq_map_size_ = r->cq_map_size_ =
+            std::max(r->sq_map_size_, r->cq_map_size_);
+    r->sq_map_ = mmap(0, r->sq_map_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (r->sq_map_ == MAP_FAILED)
+        goto fail;
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        r->cq_map_ = r->sq_map_;
+    else {
+        r->cq_map_ = mmap(0, r->cq_map_size_, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (r->cq_map_ == MAP_FAILED)
+            goto fail;
+    }
+    r->sqe_map_size_ = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqe_map_ = mmap(0, r->sqe_map_size_, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (r->sqe_map_ == MAP_FAILED)
+        goto fail;
+
+    r->sq_head_ = ring_field<unsigned>(r->sq_map_, p.sq_off.head);
+    r->sq_tail_ = ring_field<unsigned>(r->sq_map_, p.sq_off.tail);
+    r->sq_mask_ = ring_field<unsigned>(r->sq_map_, p.sq_off.ring_mask);
+    r->sq_array_ = ring_field<unsigned>(r->sq_map_, p.sq_off.array);
+    r->cq_head_ = ring_field<unsigned>(r->cq_map_, p.cq_off.head);
+    r->cq_tail_ = ring_field<unsigned>(r->cq_map_, p.cq_off.tail);
+    r->cq_mask_ = ring_field<unsigned>(r->cq_map_, p.cq_off.ring_mask);
+    r->cqes_ = ring_field<void>(r->cq_map_, p.cq_off.cqes);
+    return r;
+
+ fail:
+    delete r;
+    return 0;
+}
+
+io_ring::~io_ring() {
+    if (sqe_map_ != MAP_FAILED)
+        munmap(sqe_map_, sqe_map_size_);
+    if (cq_map_ != MAP_FAILED && cq_map_ != sq_map_)
+        munmap(cq_map_, cq_map_size_);
+    if (sq_map_ != MAP_FAILED)
+        munmap(sq_map_, sq_map_size_);
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+bool io_ring::register_buffers(const struct iovec* iov, unsigned n) {
+    registered_ = sys_io_uring_register(fd_, IORING_REGISTER_BUFFERS,
+                                        iov, n) == 0;
+    return registered_;
+}
+
+// Return the next free submission entry, submitting queued entries if
+// the queue is full.
+void* io_ring::next_sqe() {
+    unsigned tail = *sq_tail_;
+    while (tail - *(volatile unsigned*) sq_head_ == sq_entries_) {
+        int r = submit();
+        always_assert(r >= 0 || r == -EAGAIN || r == -EBUSY);
+    }
+    unsigned index = tail & *sq_mask_;
+    struct io_uring_sqe* sqe =
+        static_cast<struct io_uring_sqe*>(sqe_map_) + index;
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array_[index] = index;
+    return sqe;
+}
+
+void io_ring::write(int fd, const void* buf, size_t len, uint64_t off,
+                    int buf_index, uint64_t tag, bool link) {
+    struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(next_sqe());
+    if (registered_ && buf_index >= 0) {
+        sqe->opcode = IORING_OP_WRITE_FIXED;
+        sqe->buf_index = buf_index;
+    } else
+        sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uintptr_t>(buf);
+    sqe->len = len;
+    sqe->off = off;
+    sqe->user_data = tag;
+    if (link)
+        sqe->flags = IOSQE_IO_LINK;
+    release_fence();
+    ++*sq_tail_;
+    ++to_submit_;
+}
+
+void io_ring::fdatasync(int fd, uint64_t tag) {
+    struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(next_sqe());
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->fd = fd;
+    sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    sqe->user_data = tag;
+    release_fence();
+    ++*sq_tail_;
+    ++to_submit_;
+}
+
+int io_ring::submit() {
+    int n = 0;
+    while (to_submit_) {
+        int r = sys_io_uring_enter(fd_, to_submit_, 0, 0);
+        if (r < 0 && errno == EINTR)
+            continue;
+        else if (r < 0)
+            return -errno;
+        to_submit_ -= r;
+        n += r;
+    }
+    return n;
+}
+
+bool io_ring::wait(completion& c) {
+    unsigned head = *cq_head_;
+    while (head == *(volatile unsigned*) cq_tail_) {
+        int r = sys_io_uring_enter(fd_, 0, 1, IORING_ENTER_GETEVENTS);
+        if (r < 0 && errno != EINTR)
+            return false;
+    }
+    acquire_fence();
+    const struct io_uring_cqe* cqe =
+        static_cast<const struct io_uring_cqe*>(cqes_) + (head & *cq_mask_);
+    c.tag = cqe->user_data;
+    c.result = cqe->res;
+    release_fence();
+    *(volatile unsigned*) cq_head_ = head + 1;
+    return true;
+}
+
+#else
+
+io_ring* io_ring::make(unsigned) {
+    return 0;
+}
+
+io_ring::~io_ring() {
+}
+
+bool io_ring::register_buffers(const struct iovec*, unsigned) {
+    return false;
+}
+
+void io_ring::write(int, const void*, size_t, uint64_t, int, uint64_t, bool) {
+    always_assert(0);
+}
+
+void io_ring::fdatasync(int, uint64_t) {
+    always_assert(0);
+}
+
+int io_ring::submit() {
+    return -ENOSYS;
+}
+
+bool io_ring::wait(completion&) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,84 @@
+/* Masstree
+ * Eddie Kohler, Yandong Mao, Robert Morris
+ * Copyright (c) 2012-2014 President and Fellows of Harvard College
+ * Copyright (c) 2012-2014 Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Masstree LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Masstree LICENSE file; the license in that file
+ * is legally binding.
+ */
+#ifndef MASSTREE_IOURING_HH
+#define MASSTREE_IOURING_HH
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+// A minimal io_uring submission/completion queue for file writes, used by
+// the log flusher and the checkpoint writer. One thread submits and one
+// thread (possibly another) reaps completions.
+//
+// make() returns null if io_uring is unavailable (not compiled in, an old
+// kernel, a seccomp filter) or disabled, and callers fall back to
+// ordinary write() and fsync().
+class io_ring {
+  public:
+    struct completion {
+        uint64_t tag;
+        int result;             // bytes written, 0, or -errno
+    };
+
+    static io_ring* make(unsigned entries);
+    ~io_ring();
+
+    // Register buffers for fixed writes. Fails, leaving writes to use
+    // ordinary buffers, if the pages can't be pinned (RLIMIT_MEMLOCK).
+    bool register_buffers(const struct iovec* iov, unsigned n);
+    bool registered() const {
+        return registered_;
+    }
+
+    // Queue a write of [buf, buf + len) at offset off. If buf_index >= 0,
+    // buf lies in that registered buffer. If link, the next queued
+    // operation starts only after this one succeeds.
+    void write(int fd, const void* buf, size_t len, uint64_t off,
+               int buf_index, uint64_t tag, bool link = false);
+    void fdatasync(int fd, uint64_t tag);
+    // Submit queued operations; returns the number submitted or -errno.
+    int submit();
+    // Wait for a completion. Returns false if interrupted.
+    bool wait(completion& c);
+
+    static bool enabled;
+
+  private:
+    int fd_;
+    bool registered_;
+    unsigned sq_entries_;
+    unsigned cq_entries_;
+    unsigned to_submit_;
+    void* sq_map_;
+    size_t sq_map_size_;
+    void* cq_map_;
+    size_t cq_map_size_;
+    void* sqe_map_;
+    size_t sqe_map_size_;
+    unsigned* sq_head_;
+    unsigned* sq_tail_;
+    unsigned* sq_mask_;
+    unsigned* sq_array_;
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned* cq_mask_;
+    void* cqes_;
+
+    io_ring();
+    void* next_sqe();
+};
+
+#endif
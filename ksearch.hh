@@ -16,6 +16,10 @@
 #ifndef KSEARCH_HH
 #define KSEARCH_HH 1
 #include "kpermuter.hh"
+#include <type_traits>
+#if __AVX2__ || __AVX512F__
+# include <immintrin.h>
+#endif
 
 template <typename KA, typename T>
 struct key_comparator {
@@ -153,11 +157,134 @@ struct key_bound_linear {
     }
 };
 
+// SIMD search compares the search ikey against every ikey slot in the
+// node at once. The number of live slots with a smaller ikey is the lower
+// bound's rank; the few live slots with an equal ikey (keys that differ
+// only in length or suffix) are resolved with compare_key. This replaces
+// the binary search's data-dependent branches with a fixed amount of work.
+// The vector code is used when the compiler targets AVX-512 or AVX2
+// (e.g., CXXFLAGS=-march=native). Other ikey types build the masks with a
+// branch-free scalar loop.
+template <typename I>
+inline typename std::enable_if<std::is_integral<I>::value, I>::type
+key_bound_ikey(I ikey) {
+    return ikey;
+}
+template <typename KA>
+inline auto key_bound_ikey(const KA& ka) -> decltype(ka.ikey()) {
+    return ka.ikey();
+}
+
+template <int W>
+inline uint64_t key_live_mask(const kpermuter<W>& perm) {
+    // a kpermuter lists every slot, so a fixed-length loop avoids a
+    // mispredicted exit
+    uint64_t live = 0;
+    int n = perm.size();
+    for (int i = 0; i != W; ++i)
+        live |= uint64_t(i < n) << perm[i];
+    return live;
+}
+inline uint64_t key_live_mask(const identity_kpermuter& perm) {
+    return (uint64_t(1) << perm.size()) - 1;
+}
+
+// Set bit i of lt (eq) if ikeys[i] < ikey (ikeys[i] == ikey), i < W.
+template <int W, typename I>
+inline void key_compare_masks(const I* ikeys, I ikey,
+                              uint64_t& lt, uint64_t& eq) {
+    uint64_t l = 0, e = 0;
+    for (int i = 0; i != W; ++i) {
+        l |= uint64_t(ikeys[i] < ikey) << i;
+        e |= uint64_t(ikeys[i] == ikey) << i;
+    }
+    lt = l;
+    eq = e;
+}
+
+#if __AVX512F__
+template <int W>
+inline void key_compare_masks(const uint64_t* ikeys, uint64_t ikey,
+                              uint64_t& lt, uint64_t& eq) {
+    __m512i k = _mm512_set1_epi64(ikey);
+    uint64_t l = 0, e = 0;
+    for (int i = 0; i < W; i += 8) {
+        __mmask8 m = W - i >= 8 ? 0xFF : (1U << (W - i)) - 1;
+        __m512i x = _mm512_maskz_loadu_epi64(m, ikeys + i);
+        l |= uint64_t(_mm512_mask_cmplt_epu64_mask(m, x, k)) << i;
+        e |= uint64_t(_mm512_mask_cmpeq_epu64_mask(m, x, k)) << i;
+    }
+    lt = l;
+    eq = e;
+}
+#elif __AVX2__
+template <int W>
+inline void key_compare_masks(const uint64_t* ikeys, uint64_t ikey,
+                              uint64_t& lt, uint64_t& eq) {
+    if (W < 4)
+        return key_compare_masks<W, uint64_t>(ikeys, ikey, lt, eq);
+    // AVX2 has only signed 64-bit comparison; flip the sign bits.
+    const __m256i sign = _mm256_set1_epi64x(int64_t(1) << 63);
+    __m256i k = _mm256_set1_epi64x(ikey);
+    __m256i ks = _mm256_xor_si256(k, sign);
+    uint64_t l = 0, e = 0;
+    for (int i = 0; i < W; i += 4) {
+        // the last group overlaps the previous one instead of reading
+        // past the array
+        int j = W - i >= 4 ? i : W - 4;
+        __m256i x = _mm256_loadu_si256((const __m256i*) (ikeys + j));
+        __m256i xs = _mm256_xor_si256(x, sign);
+        unsigned ml = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(ks, xs)));
+        unsigned me = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(k, x)));
+        l |= uint64_t(ml >> (i - j)) << i;
+        e |= uint64_t(me >> (i - j)) << i;
+    }
+    lt = l;
+    eq = e;
+}
+#endif
+
+struct key_bound_simd {
+    static constexpr bool is_binary = false;
+    template <typename KA, typename T>
+    static inline int upper(const KA& ka, const T& n) {
+        typename key_permuter<T>::type perm = key_permuter<T>::permutation(n);
+        uint64_t lt, eq;
+        key_compare_masks<T::width>(n.ikey_array(), key_bound_ikey(ka), lt, eq);
+        uint64_t live = key_live_mask(perm);
+        int l = __builtin_popcountll(lt & live);
+        for (eq &= live; eq; eq &= eq - 1)
+            l += n.compare_key(ka, ctz(eq)) >= 0;
+        return l;
+    }
+    template <typename KA, typename T>
+    static inline key_indexed_position lower(const KA& ka, const T& n) {
+        typename key_permuter<T>::type perm = key_permuter<T>::permutation(n);
+        uint64_t lt, eq;
+        key_compare_masks<T::width>(n.ikey_array(), key_bound_ikey(ka), lt, eq);
+        uint64_t live = key_live_mask(perm);
+        int l = __builtin_popcountll(lt & live), p = -1;
+        for (eq &= live; eq; eq &= eq - 1) {
+            int cmp = n.compare_key(ka, ctz(eq));
+            if (cmp > 0)
+                ++l;
+            else if (cmp == 0)
+                p = ctz(eq);
+        }
+        return key_indexed_position(l, p);
+    }
+    template <typename KA, typename T, typename F>
+    static inline key_indexed_position lower_by(const KA& ka, const T& n, F comparator) {
+        return key_lower_bound_by(ka, n, comparator);
+    }
+};
+
 
 enum {
     bound_method_fast = 0,
     bound_method_binary,
-    bound_method_linear
+    bound_method_linear,
+    bound_method_simd
 };
 template <int max_size, int method = bound_method_fast> struct key_bound {};
 template <int max_size> struct key_bound<max_size, bound_method_binary> {
@@ -166,6 +293,15 @@ template <int max_size> struct key_bound<max_size, bound_method_binary> {
 template <int max_size> struct key_bound<max_size, bound_method_linear> {
     typedef key_bound_linear type;
 };
+// Without vector instructions, the SIMD method is the binary search.
+template <int max_size> struct key_bound<max_size, bound_method_simd> {
+#if __AVX2__ || __AVX512F__
+    typedef typename std::conditional<(max_size < 64), key_bound_simd,
+                                      key_bound_binary>::type type;
+#else
+    typedef key_bound_binary type;
+#endif
+};
 template <int max_size> struct key_bound<max_size, bound_method_fast> {
     typedef typename key_bound<max_size, (max_size > 16 ? bound_method_binary : bound_method_linear)>::type type;
 };
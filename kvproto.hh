@@ -16,6 +16,7 @@
 #ifndef KVPROTO_HH
 #define KVPROTO_HH
 #include "compiler.hh"
+#include "str.hh"
 
 enum {
     Cmd_None = 0,
@@ -26,10 +27,17 @@ enum {
     Cmd_Remove = 10,
     Cmd_Checkpoint = 12,
     Cmd_Handshake = 14,
+    Cmd_MultiGet = 16,
+    Cmd_RemoveRange = 18,
+    Cmd_Increment = 20,
+    Cmd_Append = 22,
+    Cmd_CompareAndSwap = 24,
+    Cmd_Stats = 26,
     Cmd_Max
 };
 
 enum result_t {
+    Rejected = -3,              // the row type can't hold the value
     NotFound = -2,
     Retry,
     OutOfDate,
@@ -54,4 +62,18 @@ inline bool row_is_marker(const R* row) {
     return row->timestamp() & 1;
 }
 
+// Tree slots hold pointers to rows, except for row types stored in the
+// slot itself, which specialize row_slot. row() returns a slot's row;
+// fits(col, value) says whether a row can store value in column col.
+template <typename R>
+struct row_slot {
+    typedef R* type;
+    static R* row(R* value) {
+        return value;
+    }
+    static bool fits(int, lcdf::Str) {
+        return true;
+    }
+};
+
 #endif
@@ -16,6 +16,7 @@
 #include "kvrandom.hh"
 #include "compiler.hh"
 #include <stdio.h>
+#include <math.h>
 
 const uint32_t kvrandom_psdes_nr::c1[] = {
     0xBAA96887U, 0x1E17D32CU, 0x03BCDC3CU, 0x0F33D1B2U
@@ -36,3 +37,28 @@ uint32_t kvrandom_psdes_nr::psdes(uint32_t lword, uint32_t irword) {
     }
     return irword;
 }
+
+static double zeta(uint64_t first, uint64_t last, double theta) {
+    double sum = 0;
+    for (uint64_t i = first; i <= last; ++i)
+        sum += 1 / pow(double(i), theta);
+    return sum;
+}
+
+kvrandom_zipfian_distribution::kvrandom_zipfian_distribution(uint64_t n,
+                                                             double theta)
+    : n_(0), theta_(theta), alpha_(1 / (1 - theta)),
+      half_pow_theta_(pow(0.5, theta)), zeta2_(zeta(1, 2, theta)), zetan_(0) {
+    always_assert(theta > 0 && theta < 1);
+    resize(n);
+}
+
+void kvrandom_zipfian_distribution::resize(uint64_t n) {
+    always_assert(n > 0);
+    if (n > n_)
+        zetan_ += zeta(n_ + 1, n, theta_);
+    else if (n < n_)
+        zetan_ = zeta(1, n, theta_);
+    n_ = n;
+    eta_ = (1 - pow(2.0 / n_, 1 - theta_)) / (1 - zeta2_ / zetan_);
+}
@@ -18,6 +18,9 @@
 #include <inttypes.h>
 #include <stdlib.h>
 #include <random>
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
 
 // A simple LCG with parameters from Numerical Recipes.
 class kvrandom_lcg_nr_simple {
@@ -147,4 +150,121 @@ private:
 // the std::bernoulli_distribution is fast enough
 using kvrandom_bernoulli_distribution = std::bernoulli_distribution;
 
+// a double uniformly distributed in [0, 1)
+template <typename G>
+inline double kvrandom_unit(G& g) {
+    return (g() - G::min()) / (double(G::max() - G::min()) + 1);
+}
+
+// Zipfian-distributed integers in [0, n), where item i is chosen with
+// probability proportional to 1/(i+1)^theta, so 0 is the most popular.
+// Uses the method of Gray et al., "Quickly generating billion-record
+// synthetic databases" (SIGMOD 1994), as YCSB does. Construction takes
+// O(n) time; resize() extends the item count incrementally.
+class kvrandom_zipfian_distribution {
+public:
+    using result_type = uint64_t;
+
+    kvrandom_zipfian_distribution(uint64_t n, double theta = 0.99);
+    uint64_t n() const {
+        return n_;
+    }
+    double theta() const {
+        return theta_;
+    }
+    void resize(uint64_t n);
+    template <typename G>
+    result_type operator()(G& g) const {
+        double u = kvrandom_unit(g);
+        double uz = u * zetan_;
+        if (uz < 1)
+            return 0;
+        if (uz < 1 + half_pow_theta_)
+            return 1;
+        uint64_t x = n_ * pow(eta_ * u - eta_ + 1, alpha_);
+        return x < n_ ? x : n_ - 1;
+    }
+private:
+    uint64_t n_;
+    double theta_;
+    double alpha_;
+    double half_pow_theta_;
+    double zeta2_;
+    double zetan_;
+    double eta_;
+};
+
+// Zipfian popularity with the popular items scattered over [0, n) by a
+// hash, so hot items aren't neighbors (YCSB's default request
+// distribution). Hash collisions make the skew slightly uneven.
+class kvrandom_scrambled_zipfian_distribution {
+public:
+    using result_type = uint64_t;
+
+    kvrandom_scrambled_zipfian_distribution(uint64_t n, double theta = 0.99)
+        : zipf_(n, theta) {
+    }
+    template <typename G>
+    result_type operator()(G& g) const {
+        return scramble(zipf_(g)) % zipf_.n();
+    }
+    // 64-bit FNV-1a over the bytes of x
+    static uint64_t scramble(uint64_t x) {
+        uint64_t h = 0xCBF29CE484222325ULL;
+        for (int i = 0; i != 8; ++i, x >>= 8)
+            h = (h ^ (x & 0xFF)) * 0x100000001B3ULL;
+        return h;
+    }
+private:
+    kvrandom_zipfian_distribution zipf_;
+};
+
+// Zipfian skew toward the most recently added of n items: n-1 is the
+// most popular. Call resize() as items are added.
+class kvrandom_latest_distribution {
+public:
+    using result_type = uint64_t;
+
+    kvrandom_latest_distribution(uint64_t n, double theta = 0.99)
+        : zipf_(n, theta) {
+    }
+    void resize(uint64_t n) {
+        zipf_.resize(n);
+    }
+    template <typename G>
+    result_type operator()(G& g) const {
+        return zipf_.n() - 1 - zipf_(g);
+    }
+private:
+    kvrandom_zipfian_distribution zipf_;
+};
+
+// A hot set of the first hot_fraction of [0, n) receives hot_ops of the
+// requests; both sets are uniform internally.
+class kvrandom_hotspot_distribution {
+public:
+    using result_type = uint64_t;
+
+    kvrandom_hotspot_distribution(uint64_t n, double hot_fraction = 0.2,
+                                  double hot_ops = 0.8)
+        : n_(n), hot_ops_(hot_ops) {
+        assert(n > 0 && hot_fraction >= 0 && hot_fraction <= 1);
+        nhot_ = std::max(uint64_t(n * hot_fraction), uint64_t(1));
+        nhot_ = std::min(nhot_, n);
+    }
+    template <typename G>
+    result_type operator()(G& g) const {
+        double u = kvrandom_unit(g);
+        if (u < hot_ops_ || nhot_ == n_)
+            return std::min(uint64_t(kvrandom_unit(g) * nhot_), nhot_ - 1);
+        else
+            return nhot_ + std::min(uint64_t(kvrandom_unit(g) * (n_ - nhot_)),
+                                    n_ - nhot_ - 1);
+    }
+private:
+    uint64_t n_;
+    uint64_t nhot_;
+    double hot_ops_;
+};
+
 #endif
@@ -19,6 +19,8 @@
 #include "kvproto.hh"
 #include "log.hh"
 #include "json.hh"
+#include "msgpack.hh"
+#include "masstree.hh"
 #include <algorithm>
 
 #if MASSTREE_ROW_TYPE_ARRAY
@@ -30,6 +32,9 @@ typedef value_versioned_array row_type;
 #elif MASSTREE_ROW_TYPE_STR
 # include "value_string.hh"
 typedef value_string row_type;
+#elif MASSTREE_ROW_TYPE_INLINE
+# include "value_inline.hh"
+typedef value_inline row_type;
 #else
 # include "value_bag.hh"
 typedef value_bag<uint16_t> row_type;
@@ -40,28 +45,86 @@ struct query_helper {
     inline const R* snapshot(const R* row, const std::vector<typename R::index_type>&, threadinfo&) {
         return row;
     }
+    static inline lcdf::String column(Str col) {
+        return lcdf::String::make_stable(col);
+    }
+    inline R* update(R* row, const lcdf::Json* first, const lcdf::Json* last,
+                     kvtimestamp_t ts, threadinfo& ti) {
+        return row->update(first, last, ts, ti);
+    }
 };
 
 template <typename R> class query_json_scanner;
+template <typename R, typename F> class query_range_remover;
 
 template <typename R>
 class query {
   public:
     typedef lcdf::Json Json;
+    typedef typename row_slot<R>::type slot_type;
+
+    query()
+        : log_position_(0) {
+    }
 
     template <typename T>
     void run_get(T& table, Json& req, threadinfo& ti);
+    // value is valid until the next query on this object.
     template <typename T>
     bool run_get1(T& table, Str key, int col, Str& value, threadinfo& ti);
+    // Return key's row with at least fields [fields, fields + nfields)
+    // stable (all columns if nfields == 0), or null if key is absent.
+    // The row is valid until the next query on this object.
+    template <typename T>
+    const R* run_get_row(T& table, Str key, const int* fields, int nfields,
+                         threadinfo& ti);
+    // request is [seq, cmd, [key...], field...]; result is one row per
+    // key, in order, null for a missing key. Each group of keys is first
+    // walked together by prefetch_paths(), which overlaps their cache
+    // misses, and then looked up one by one.
+    template <typename T>
+    void run_multiget(T& table, Json& req, threadinfo& ti);
 
+    // If logging, put logs changeset if nonempty, or else the msgpack
+    // encoding of [firstreq, lastreq). Put and replace change nothing
+    // and return Rejected if the row type can't hold a value.
     template <typename T>
     result_t run_put(T& table, Str key,
-                     const Json* firstreq, const Json* lastreq, threadinfo& ti);
+                     const Json* firstreq, const Json* lastreq, threadinfo& ti,
+                     Str changeset = Str());
     template <typename T>
     result_t run_replace(T& table, Str key, Str value, threadinfo& ti);
     template <typename T>
     bool run_remove(T& table, Str key, threadinfo& ti);
+    // Remove every key in [first, last), calling removed(key, ts) for
+    // each, and log one range tombstone.
+    template <typename T, typename F>
+    uint64_t run_remove_range(T& table, Str first, Str last, F& removed,
+                              threadinfo& ti);
+
+    // Atomic read-modify-write of one column. Each rewrites req, which is
+    // [seq, cmd, key, col, args...], as [seq, cmd, result...].
+    // Increment: args are [delta]; result is the new value, or null if
+    // the column doesn't hold an integer, the sum overflows, or the row
+    // can't hold the new value. A missing column counts as 0.
+    template <typename T>
+    void run_increment(T& table, Json& req, threadinfo& ti);
+    // Append: args are [suffix]; result is the column's new length, or
+    // null if the row can't hold the new value.
+    template <typename T>
+    void run_append(T& table, Json& req, threadinfo& ti);
+    // CompareAndSwap: args are [expected, value]. expected is the
+    // column's current value, an integer row timestamp, or null for a
+    // missing key. Result is [ok, current column value, row timestamp];
+    // ok is null if the row can't hold value.
+    template <typename T>
+    void run_cas(T& table, Json& req, threadinfo& ti);
 
+    // request is [seq, cmd, firstkey, count, field..., options?]. The
+    // optional trailing object may set "end", an exclusive end key (a
+    // reverse scan stops at keys <= end); "keys", to return only keys;
+    // "reverse", to scan downward from firstkey; and "max_bytes", to
+    // stop once the returned keys and values reach that many bytes.
     template <typename T>
     void run_scan(T& table, Json& request, threadinfo& ti);
     template <typename T>
@@ -72,25 +135,42 @@ class query {
     const loginfo::query_times& query_times() const {
         return qtimes_;
     }
+    // Log position of the last put/replace/remove's log record, or 0.
+    uint64_t log_position() const {
+        return log_position_;
+    }
 
   private:
     std::vector<typename R::index_type> f_;
     loginfo::query_times qtimes_;
+    uint64_t log_position_;
     query_helper<R> helper_;
     lcdf::String scankey_;
     int scankeypos_;
+    std::vector<Str> multikeys_;
+    lcdf::StringAccum logbuf_;
+    Masstree::finger finger_;   // where this thread's last get or put ended
 
     void emit_fields(const R* value, Json& req, threadinfo& ti);
     void emit_fields1(const R* value, Json& req, threadinfo& ti);
     void assign_timestamp(threadinfo& ti);
     void assign_timestamp(threadinfo& ti, kvtimestamp_t t);
-    inline bool apply_put(R*& value, bool found, const Json* firstreq,
-                          const Json* lastreq, threadinfo& ti);
-    inline bool apply_replace(R*& value, bool found, Str new_value,
-                              threadinfo& ti);
-    inline void apply_remove(R*& value, kvtimestamp_t& node_ts, threadinfo& ti);
+    inline void log(int command, Str key, Str value, threadinfo& ti);
+    inline bool apply_put(slot_type& value, bool found, Str key,
+                          const Json* firstreq, const Json* lastreq,
+                          Str changeset, threadinfo& ti);
+    inline bool apply_replace(slot_type& value, bool found, Str key,
+                              Str new_value, threadinfo& ti);
+    static bool fits(const Json* firstreq, const Json* lastreq);
+    template <typename T, typename F>
+    result_t run_modify(T& table, Str key, int col, F& modify,
+                        threadinfo& ti);
+    static bool parse_integer(Str s, int64_t& x);
+    inline void apply_remove(slot_type& value, Str key,
+                             kvtimestamp_t& node_ts, threadinfo& ti);
 
     template <typename RR> friend class query_json_scanner;
+    template <typename RR, typename F> friend class query_range_remover;
 };
 
 
@@ -99,10 +179,10 @@ void query<R>::emit_fields(const R* value, Json& req, threadinfo& ti) {
     const R* snapshot = helper_.snapshot(value, f_, ti);
     if (f_.empty()) {
         for (int i = 0; i != snapshot->ncol(); ++i)
-            req.push_back(lcdf::String::make_stable(snapshot->col(i)));
+            req.push_back(helper_.column(snapshot->col(i)));
     } else {
         for (int i = 0; i != (int) f_.size(); ++i)
-            req.push_back(lcdf::String::make_stable(snapshot->col(f_[i])));
+            req.push_back(helper_.column(snapshot->col(f_[i])));
     }
 }
 
@@ -110,22 +190,22 @@ template <typename R>
 void query<R>::emit_fields1(const R* value, Json& req, threadinfo& ti) {
     const R* snapshot = helper_.snapshot(value, f_, ti);
     if ((f_.empty() && snapshot->ncol() == 1) || f_.size() == 1)
-        req = lcdf::String::make_stable(snapshot->col(f_.empty() ? 0 : f_[0]));
+        req = helper_.column(snapshot->col(f_.empty() ? 0 : f_[0]));
     else if (f_.empty()) {
         for (int i = 0; i != snapshot->ncol(); ++i)
-            req.push_back(lcdf::String::make_stable(snapshot->col(i)));
+            req.push_back(helper_.column(snapshot->col(i)));
     } else {
         for (int i = 0; i != (int) f_.size(); ++i)
-            req.push_back(lcdf::String::make_stable(snapshot->col(f_[i])));
+            req.push_back(helper_.column(snapshot->col(f_[i])));
     }
 }
 
 
 template <typename R> template <typename T>
 void query<R>::run_get(T& table, Json& req, threadinfo& ti) {
-    typename T::unlocked_cursor_type lp(table, req[2].as_s());
+    typename T::unlocked_cursor_type lp(table, req[2].as_s(), finger_);
     bool found = lp.find_unlocked(ti);
-    if (found && row_is_marker(lp.value()))
+    if (found && row_is_marker(row_slot<R>::row(lp.value())))
         found = false;
     if (found) {
         f_.clear();
@@ -133,21 +213,64 @@ void query<R>::run_get(T& table, Json& req, threadinfo& ti) {
             f_.push_back(req[i].as_i());
         }
         req.resize(2);
-        emit_fields(lp.value(), req, ti);
+        emit_fields(row_slot<R>::row(lp.value()), req, ti);
+    }
+}
+
+// req is [seq, cmd, [key...], field...]. Replaces the keys with an array
+// holding, for each key, null if not found and otherwise the fields as
+// Cmd_Get would return them. Keys are looked up in groups whose tree
+// paths are prefetched together.
+template <typename R> template <typename T>
+void query<R>::run_multiget(T& table, Json& req, threadinfo& ti) {
+    enum { group = 16 };
+    f_.clear();
+    for (int i = 3; i != req.size(); ++i)
+        f_.push_back(req[i].as_i());
+    Json keys = std::move(req[2]);
+    multikeys_.clear();
+    for (int i = 0; i != keys.size(); ++i)
+        multikeys_.push_back(keys[i].as_s());
+    req.resize(3);
+    req[2] = Json::make_array_reserve(multikeys_.size());
+
+    Json& result = req[2];
+    for (size_t g = 0; g < multikeys_.size(); g += group) {
+        int n = std::min(multikeys_.size() - g, size_t(group));
+        table.prefetch_paths(multikeys_.data() + g, n, ti);
+        for (int i = 0; i != n; ++i) {
+            typename T::unlocked_cursor_type lp(table, multikeys_[g + i]);
+            bool found = lp.find_unlocked(ti);
+            result.push_back(Json());
+            if (found && !row_is_marker(row_slot<R>::row(lp.value())))
+                emit_fields(row_slot<R>::row(lp.value()), result.back(), ti);
+        }
     }
 }
 
 template <typename R> template <typename T>
 bool query<R>::run_get1(T& table, Str key, int col, Str& value, threadinfo& ti) {
-    typename T::unlocked_cursor_type lp(table, key);
+    typename T::unlocked_cursor_type lp(table, key, finger_);
     bool found = lp.find_unlocked(ti);
-    if (found && row_is_marker(lp.value()))
+    if (found && row_is_marker(row_slot<R>::row(lp.value())))
         found = false;
-    if (found)
-        value = lp.value()->col(col);
+    if (found) {
+        f_.assign(1, col);
+        value = helper_.snapshot(row_slot<R>::row(lp.value()), f_, ti)->col(col);
+    }
     return found;
 }
 
+template <typename R> template <typename T>
+const R* query<R>::run_get_row(T& table, Str key, const int* fields,
+                               int nfields, threadinfo& ti) {
+    typename T::unlocked_cursor_type lp(table, key, finger_);
+    if (!lp.find_unlocked(ti) || row_is_marker(row_slot<R>::row(lp.value())))
+        return nullptr;
+    f_.assign(fields, fields + nfields);
+    return helper_.snapshot(row_slot<R>::row(lp.value()), f_, ti);
+}
+
 
 template <typename R>
 inline void query<R>::assign_timestamp(threadinfo& ti) {
@@ -162,102 +285,131 @@ inline void query<R>::assign_timestamp(threadinfo& ti, kvtimestamp_t min_ts) {
 }
 
 
+// Log a write. Called with the row locked, after assigning timestamps
+// but before the new value is visible.
+template <typename R>
+inline void query<R>::log(int command, Str key, Str value, threadinfo& ti) {
+    if (loginfo* logger = ti.logger()) {
+        qtimes_.epoch = global_log_epoch;
+        log_position_ = logger->record(command, qtimes_, key, value);
+    }
+}
+
+template <typename R>
+bool query<R>::fits(const Json* firstreq, const Json* lastreq) {
+    for (; firstreq != lastreq; firstreq += 2)
+        if (!row_slot<R>::fits(firstreq[0].as_i(), firstreq[1].as_s()))
+            return false;
+    return true;
+}
+
 template <typename R> template <typename T>
 result_t query<R>::run_put(T& table, Str key,
                            const Json* firstreq, const Json* lastreq,
-                           threadinfo& ti) {
-    typename T::cursor_type lp(table, key);
+                           threadinfo& ti, Str changeset) {
+    if (!fits(firstreq, lastreq))
+        return Rejected;
+    typename T::cursor_type lp(table, key, finger_);
     bool found = lp.find_insert(ti);
     if (!found) {
         ti.observe_phantoms(lp.node());
+    } else {
+        lp.mark_value_update();
     }
-    bool inserted = apply_put(lp.value(), found, firstreq, lastreq, ti);
+    bool inserted = apply_put(lp.value(), found, key, firstreq, lastreq,
+                              changeset, ti);
     lp.finish(1, ti);
     return inserted ? Inserted : Updated;
 }
 
 template <typename R>
-inline bool query<R>::apply_put(R*& value, bool found, const Json* firstreq,
-                                const Json* lastreq, threadinfo& ti) {
-    if (loginfo* log = ti.logger()) {
-        log->acquire();
-        qtimes_.epoch = global_log_epoch;
+inline bool query<R>::apply_put(slot_type& value, bool found, Str key,
+                                const Json* firstreq, const Json* lastreq,
+                                Str changeset, threadinfo& ti) {
+    log_position_ = 0;
+    if (ti.logger() && !changeset) {
+        logbuf_.clear();
+        msgpack::unparser<lcdf::StringAccum> cu(logbuf_);
+        for (const Json* req = firstreq; req != lastreq; ++req)
+            cu << *req;
+        changeset = Str(logbuf_.data(), logbuf_.length());
     }
 
     if (!found) {
     insert:
         assign_timestamp(ti);
+        log(logcmd_put, key, changeset, ti);
         value = R::create(firstreq, lastreq, qtimes_.ts, ti);
         return true;
     }
 
-    R* old_value = value;
+    R* old_value = row_slot<R>::row(value);
     assign_timestamp(ti, old_value->timestamp());
     if (row_is_marker(old_value)) {
         old_value->deallocate_rcu(ti);
         goto insert;
     }
 
-    R* updated = old_value->update(firstreq, lastreq, qtimes_.ts, ti);
-    if (updated != old_value) {
-        value = updated;
+    log(logcmd_put, key, changeset, ti);
+    slot_type updated = helper_.update(value, firstreq, lastreq, qtimes_.ts, ti);
+    if (row_slot<R>::row(updated) != old_value) {
         old_value->deallocate_rcu_after_update(firstreq, lastreq, ti);
+        value = updated;
     }
     return false;
 }
 
 template <typename R> template <typename T>
 result_t query<R>::run_replace(T& table, Str key, Str value, threadinfo& ti) {
-    typename T::cursor_type lp(table, key);
+    if (!row_slot<R>::fits(0, value))
+        return Rejected;
+    typename T::cursor_type lp(table, key, finger_);
     bool found = lp.find_insert(ti);
     if (!found) {
         ti.observe_phantoms(lp.node());
+    } else {
+        lp.mark_value_update();
     }
-    bool inserted = apply_replace(lp.value(), found, value, ti);
+    bool inserted = apply_replace(lp.value(), found, key, value, ti);
     lp.finish(1, ti);
     return inserted ? Inserted : Updated;
 }
 
 template <typename R>
-inline bool query<R>::apply_replace(R*& value, bool found, Str new_value,
-                                    threadinfo& ti) {
-    if (loginfo* log = ti.logger()) {
-        log->acquire();
-        qtimes_.epoch = global_log_epoch;
-    }
-
-    bool inserted = !found || row_is_marker(value);
+inline bool query<R>::apply_replace(slot_type& value, bool found, Str key,
+                                    Str new_value, threadinfo& ti) {
+    log_position_ = 0;
+    R* old_value = found ? row_slot<R>::row(value) : nullptr;
+    bool inserted = !found || row_is_marker(old_value);
     if (!found) {
         assign_timestamp(ti);
     } else {
-        assign_timestamp(ti, value->timestamp());
-        value->deallocate_rcu(ti);
+        assign_timestamp(ti, old_value->timestamp());
+        old_value->deallocate_rcu(ti);
     }
 
+    log(logcmd_replace, key, new_value, ti);
     value = R::create1(new_value, qtimes_.ts, ti);
     return inserted;
 }
 
 template <typename R> template <typename T>
 bool query<R>::run_remove(T& table, Str key, threadinfo& ti) {
-    typename T::cursor_type lp(table, key);
+    typename T::cursor_type lp(table, key, finger_);
     bool found = lp.find_locked(ti);
+    log_position_ = 0;
     if (found)
-        apply_remove(lp.value(), lp.node()->phantom_epoch_[0], ti);
+        apply_remove(lp.value(), key, lp.node()->phantom_epoch_[0], ti);
     lp.finish(-1, ti);
     return found;
 }
 
 template <typename R>
-inline void query<R>::apply_remove(R*& value, kvtimestamp_t& node_ts,
-                                   threadinfo& ti) {
-    if (loginfo* log = ti.logger()) {
-        log->acquire();
-        qtimes_.epoch = global_log_epoch;
-    }
-
-    R* old_value = value;
+inline void query<R>::apply_remove(slot_type& value, Str key,
+                                   kvtimestamp_t& node_ts, threadinfo& ti) {
+    R* old_value = row_slot<R>::row(value);
     assign_timestamp(ti, old_value->timestamp());
+    log(logcmd_remove, key, Str(), ti);
     if (circular_int<kvtimestamp_t>::less_equal(node_ts, qtimes_.ts)) {
         node_ts = qtimes_.ts + 2;
     }
@@ -265,16 +417,190 @@ inline void query<R>::apply_remove(R*& value, kvtimestamp_t& node_ts,
 }
 
 
+// Rows older than a range tombstone's timestamp are removed, here and in
+// log replay. The timestamp is a new timestamp_floor, so every row that
+// exists when the remove starts is older; the phantom epochs of visited
+// leaves ensure rows inserted behind the remove are newer.
+template <typename R, typename F>
+class query_range_remover {
+  public:
+    query_range_remover(query<R>& q, F& removed)
+        : q_(q), removed_(removed) {
+    }
+    template <typename N>
+    void visit_leaf(N* n, threadinfo&) {
+        kvtimestamp_t ts = q_.qtimes_.ts | 1;
+        if (circular_int<kvtimestamp_t>::less_equal(n->phantom_epoch_[0], ts))
+            n->phantom_epoch_[0] = ts + 1;
+    }
+    bool visit_value(Str key, typename row_slot<R>::type& value,
+                     threadinfo& ti) {
+        R* row = row_slot<R>::row(value);
+        if (!circular_int<kvtimestamp_t>::less(row->timestamp(),
+                                               q_.qtimes_.ts | 1))
+            return false;
+        removed_(key, q_.qtimes_.ts);
+        row->deallocate_rcu(ti);
+        return true;
+    }
+  private:
+    query<R>& q_;
+    F& removed_;
+};
+
+template <typename R> template <typename T, typename F>
+uint64_t query<R>::run_remove_range(T& table, Str first, Str last,
+                                    F& removed, threadinfo& ti) {
+    threadinfo::raise_timestamp_floor();
+    assign_timestamp(ti);
+    log_position_ = 0;
+    log(logcmd_remove_range, first, last, ti);
+    query_range_remover<R, F> remover(*this, removed);
+    return table.remove_range(first, last, remover, ti);
+}
+
+
+// Read-modify-write commands compute a column's new value under the leaf
+// lock and apply it as a Put of that column, so the log records only the
+// new value and replay never reruns the modification. modify(row, value)
+// sets value from the current row (null if the key is absent) and returns
+// false to leave the row alone. Returns Updated if the row changed,
+// OutOfDate if modify declined, and Rejected if the row can't hold value.
+template <typename R> template <typename T, typename F>
+result_t query<R>::run_modify(T& table, Str key, int col, F& modify,
+                              threadinfo& ti) {
+    typename T::cursor_type lp(table, key, finger_);
+    bool found = lp.find_insert(ti);
+    const R* row = found ? row_slot<R>::row(lp.value()) : 0;
+    if (row && row_is_marker(row))
+        row = 0;
+    Json change[2] = {Json(col), Json()};
+    log_position_ = 0;
+    if (!modify(row, change[1])) {
+        lp.finish(0, ti);
+        return OutOfDate;
+    }
+    if (!fits(change, change + 2)) {
+        lp.finish(0, ti);
+        return Rejected;
+    }
+    if (!found)
+        ti.observe_phantoms(lp.node());
+    else
+        lp.mark_value_update();
+    apply_put(lp.value(), found, key, change, change + 2, Str(), ti);
+    lp.finish(1, ti);
+    return Updated;
+}
+
+template <typename R>
+bool query<R>::parse_integer(Str s, int64_t& x) {
+    const char* p = s.begin();
+    bool neg = p != s.end() && *p == '-';
+    p += neg;
+    if (p == s.end() && neg)
+        return false;
+    uint64_t v = 0;
+    for (; p != s.end(); ++p) {
+        int d = *p - '0';
+        if (d < 0 || d > 9 || v > (uint64_t(INT64_MAX) - d) / 10)
+            return false;
+        v = v * 10 + d;
+    }
+    x = neg ? -int64_t(v) : int64_t(v);
+    return true;
+}
+
+template <typename R> template <typename T>
+void query<R>::run_increment(T& table, Json& req, threadinfo& ti) {
+    int col = req[3].as_i();
+    int64_t delta = req[4].as_i(), x = 0;
+    auto modify = [&](const R* row, Json& value) {
+        if ((row && !parse_integer(row->col(col), x))
+            || __builtin_add_overflow(x, delta, &x))
+            return false;
+        value = lcdf::String((long long) x);
+        return true;
+    };
+    bool ok = run_modify(table, req[2].as_s(), col, modify, ti) == Updated;
+    req.resize(3);
+    req[2] = ok ? Json(x) : Json();
+}
+
+template <typename R> template <typename T>
+void query<R>::run_append(T& table, Json& req, threadinfo& ti) {
+    int col = req[3].as_i();
+    Str suffix = req[4].as_s();
+    int len = 0;
+    auto modify = [&](const R* row, Json& value) {
+        Str old = row ? row->col(col) : Str();
+        lcdf::StringAccum sa(old.length() + suffix.length());
+        sa << old << suffix;
+        len = sa.length();
+        value = sa.take_string();
+        return true;
+    };
+    result_t r = run_modify(table, req[2].as_s(), col, modify, ti);
+    req.resize(3);
+    req[2] = r == Updated ? Json(len) : Json();
+}
+
+template <typename R> template <typename T>
+void query<R>::run_cas(T& table, Json& req, threadinfo& ti) {
+    int col = req[3].as_i();
+    const Json& expected = req[4];
+    Json current;
+    kvtimestamp_t ts = 0;
+    auto modify = [&](const R* row, Json& value) {
+        bool match;
+        if (!row)
+            match = expected.is_null();
+        else if (expected.is_s())
+            match = row->col(col) == expected.as_s();
+        else
+            match = expected.is_int() && expected.to_u64() == row->timestamp();
+        if (row) {
+            current = lcdf::String(row->col(col));
+            ts = row->timestamp();
+        }
+        if (!match)
+            return false;
+        value = req[5];
+        return true;
+    };
+    result_t r = run_modify(table, req[2].as_s(), col, modify, ti);
+    if (r == Updated) {
+        current = req[5];
+        ts = qtimes_.ts;
+    }
+    req.resize(5);
+    req[2] = r == Rejected ? Json() : Json(r == Updated);
+    req[3] = std::move(current);
+    req[4] = ts;
+}
+
 template <typename R>
 class query_json_scanner {
   public:
     query_json_scanner(query<R>& q, lcdf::Json& request, std::vector<uint64_t>* scan_versions)
         : q_(q), nleft_(request[3].as_i()), request_(request),
-          scan_versions_(scan_versions) {
+          scan_versions_(scan_versions), reverse_(false), keys_only_(false),
+          max_bytes_(0), nbytes_(0) {
         std::swap(request[2].value().as_s(), firstkey_);
         request_.resize(2);
         q_.scankeypos_ = 0;
     }
+    query_json_scanner(query<R>& q, lcdf::Json& request,
+                       const lcdf::Json& options)
+        : query_json_scanner(q, request, nullptr) {
+        endkey_ = options["end"].as_s("");
+        reverse_ = options["reverse"].as_b(false);
+        keys_only_ = options["keys"].as_b(false);
+        max_bytes_ = std::max(options["max_bytes"].as_i(0), int64_t(0));
+    }
+    bool reverse() const {
+        return reverse_;
+    }
     const lcdf::String& firstkey() const {
         return firstkey_;
     }
@@ -285,8 +611,11 @@ class query_json_scanner {
             scan_versions_->push_back(scanstack.full_version_value());
         }
     }
-    bool visit_value(Str key, R* value, threadinfo& ti) {
-        if (row_is_marker(value)) {
+    bool visit_value(Str key, const typename row_slot<R>::type& value,
+                     threadinfo& ti) {
+        if (endkey_ && (reverse_ ? key <= endkey_ : key >= endkey_))
+            return false;
+        if (row_is_marker(row_slot<R>::row(value))) {
             return true;
         }
         // NB the `key` is not stable! We must save space for it.
@@ -298,10 +627,19 @@ class query_json_scanner {
                key.data(), key.length());
         request_.push_back(q_.scankey_.substr(q_.scankeypos_, key.length()));
         q_.scankeypos_ += key.length();
-        request_.push_back(lcdf::Json());
-        q_.emit_fields1(value, request_.back(), ti);
+        nbytes_ += key.length();
+        if (!keys_only_) {
+            request_.push_back(lcdf::Json());
+            q_.emit_fields1(row_slot<R>::row(value), request_.back(), ti);
+            const lcdf::Json& v = request_.back();
+            if (v.is_s())
+                nbytes_ += v.as_s().length();
+            else
+                for (int i = 0; i != v.size(); ++i)
+                    nbytes_ += v[i].as_s().length();
+        }
         --nleft_;
-        return nleft_ != 0;
+        return nleft_ != 0 && (!max_bytes_ || nbytes_ < max_bytes_);
     }
   private:
     query<R>& q_;
@@ -309,17 +647,33 @@ class query_json_scanner {
     lcdf::Json& request_;
     lcdf::String firstkey_;
     std::vector<uint64_t>* scan_versions_;
+    lcdf::String endkey_;
+    bool reverse_;
+    bool keys_only_;
+    uint64_t max_bytes_;        // 0 means no limit
+    uint64_t nbytes_;
 };
 
 template <typename R> template <typename T>
 void query<R>::run_scan(T& table, Json& request, threadinfo& ti) {
-    assert(request[3].as_i() > 0);
+    if (request[3].as_i() <= 0) {
+        request.resize(2);
+        return;
+    }
+    Json options;
+    if (request.back().is_o()) {
+        options = std::move(request.back());
+        request.pop_back();
+    }
     f_.clear();
     for (int i = 4; i != request.size(); ++i) {
         f_.push_back(request[i].as_i());
     }
-    query_json_scanner<R> scanf(*this, request, nullptr);
-    table.scan(scanf.firstkey(), true, scanf, ti);
+    query_json_scanner<R> scanf(*this, request, options);
+    if (scanf.reverse())
+        table.rscan(scanf.firstkey(), true, scanf, ti);
+    else
+        table.scan(scanf.firstkey(), true, scanf, ti);
 }
 
 template <typename R> template <typename T>
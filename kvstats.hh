@@ -16,6 +16,9 @@
 #ifndef KVSTATS_HH
 #define KVSTATS_HH 1
 #include <stdlib.h>
+#include <stdint.h>
+#include <algorithm>
+#include "json.hh"
 
 struct kvstats {
   double min, max, sum, sumsq;
@@ -50,4 +53,178 @@ struct kvstats {
   }
 };
 
+// log2-bucketed histogram: bucket i counts values in [2^(i-1), 2^i),
+// and bucket 0 counts zeros.
+struct kvhistogram {
+  enum { nbuckets = 65 };
+  uint64_t bucket[nbuckets];
+  uint64_t count, max;
+  double sum;
+  kvhistogram() {
+    clear();
+  }
+  void clear() {
+    for (int i = 0; i < nbuckets; ++i)
+      bucket[i] = 0;
+    count = max = 0;
+    sum = 0;
+  }
+  static int bucket_index(uint64_t x) {
+    return x ? 64 - __builtin_clzll(x) : 0;
+  }
+  void add(uint64_t x) {
+    ++bucket[bucket_index(x)];
+    ++count;
+    sum += x;
+    if (x > max)
+      max = x;
+  }
+  void merge(const kvhistogram &x) {
+    for (int i = 0; i < nbuckets; ++i)
+      bucket[i] += x.bucket[i];
+    count += x.count;
+    sum += x.sum;
+    if (x.max > max)
+      max = x.max;
+  }
+  // add() and merge() for histograms that one thread adds to while
+  // others merge them: the adder stores each field with a relaxed
+  // atomic store, and the merger loads each field atomically. A merge
+  // may see a value's bucket but not yet its count.
+  void add_relaxed(uint64_t x) {
+    uint64_t *b = &bucket[bucket_index(x)];
+    __atomic_store_n(b, *b + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&count, count + 1, __ATOMIC_RELAXED);
+    double s = sum + x;
+    __atomic_store(&sum, &s, __ATOMIC_RELAXED);
+    if (x > max)
+      __atomic_store_n(&max, x, __ATOMIC_RELAXED);
+  }
+  void merge_relaxed(const kvhistogram &x) {
+    for (int i = 0; i < nbuckets; ++i)
+      bucket[i] += __atomic_load_n(&x.bucket[i], __ATOMIC_RELAXED);
+    count += __atomic_load_n(&x.count, __ATOMIC_RELAXED);
+    double s;
+    __atomic_load(&x.sum, &s, __ATOMIC_RELAXED);
+    sum += s;
+    uint64_t m = __atomic_load_n(&x.max, __ATOMIC_RELAXED);
+    if (m > max)
+      max = m;
+  }
+  // upper bound of the bucket containing the q-th quantile
+  uint64_t quantile(double q) const {
+    uint64_t want = (uint64_t) (q * count), seen = 0;
+    for (int i = 0; i < nbuckets; ++i) {
+      seen += bucket[i];
+      if (seen > want || seen == count)
+        return i ? (i == 64 ? max : std::min(max, (uint64_t(1) << i) - 1)) : 0;
+    }
+    return max;
+  }
+  lcdf::Json unparse_json() const {
+    lcdf::Json j = lcdf::Json().set("n", count);
+    if (count) {
+      j.set("mean", sum / count).set("p50", quantile(0.5))
+        .set("p90", quantile(0.9)).set("p99", quantile(0.99))
+        .set("p999", quantile(0.999)).set("max", max);
+      lcdf::Json b = lcdf::Json::make_array();
+      int last = nbuckets - 1;
+      while (last > 0 && !bucket[last])
+        --last;
+      for (int i = 0; i <= last; ++i)
+        b.push_back(bucket[i]);
+      j.set("log2_buckets", b);
+    }
+    return j;
+  }
+};
+
+// log-linear histogram: each power of two is split into 2^sub_bits
+// equal buckets, so quantiles are accurate to within 1/2^sub_bits.
+// Values below 2^sub_bits get a bucket each.
+struct kvloglinear_histogram {
+  enum { sub_bits = 3, nsub = 1 << sub_bits,
+         nbuckets = (64 - sub_bits + 1) * nsub };
+  uint64_t bucket[nbuckets];
+  uint64_t count, max;
+  double sum;
+  kvloglinear_histogram() {
+    clear();
+  }
+  void clear() {
+    for (int i = 0; i < nbuckets; ++i)
+      bucket[i] = 0;
+    count = max = 0;
+    sum = 0;
+  }
+  static int bucket_index(uint64_t x) {
+    if (x < nsub)
+      return x;
+    int msb = 63 - __builtin_clzll(x);
+    return (msb - sub_bits + 1) * nsub + ((x >> (msb - sub_bits)) & (nsub - 1));
+  }
+  // largest value in bucket i
+  static uint64_t bucket_limit(int i) {
+    if (i < nsub)
+      return i;
+    int shift = i / nsub - 1;
+    uint64_t low = uint64_t(nsub + i % nsub) << shift;
+    return low + ((uint64_t(1) << shift) - 1);
+  }
+  void add(uint64_t x) {
+    ++bucket[bucket_index(x)];
+    ++count;
+    sum += x;
+    if (x > max)
+      max = x;
+  }
+  void merge(const kvloglinear_histogram &x) {
+    for (int i = 0; i < nbuckets; ++i)
+      bucket[i] += x.bucket[i];
+    count += x.count;
+    sum += x.sum;
+    if (x.max > max)
+      max = x.max;
+  }
+  // as in kvhistogram
+  void add_relaxed(uint64_t x) {
+    uint64_t *b = &bucket[bucket_index(x)];
+    __atomic_store_n(b, *b + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&count, count + 1, __ATOMIC_RELAXED);
+    double s = sum + x;
+    __atomic_store(&sum, &s, __ATOMIC_RELAXED);
+    if (x > max)
+      __atomic_store_n(&max, x, __ATOMIC_RELAXED);
+  }
+  void merge_relaxed(const kvloglinear_histogram &x) {
+    for (int i = 0; i < nbuckets; ++i)
+      bucket[i] += __atomic_load_n(&x.bucket[i], __ATOMIC_RELAXED);
+    count += __atomic_load_n(&x.count, __ATOMIC_RELAXED);
+    double s;
+    __atomic_load(&x.sum, &s, __ATOMIC_RELAXED);
+    sum += s;
+    uint64_t m = __atomic_load_n(&x.max, __ATOMIC_RELAXED);
+    if (m > max)
+      max = m;
+  }
+  // upper bound of the bucket containing the q-th quantile
+  uint64_t quantile(double q) const {
+    uint64_t want = (uint64_t) (q * count), seen = 0;
+    for (int i = 0; i < nbuckets; ++i) {
+      seen += bucket[i];
+      if (seen > want || seen == count)
+        return std::min(max, bucket_limit(i));
+    }
+    return max;
+  }
+  lcdf::Json unparse_json() const {
+    lcdf::Json j = lcdf::Json().set("n", count);
+    if (count)
+      j.set("mean", sum / count).set("p50", quantile(0.5))
+        .set("p90", quantile(0.9)).set("p99", quantile(0.99))
+        .set("p999", quantile(0.999)).set("max", max);
+    return j;
+  }
+};
+
 #endif
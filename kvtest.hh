@@ -19,6 +19,7 @@
 #include "misc.hh"
 #include "kvproto.hh"
 #include "kvrandom.hh"
+#include "kvstats.hh"
 #include <vector>
 #include <fstream>
 #include <random>
@@ -94,6 +95,48 @@ void kvtest_sync_rw1(C &client)
     kvtest_sync_rw1_seed(client, kvtest_first_seed + client.id() % 48);
 }
 
+// Request latency: after loading nkeys keys, alternate synchronous gets
+// and puts, one request outstanding at a time, and report latency
+// percentiles in microseconds.
+template <typename C>
+void kvtest_lat1(C &client)
+{
+    long nkeys = std::max<long>(client.param("nkeys", 1000).to_i(), 1);
+    for (long k = 0; k != nkeys; ++k)
+        client.put_sync(k, k + 1);
+    client.puts_done();
+
+    client.rand.seed(kvtest_first_seed + client.id());
+    std::vector<double> getlat, putlat;
+    double t0 = client.now();
+    while (!client.timeout(0)) {
+        long k = client.rand() % nkeys;
+        double t1 = client.now();
+        client.get_check_sync(k, k + 1);
+        double t2 = client.now();
+        client.put_sync(k, k + 1);
+        double t3 = client.now();
+        getlat.push_back((t2 - t1) * 1000000);
+        putlat.push_back((t3 - t2) * 1000000);
+    }
+    double t4 = client.now();
+
+    Json result = Json();
+    auto report = [&](const char* name, std::vector<double>& lat) {
+        if (lat.empty())
+            return;
+        std::sort(lat.begin(), lat.end());
+        String n(name);
+        result.set(n + "_p50_us", lat[lat.size() / 2])
+            .set(n + "_p99_us", lat[lat.size() * 99 / 100])
+            .set(n + "_max_us", lat.back());
+    };
+    report("get", getlat);
+    report("put", putlat);
+    kvtest_set_time(result, "ops", getlat.size() + putlat.size(), t4 - t0);
+    client.report(result);
+}
+
 template <typename C>
 unsigned kvtest_rw1puts_seed(C& client, int seed) {
     client.rand.seed(seed);
@@ -131,23 +174,26 @@ void kvtest_rw1_seed(C &client, int seed)
         std::swap(a[i], a[swapd(client.rand)]);
     }
 
+    // getbatch=N checks gets N at a time, letting the client interleave
+    // their tree traversals
+    enum { max_batch = 64 };
+    unsigned batch = std::min(client.param("getbatch", 1).to_u64(),
+                              uint64_t(max_batch));
     double tg0 = client.now();
-    unsigned g;
-#if 0
-#define BATCH 8
-    for(g = 0; g+BATCH < n && !client.timeout(1); g += BATCH){
-      long key[BATCH], expected[BATCH];
-      for(int i = 0; i < BATCH; i++){
-        key[i] = a[g+i];
-        expected[i] = a[g+i] + 1;
-      }
-      client.many_get_check(BATCH, key, expected);
+    unsigned g = 0;
+    if (batch > 1) {
+        long key[max_batch], expected[max_batch];
+        for (; g + batch <= n && !client.timeout(1); g += batch) {
+            for (unsigned i = 0; i != batch; ++i) {
+                key[i] = a[g + i];
+                expected[i] = a[g + i] + 1;
+            }
+            client.many_get_check(batch, key, expected);
+        }
     }
-#else
-    for (g = 0; g < n && !client.timeout(1); ++g) {
+    for (; g < n && !client.timeout(1); ++g) {
         client.get_check(a[g], a[g] + 1);
     }
-#endif
     client.wait_all();
     double tg1 = client.now();
 
@@ -459,6 +505,40 @@ void kvtest_same(C &client)
     kvtest_same_seed(client, kvtest_first_seed + client.id() % 48);
 }
 
+// overwrite a small set of keys with same-length values while other
+// clients read them, checking that no read sees a half-written value.
+template <typename C>
+void kvtest_overwrite1(C &client)
+{
+    enum { nkeys = 64 };
+    client.rand.seed(kvtest_first_seed + client.id());
+    char key[32], value[32];
+    unsigned n, errors = 0;
+    double t0 = client.now();
+    for (n = 0; !client.timeout(0) && n <= client.limit(); ++n) {
+        unsigned x = client.rand() % nkeys;
+        sprintf(key, "ow/%02u", x);
+        if (n < nkeys || client.id() % 2 == 0) {
+            unsigned v = client.rand() % 100000000;
+            sprintf(value, "%08u%08u", v, v);
+            client.put(Str(key), Str(value, 16));
+        } else {
+            Str got;
+            if (client.get_sync(Str(key), got)
+                && (got.len != 16 || memcmp(got.s, got.s + 8, 8) != 0)) {
+                client.notice("overwrite1: torn value %.*s\n", got.len, got.s);
+                ++errors;
+            }
+        }
+    }
+    client.wait_all();
+    double t1 = client.now();
+
+    Json result = Json().set("errors", errors);
+    kvtest_set_time(result, "ops", n, t1 - t0);
+    client.report(result);
+}
+
 // update the same small set of keys over and over, with interspersed gets.
 template <typename C>
 void kvtest_rwsmall_seed(C &client, int nkeys, int seed)
@@ -554,23 +634,26 @@ void kvtest_rw1fixed_seed(C &client, int seed)
         std::swap(a[i], a[swapd(client.rand)]);
     }
 
+    // getbatch=N checks gets N at a time, letting the client interleave
+    // their tree traversals
+    enum { max_batch = 64 };
+    unsigned batch = std::min(client.param("getbatch", 1).to_u64(),
+                              uint64_t(max_batch));
     double tg0 = client.now();
-    unsigned g;
-#if 0
-#define BATCH 8
-    for(g = 0; g+BATCH < n && !client.timeout(1); g += BATCH){
-      long key[BATCH], expected[BATCH];
-      for(int i = 0; i < BATCH; i++){
-        key[i] = a[g+i];
-        expected[i] = a[g+i] + 1;
-      }
-      client.many_get_check(BATCH, key, expected);
+    unsigned g = 0;
+    if (batch > 1) {
+        long key[max_batch], expected[max_batch];
+        for (; g + batch <= n && !client.timeout(1); g += batch) {
+            for (unsigned i = 0; i != batch; ++i) {
+                key[i] = a[g + i];
+                expected[i] = a[g + i] + 1;
+            }
+            client.many_get_check(batch, key, expected);
+        }
     }
-#else
-    for (g = 0; g < n && !client.timeout(1); ++g) {
+    for (; g < n && !client.timeout(1); ++g) {
         client.get_check(a[g], a[g] + 1);
     }
-#endif
     client.wait_all();
     double tg1 = client.now();
 
@@ -1356,34 +1439,40 @@ kvtest_uscale(C &client)
     client.report(result);
 }
 
+// Keep the client's window of asynchronous requests full with puts and
+// then gets over nkeys keys, so a server batching datagrams sees many
+// outstanding requests for different keys.
 template <typename C>
 void kvtest_udp1_seed(C &client, int seed)
 {
+    unsigned nkeys = std::max(client.param("nkeys", 10000).to_u64(), uint64_t(1));
     client.rand.seed(seed);
     double tp0 = client.now();
     unsigned n;
     for (n = 0; !client.timeout(0); ++n) {
-        client.put(0, 1);
+        long k = n % nkeys;
+        client.put(k, k + 1);
     }
     client.wait_all();
     double tp1 = client.now();
 
     client.puts_done();
     client.notice("now getting\n");
-    int32_t *a = (int32_t *) malloc(sizeof(int32_t) * n);
+    unsigned nput = std::min(n, nkeys);
+    uint32_t *a = (uint32_t *) malloc(sizeof(uint32_t) * nput);
     assert(a);
-    client.rand.seed(seed);
-    for (unsigned i = 0; i < n; ++i) {
-        a[i] = (int32_t) client.rand();
+    for (unsigned i = 0; i < nput; ++i) {
+        a[i] = i;
     }
-    for (unsigned i = 0; i < n; ++i) {
-        std::swap(a[i], a[client.rand() % n]);
+    for (unsigned i = 0; i < nput; ++i) {
+        std::swap(a[i], a[client.rand() % nput]);
     }
 
     double tg0 = client.now();
     unsigned g;
-    for (g = 0; !client.timeout(1); ++g) {
-        client.get_check(0, 1);
+    for (g = 0; nput && !client.timeout(1); ++g) {
+        long k = a[g % nput];
+        client.get_check(k, k + 1);
     }
     client.wait_all();
     double tg1 = client.now();
@@ -1873,4 +1962,598 @@ void kvtest_url(C &client)
   kvtest_url_seed(client);
 }
 
+// remove random ranges of this client's keys with remove_range, checking
+// each count against the keys known to be present and then every key
+// with a get. All keys share their first 8 bytes, so the ranges are
+// removed from a lower layer.
+template <typename C>
+void kvtest_rmrange1(C &client)
+{
+    unsigned n = std::min(client.param("nkeys", 100000).to_u64(),
+                          uint64_t(client.limit()));
+    char prefix[32];
+    int plen = sprintf(prefix, "rmr/%d/", client.id());
+    auto key = [&](unsigned i) {
+        char buf[64];
+        return String(buf, sprintf(buf, "%s%07u", prefix, i));
+    };
+
+    double t0 = client.now();
+    for (unsigned i = 0; i < n; ++i)
+        client.put(key(i), i + 1);
+    client.wait_all();
+    double t1 = client.now();
+
+    client.rand.seed(kvtest_first_seed + client.id());
+    kvrandom_uniform_int_distribution<unsigned> startd(0, n - 1), lend(1, 1000);
+    std::vector<bool> present(n, true);
+    unsigned nranges = 0, errors = 0;
+    uint64_t nremoved = 0;
+    while (nranges < n / 100 && !client.timeout(0)) {
+        unsigned a = startd(client.rand), b = std::min(a + lend(client.rand), n);
+        uint64_t expected = 0;
+        for (unsigned i = a; i != b; ++i) {
+            expected += present[i];
+            present[i] = false;
+        }
+        uint64_t got = client.remove_range_sync(key(a), key(b));
+        if (got != expected) {
+            client.notice("remove_range [%u, %u) removed %" PRIu64 ", expected %" PRIu64 "\n", a, b, got, expected);
+            ++errors;
+        }
+        nremoved += got;
+        ++nranges;
+    }
+    double t2 = client.now();
+
+    // removed keys are gone and the others kept their values
+    for (unsigned i = 0; i < n; ++i)
+        if (!present[i])
+            client.get_check_absent(key(i));
+    for (unsigned i = 0; i < n; ++i)
+        if (present[i])
+            client.get_check(key(i), String(i + 1));
+    client.wait_all();
+
+    // remove the rest: "rmr/ID0" ends the keys with prefix "rmr/ID/"
+    uint64_t expected = std::count(present.begin(), present.end(), true);
+    String last = String(prefix, plen - 1) + "0";
+    uint64_t got = client.remove_range_sync(Str(prefix, plen), last);
+    if (got != expected) {
+        client.notice("remove_range rest removed %" PRIu64 ", expected %" PRIu64 "\n", got, expected);
+        ++errors;
+    }
+    double t3 = client.now();
+
+    Json result = Json::object("keys_removed", nremoved + got, "errors", errors);
+    kvtest_set_time(result, "puts", n, t1 - t0);
+    kvtest_set_time(result, "ranges", nranges, t2 - t1);
+    kvtest_set_time(result, "rest", got, t3 - t2);
+    client.report(result);
+}
+
+// atomic read-modify-write: every client increments a shared set of
+// counters, checking that the values it sees only grow, and keeps its
+// own appended column and compare-and-swap chain.
+template <typename C>
+void kvtest_rmw1(C &client)
+{
+    enum { nshared = 16, max_appends = 1000 };
+    unsigned n = std::min(client.param("nops", 100000).to_u64(),
+                          uint64_t(client.limit()));
+    client.rand.seed(kvtest_first_seed + client.id());
+    int64_t last[nshared] = {0};
+    char key[32];
+    unsigned errors = 0, nincr = 0, nappend = 0, ncas = 0;
+    long casval = 0;
+    Json current;
+    uint64_t ts = 0;
+
+    double t0 = client.now();
+    for (unsigned i = 0; i != n && !client.timeout(0); ++i) {
+        unsigned x = client.rand() % nshared;
+        sprintf(key, "rmw/%02u", x);
+        int64_t v;
+        if (!client.increment_sync(Str(key), 0, 1, v) || v <= last[x]) {
+            client.notice("increment(%s) returned %" PRId64 " after %" PRId64 "\n", key, v, last[x]);
+            ++errors;
+        } else
+            last[x] = v;
+        ++nincr;
+
+        if (i % 8 == 0 && nappend < max_appends) {
+            sprintf(key, "rmw/%d/a", client.id());
+            ++nappend;
+            int len = client.append_sync(Str(key), 0, Str("ab", 2));
+            if (len != int(2 * nappend)) {
+                client.notice("append(%s) length %d, expected %u\n", key, len, 2 * nappend);
+                ++errors;
+            }
+        } else if (i % 8 == 4) {
+            // alternate matching the column value and the row timestamp
+            sprintf(key, "rmw/%d/c", client.id());
+            Json expected;
+            if (casval % 2)
+                expected = ts;
+            else if (casval)
+                expected = current;
+            quick_istr next(casval + 1);
+            if (!client.cas_sync(Str(key), 0, expected, next.string(),
+                                 current, ts)) {
+                client.notice("cas(%s) failed at %ld\n", key, casval);
+                ++errors;
+            } else
+                ++casval;
+            quick_istr stale(casval - 1);
+            Json stale_current;
+            uint64_t stale_ts;
+            if (client.cas_sync(Str(key), 0, Json(stale.string()), Str("x"),
+                                stale_current, stale_ts)
+                || stale_current != current || stale_ts != ts) {
+                client.notice("stale cas(%s) succeeded\n", key);
+                ++errors;
+            }
+            ncas += 2;
+        }
+    }
+    client.wait_all();
+    double t1 = client.now();
+
+    // an increment that would overflow fails and leaves the value alone
+    sprintf(key, "rmw/%d/max", client.id());
+    quick_istr max(INT64_MAX - 1);
+    client.put(Str(key), max.string());
+    client.wait_all();
+    int64_t v;
+    if (!client.increment_sync(Str(key), 0, 1, v) || v != INT64_MAX
+        || client.increment_sync(Str(key), 0, 1, v)
+        || client.increment_sync(Str(key), 0, INT64_MAX, v)) {
+        client.notice("increment(%s) past INT64_MAX didn't fail\n", key);
+        ++errors;
+    }
+    max.set(INT64_MAX);
+    client.get_check(Str(key), max.string());
+    client.wait_all();
+
+    Json result = Json::object("errors", errors);
+    kvtest_set_time(result, "ops", nincr + nappend + ncas, t1 - t0);
+    client.report(result);
+}
+
+// values are stored exactly: ones holding NULs and ones filling an
+// inline row round-trip, and a row type that can't hold a value rejects
+// it, leaving the old value, instead of truncating it. Inline rows hold
+// at most 8 bytes; other row types take every value here.
+template <typename C>
+void kvtest_vlen1(C &client)
+{
+    static const Str values[] = {
+        Str("", 0), Str("\0", 1), Str("a\0b", 3), Str("ab\0\0", 4),
+        Str("\0\0\0\0\0\0\0\0", 8), Str("1234\0678", 8), Str("12345678", 8)
+    };
+    enum { nvalues = sizeof(values) / sizeof(values[0]) };
+    char key[32];
+    unsigned errors = 0;
+    for (int i = 0; i != nvalues; ++i) {
+        sprintf(key, "vlen/%d/%d", client.id(), i);
+        int status;
+        client.put(Str(key), values[i], &status);
+        client.wait_all();
+        if (status != Inserted) {
+            client.notice("put(%s) returned %d\n", key, status);
+            ++errors;
+        }
+        client.get_check(Str(key), values[i]);
+    }
+    client.wait_all();
+
+    bool limited = client.row_type_name() == "Inline";
+    Str longer("123456789", 9);
+    for (int i = 0; i != nvalues; ++i) {
+        sprintf(key, "vlen/%d/%d", client.id(), i);
+        int status;
+        client.put(Str(key), longer, &status);
+        client.wait_all();
+        if ((status == Rejected) != limited) {
+            client.notice("put(%s) of %d bytes returned %d\n", key, longer.length(), status);
+            ++errors;
+        }
+        client.get_check(Str(key), limited ? values[i] : longer);
+    }
+    client.wait_all();
+
+    // appends past the limit are rejected too
+    sprintf(key, "vlen/%d/%d", client.id(), nvalues - 1);
+    int len = client.append_sync(Str(key), 0, Str("x", 1));
+    if (len != (limited ? -1 : longer.length() + 1)) {
+        client.notice("append(%s) returned %d\n", key, len);
+        ++errors;
+    }
+    client.report(Json::object("errors", errors));
+}
+
+// bounded scans over this client's keys: random end keys, directions,
+// keys-only replies, and byte budgets, checked against the expected keys.
+template <typename C>
+void kvtest_scanrange1(C &client)
+{
+    int n = std::min(client.param("nkeys", 10000).to_u64(),
+                     uint64_t(client.limit()));
+    char prefix[32];
+    int plen = sprintf(prefix, "sr/%d/", client.id());
+    auto key = [&](int i) {
+        char buf[64];
+        return String(buf, sprintf(buf, "%s%06d", prefix, i));
+    };
+
+    double t0 = client.now();
+    for (int i = 0; i < n; ++i)
+        client.put(key(i), i);
+    client.wait_all();
+    double t1 = client.now();
+
+    client.rand.seed(kvtest_first_seed + client.id());
+    std::vector<Str> keys, values;
+    unsigned nscans = 0, nfound = 0, errors = 0;
+    while (nscans < 10000 && !client.timeout(0)) {
+        int a = client.rand() % n, len = client.rand() % 200;
+        int count = 1 + client.rand() % 100;
+        bool reverse = client.rand() % 2, keys_only = client.rand() % 2;
+        int max_bytes = client.rand() % 4 ? 0 : client.rand() % 400;
+        // the prefix itself sorts before every key
+        int e = reverse ? std::max(a - len, -1) : std::min(a + len, n);
+        Json options = Json().set("end", e < 0 ? String(prefix, plen) : key(e));
+        if (reverse)
+            options.set("reverse", true);
+        if (keys_only)
+            options.set("keys", true);
+        if (max_bytes)
+            options.set("max_bytes", max_bytes);
+        client.scan_range_sync(key(a), count, options, keys, values);
+
+        int i = a, got = 0, nbytes = 0;
+        bool ok = true;
+        while ((reverse ? i > e : i < e) && got < count
+               && (!max_bytes || nbytes < max_bytes)) {
+            quick_istr value(i);
+            nbytes += key(i).length() + (keys_only ? 0 : value.length());
+            ok = ok && size_t(got) < keys.size() && keys[got] == key(i)
+                && (keys_only || values[got] == value.string());
+            ++got;
+            i += reverse ? -1 : 1;
+        }
+        if (!ok || size_t(got) != keys.size()
+            || values.size() != (keys_only ? 0 : keys.size())) {
+            client.notice("scan %s from %d to %d: got %zu keys, expected %d\n",
+                          reverse ? "down" : "up", a, e, keys.size(), got);
+            ++errors;
+        }
+        nfound += keys.size();
+        ++nscans;
+    }
+    double t2 = client.now();
+
+    Json result = Json::object("keys_found", nfound, "errors", errors);
+    kvtest_set_time(result, "puts", n, t1 - t0);
+    kvtest_set_time(result, "scans", nscans, t2 - t1);
+    client.report(result);
+}
+
+// client 0 removes most keys, in random order, so leaves empty out and
+// merge (run with --merge-fill=N), while the other clients scan and get.
+// Every scan must return each surviving key once and in order; removed
+// keys may appear until they are gone. Then client 0 checks that a last
+// scan returns exactly the survivors, and, in builds configured with
+// --enable-counters, that leaves merged.
+template <typename C>
+void kvtest_merge1(C &client)
+{
+    enum { keep_every = 16, batch = 50 };
+    int n = std::min(client.param("nkeys", 50000).to_u64(),
+                     uint64_t(client.limit()));
+    // the keys are all digits, so "end" leaves out the flag keys
+    Json range = Json().set("end", "a");
+    unsigned errors = 0, nscans = 0;
+    client.rand.seed(kvtest_first_seed + client.id());
+
+    auto scan = [&](bool exact) {
+        std::vector<Str> keys, values;
+        quick_istr first(0, 8);
+        int prev = -1, expect = 0;
+        while (1) {
+            client.scan_range_sync(first.string(), batch, range, keys, values);
+            if (keys.empty())
+                break;
+            for (size_t i = 0; i != keys.size(); ++i) {
+                int x = keys[i].to_i();
+                quick_istr value(x + 1);
+                const char* problem = nullptr;
+                if (x <= prev)
+                    problem = "out of order";
+                else if (x > expect)
+                    problem = "skipped a survivor";
+                else if (x < expect && exact)
+                    problem = "removed key present";
+                else if (values[i] != value.string())
+                    problem = "wrong value";
+                if (problem) {
+                    client.notice("scan got %d after %d, expected %d: %s\n",
+                                  x, prev, expect, problem);
+                    ++errors;
+                    return;
+                }
+                prev = x;
+                if (x == expect)
+                    expect += keep_every;
+            }
+            first.set(prev + 1, 8);
+        }
+        if (expect < n) {
+            client.notice("scan ended at %d, expected %d\n", prev, expect);
+            ++errors;
+        }
+    };
+
+    Json result;
+    if (client.id() == 0) {
+        for (int i = 0; i != n; ++i)
+            client.put_key8(i, i + 1);
+        client.put(Str("merge1/go"), Str("1"));
+        client.wait_all();
+
+        std::vector<int> removes;
+        for (int i = 0; i != n; ++i)
+            if (i % keep_every)
+                removes.push_back(i);
+        for (size_t i = removes.size(); i > 1; --i)
+            std::swap(removes[i - 1], removes[client.rand() % i]);
+        Json merges0 = client.leaf_merges();
+        for (size_t i = 0; i != removes.size(); ++i) {
+            quick_istr key(removes[i], 8);
+            client.remove(key.string());
+            if (i % 64 == 0)
+                client.rcu_quiesce();
+        }
+        client.wait_all();
+        Json merges = client.leaf_merges();
+        client.put(Str("merge1/done"), Str("1"));
+        client.wait_all();
+
+        scan(true);
+        for (int i = 0; i < n; i += keep_every)
+            client.get_check_key8(i, i + 1);
+        client.wait_all();
+        if (!merges.is_null()) {
+            uint64_t nmerged = merges.as_u() - merges0.as_u(0);
+            if (!nmerged) {
+                client.notice("no leaves merged; run with --merge-fill=N\n");
+                ++errors;
+            }
+            result.set("leaf_merges", nmerged);
+        }
+    } else {
+        while (!client.get_row_sync(Str("merge1/go")) && !client.timeout(0))
+            client.rcu_quiesce();
+        bool done = false;
+        while (!done && !client.timeout(0)) {
+            // a scan that starts after the removes sees only survivors
+            done = client.get_row_sync(Str("merge1/done"));
+            scan(done);
+            for (int i = 0; i != 100; ++i) {
+                int x = client.rand() % ((n + keep_every - 1) / keep_every);
+                client.get_check_key8(x * keep_every, x * keep_every + 1);
+            }
+            client.wait_all();
+            client.rcu_quiesce();
+            ++nscans;
+        }
+        result.set("scans", nscans);
+    }
+    result.set("errors", errors);
+    client.report(result);
+}
+
+// multiget batches of keys, about half of them missing and some repeated:
+// the reply holds one row per requested key, in request order, null for a
+// missing key. nkeys sets the number of keys, half of which are put; use
+// a tree larger than the last-level cache to time the lookups.
+template <typename C>
+void kvtest_multiget1(C &client)
+{
+    enum { batch = 16 };
+    unsigned n = std::min(client.param("nkeys", 100000).to_u64(),
+                          uint64_t(client.limit()));
+    n = std::max(n, 2U);
+    // 8-byte keys stay in the first layer; the prefix keeps other tests'
+    // keys out of the way
+    auto ikey = [&](unsigned i) {
+        return uint64_t(i) * client.nthreads() + client.id();
+    };
+    auto key = [&](char* buf, unsigned i) {
+        return Str(buf, sprintf(buf, "g%07" PRIx64, ikey(i)));
+    };
+
+    double t0 = client.now();
+    for (unsigned i = 0; i < n; i += 2) {
+        char buf[32];
+        quick_istr value(ikey(i) + 1);
+        client.put(key(buf, i), value.string());
+    }
+    client.wait_all();
+    double t1 = client.now();
+
+    client.rand.seed(kvtest_first_seed + client.id());
+    char keybuf[batch][32];
+    Str keys[batch];
+    unsigned which[batch];
+    unsigned nbatches = 0, nfound = 0, errors = 0;
+    while (!client.timeout(0) && nbatches < n / 2) {
+        for (int j = 0; j != batch; ++j) {
+            which[j] = j && client.rand() % 8 == 0 ? which[j - 1]
+                : client.rand() % n;
+            keys[j] = key(keybuf[j], which[j]);
+        }
+        Json rows = client.multiget_sync(keys, batch);
+        for (int j = 0; j != batch; ++j) {
+            quick_istr value(ikey(which[j]) + 1);
+            bool ok;
+            if (which[j] % 2)
+                ok = rows[j].is_null();
+            else
+                ok = rows[j].is_a() && rows[j].size() == 1
+                    && rows[j][0].as_s() == value.string();
+            if (!ok && errors < 10)
+                client.notice("multiget %s: row %d is %s\n",
+                              String(keys[j]).printable().c_str(), j,
+                              rows[j].unparse().c_str());
+            errors += !ok;
+            nfound += !rows[j].is_null();
+        }
+        errors += rows.size() != batch;
+        ++nbatches;
+    }
+    double t2 = client.now();
+
+    Json result = Json::object("found", nfound, "errors", errors);
+    kvtest_set_time(result, "puts", (n + 1) / 2, t1 - t0);
+    kvtest_set_time(result, "gets", nbatches * batch, t2 - t1);
+    client.report(result);
+}
+
+// YCSB core workloads (Cooper et al., "Benchmarking cloud serving systems
+// with YCSB", SoCC 2010). Clients load recordcount records of fieldcount
+// fields, each fieldlength bytes, then issue synchronous requests in the
+// workload's mix. Records are chosen by the workload's distribution
+// ("zipfian" with skew theta, "latest", "hotspot", or "uniform"; the
+// "distribution" parameter overrides it) among the loaded records; only
+// "latest" also picks this client's own inserts, favoring the newest.
+struct kvtest_ycsb_workload {
+    const char* name;
+    double read, update, insert, scan, rmw;
+    const char* distribution;
+};
+
+static const kvtest_ycsb_workload kvtest_ycsb_workloads[] = {
+    { "a", 0.5, 0.5, 0, 0, 0, "zipfian" },
+    { "b", 0.95, 0.05, 0, 0, 0, "zipfian" },
+    { "c", 1, 0, 0, 0, 0, "zipfian" },
+    { "d", 0.95, 0, 0.05, 0, 0, "latest" },
+    { "e", 0, 0, 0.05, 0.95, 0, "zipfian" },
+    { "f", 0.5, 0, 0, 0, 0.5, "zipfian" }
+};
+
+// Record number to key. The number is permuted within 40 bits, so
+// consecutive records, and inserts, spread over the whole tree.
+inline String kvtest_ycsb_key(uint64_t record) {
+    const uint64_t mask = (uint64_t(1) << 40) - 1;
+    uint64_t x = (record * 0x9E3779B97F4A7C15ULL) & mask;
+    x ^= x >> 20;
+    x = (x * 0xBF58476D1CE4E5B9ULL) & mask;
+    char buf[32];
+    return String(buf, sprintf(buf, "u%010" PRIx64, x));
+}
+
+template <typename C>
+void kvtest_ycsb(C &client, char workload)
+{
+    const kvtest_ycsb_workload& w = kvtest_ycsb_workloads[workload - 'a'];
+    uint64_t nrecords = std::max(client.param("recordcount", 100000).to_u64(),
+                                 uint64_t(1));
+    int nfields = std::max<int>(client.param("fieldcount", 10).to_i(), 1);
+    int fieldlen = std::max<int>(client.param("fieldlength", 100).to_i(), 1);
+    double theta = client.param("theta", 0.99).to_d();
+    int maxscan = std::max<int>(client.param("maxscanlength", 100).to_i(), 1);
+    String distribution = client.param("distribution", w.distribution).to_s();
+    uint64_t nthreads = client.nthreads(), id = client.id();
+
+    // field values are windows of a random string
+    client.rand.seed(kvtest_first_seed + client.id());
+    String data = String::make_uninitialized(2 * fieldlen);
+    for (int i = 0; i != data.length(); ++i)
+        const_cast<char*>(data.data())[i] = 'a' + client.rand() % 26;
+    auto value = [&]() {
+        return data.substr(client.rand() % fieldlen, fieldlen);
+    };
+    auto insert = [&](uint64_t record) {
+        String key = kvtest_ycsb_key(record);
+        for (int f = 0; f != nfields; ++f)
+            client.put_col(key, f, value());
+    };
+
+    // each client loads every nthreads-th record
+    double t0 = client.now();
+    uint64_t nloaded = 0;
+    for (uint64_t r = id; r < nrecords; r += nthreads, ++nloaded)
+        insert(r);
+    client.wait_all();
+    client.puts_done();
+    double t1 = client.now();
+
+    // this client's i'th insert is record nrecords + i * nthreads + id
+    uint64_t ninserts = 0;
+    auto record_at = [&](uint64_t i) {
+        return i < nrecords ? i : nrecords + (i - nrecords) * nthreads + id;
+    };
+    kvrandom_scrambled_zipfian_distribution zipfian(nrecords, theta);
+    kvrandom_latest_distribution latest(nrecords, theta);
+    kvrandom_hotspot_distribution hotspot(nrecords);
+    auto choose = [&]() -> uint64_t {
+        if (distribution == "latest")
+            return record_at(latest(client.rand));
+        else if (distribution == "hotspot")
+            return hotspot(client.rand);
+        else if (distribution == "uniform")
+            return uint64_t(kvrandom_unit(client.rand) * nrecords);
+        else
+            return zipfian(client.rand);
+    };
+
+    enum { op_read, op_update, op_insert, op_scan, op_rmw, nops };
+    static const char* const op_names[] = {
+        "read", "update", "insert", "scan", "rmw"
+    };
+    kvloglinear_histogram latency[nops];
+    std::vector<Str> keys, values;
+    uint64_t n, misses = 0, nscanned = 0;
+    for (n = 0; !client.timeout(0) && n < client.limit(); ++n) {
+        double u = kvrandom_unit(client.rand);
+        int op = u < w.read ? op_read
+            : (u -= w.read) < w.update ? op_update
+            : (u -= w.update) < w.insert ? op_insert
+            : (u -= w.insert) < w.scan ? op_scan : op_rmw;
+        String key = op == op_insert ? String() : kvtest_ycsb_key(choose());
+        double t2 = client.now();
+        if (op == op_read || op == op_rmw)
+            misses += !client.get_row_sync(key);
+        if (op == op_update || op == op_rmw) {
+            client.put_col(key, client.rand() % nfields, value());
+            client.wait_all();
+        } else if (op == op_insert) {
+            insert(nrecords + ninserts * nthreads + id);
+            client.wait_all();
+            ++ninserts;
+            latest.resize(nrecords + ninserts);
+        } else if (op == op_scan) {
+            client.scan_range_sync(key, 1 + client.rand() % maxscan,
+                                   Json::make_object(), keys, values);
+            nscanned += keys.size();
+        }
+        latency[op].add(uint64_t((client.now() - t2) * 1000000000));
+    }
+    double t3 = client.now();
+
+    Json lj = Json::make_object();
+    for (int op = 0; op != nops; ++op)
+        if (latency[op].count)
+            lj.set(op_names[op], latency[op].unparse_json());
+    Json result = Json::object("workload", w.name,
+                               "distribution", distribution,
+                               "read_misses", misses,
+                               "keys_scanned", nscanned,
+                               "latency_ns", lj);
+    kvtest_set_time(result, "puts", nloaded, t1 - t0);
+    kvtest_set_time(result, "ops", n, t3 - t1);
+    client.report(result);
+}
+
 #endif
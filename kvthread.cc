@@ -25,6 +25,7 @@
 #endif
 
 threadinfo *threadinfo::allthreads;
+volatile uint64_t timestamp_floor = 0;
 #if ENABLE_ASSERTIONS
 int threadinfo::no_pool_value;
 #endif
@@ -140,6 +141,16 @@ done:
         perform_gc_epoch_ = epoch_bound + 1;
 }
 
+void threadinfo::limbo_usage(size_t& used, size_t& allocated) const {
+    used = allocated = 0;
+    for (limbo_group* lg = limbo_head_; lg; lg = lg->next_) {
+        unsigned head = lg->head_, tail = lg->tail_;
+        if (head < tail)
+            used += tail - head;
+        allocated += lg->capacity;
+    }
+}
+
 void threadinfo::report_rcu(void *ptr) const
 {
     for (limbo_group *lg = limbo_head_; lg; lg = lg->next_) {
@@ -168,6 +179,18 @@ void threadinfo::report_rcu_all(void *ptr)
         ti->report_rcu(ptr);
 }
 
+kvtimestamp_t threadinfo::raise_timestamp_floor()
+{
+    kvtimestamp_t f = timestamp_floor;
+    for (threadinfo *ti = allthreads; ti; ti = ti->next())
+        if (circular_int<kvtimestamp_t>::less(f, ti->ts_))
+            f = ti->ts_;
+    f = (f | 1) + 1;
+    timestamp_floor = f;
+    fence();
+    return f;
+}
+
 
 #if HAVE_SUPERPAGE && !NOSUPERPAGE
 static size_t read_superpage_size() {
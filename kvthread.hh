@@ -33,6 +33,8 @@ typedef int64_t mrcu_signed_epoch_type;
 
 extern volatile mrcu_epoch_type globalepoch;  // global epoch, updated regularly
 extern volatile mrcu_epoch_type active_epoch;
+// Every timestamp assigned after this is published is at least this large.
+extern volatile uint64_t timestamp_floor;
 
 struct limbo_group {
     typedef mrcu_epoch_type epoch_type;
@@ -126,14 +128,19 @@ class threadinfo {
         return timestamp();
     }
     kvtimestamp_t update_timestamp() const {
+        observe_floor();
         return ts_;
     }
     kvtimestamp_t update_timestamp(kvtimestamp_t x) const {
+        observe_floor();
         if (circular_int<kvtimestamp_t>::less_equal(ts_, x))
             // x might be a marker timestamp; ensure result is not
             ts_ = (x | 1) + 1;
         return ts_;
     }
+    // Raise timestamp_floor above every timestamp assigned so far and
+    // return it.
+    static kvtimestamp_t raise_timestamp_floor();
     template <typename N> void observe_phantoms(N* n) {
         if (circular_int<kvtimestamp_t>::less(ts_, n->phantom_epoch_[0]))
             ts_ = n->phantom_epoch_[0];
@@ -274,6 +281,11 @@ class threadinfo {
         if (perform_gc_epoch_ != active_epoch)
             hard_rcu_quiesce();
     }
+    // Epoch of the current RCU critical section, or 0 outside one.
+    // Nodes seen while it is unchanged have not been freed.
+    mrcu_epoch_type gc_epoch() const {
+        return gc_epoch_;
+    }
     typedef ::mrcu_callback mrcu_callback;
     void rcu_register(mrcu_callback* cb) {
         record_rcu(cb, memtag(-1));
@@ -287,6 +299,10 @@ class threadinfo {
         return pthreadid_;
     }
 
+    // Count the limbo slots holding pointers awaiting RCU free, and the
+    // slots allocated. Approximate when called on another thread.
+    void limbo_usage(size_t& used, size_t& allocated) const;
+
     void report_rcu(void* ptr) const;
     static void report_rcu_all(void* ptr);
     static inline mrcu_epoch_type min_active_epoch();
@@ -315,8 +331,11 @@ class threadinfo {
     limbo_group* limbo_tail_;
     mutable kvtimestamp_t ts_;
 
-    //enum { ncounters = (int) tc_max };
+#if ENABLE_THREADCOUNTERS
+    enum { ncounters = (int) tc_max };
+#else
     enum { ncounters = 0 };
+#endif
     uint64_t counters_[ncounters];
 
     void refill_pool(int nl);
@@ -360,6 +379,11 @@ class threadinfo {
     threadinfo& operator=(const threadinfo&) = delete;
 
     void hard_rcu_quiesce();
+    void observe_floor() const {
+        kvtimestamp_t f = timestamp_floor;
+        if (circular_int<kvtimestamp_t>::less(ts_, f))
+            ts_ = f;
+    }
 
     friend struct limbo_group;
 };
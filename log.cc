@@ -23,18 +23,29 @@
 #include "masstree_remove.hh"
 #include "misc.hh"
 #include "msgpack.hh"
+#include "iouring.hh"
+#include <algorithm>
+#include <deque>
+#include <vector>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#if HAVE_LZ4_H && HAVE_LIBLZ4
+# include <lz4.h>
+#endif
 using lcdf::String;
 
 kvepoch_t global_log_epoch;
 kvepoch_t global_wake_epoch;
 struct timeval log_epoch_interval;
 static struct timeval log_epoch_time;
-extern Masstree::default_table* tree;
+uint32_t log_group_commit_bytes = 1 << 20;
+double log_group_commit_interval = 0.01;
+int log_io_depth = 4;
+int log_compress = log_compress_none;
+extern Masstree::server_table* tree;
 extern volatile bool recovering;
 
 kvepoch_t rec_ckp_min_epoch;
@@ -51,11 +62,13 @@ struct logrec_base {
     static size_t size() {
         return sizeof(logrec_base);
     }
-    static size_t store(char *buf, uint32_t command) {
+    static size_t store(char *buf, uint32_t command,
+                        uint32_t size = sizeof(logrec_base)) {
         // XXX check alignment on some architectures
         logrec_base *lr = reinterpret_cast<logrec_base *>(buf);
+        lr->size_ = size;
+        release_fence();
         lr->command_ = command;
-        lr->size_ = sizeof(*lr);
         return sizeof(*lr);
     }
     static bool check(const char *buf) {
@@ -79,9 +92,10 @@ struct logrec_epoch {
     static size_t store(char *buf, uint32_t command, kvepoch_t epoch) {
         // XXX check alignment on some architectures
         logrec_epoch *lr = reinterpret_cast<logrec_epoch *>(buf);
-        lr->command_ = command;
         lr->size_ = sizeof(*lr);
         lr->epoch_ = epoch;
+        release_fence();
+        lr->command_ = command;
         return sizeof(*lr);
     }
     static bool check(const char *buf) {
@@ -105,12 +119,13 @@ struct logrec_kv {
                         kvtimestamp_t ts) {
         // XXX check alignment on some architectures
         logrec_kv *lr = reinterpret_cast<logrec_kv *>(buf);
-        lr->command_ = command;
         lr->size_ = sizeof(*lr) + key.len + val.len;
         lr->ts_ = ts;
         lr->keylen_ = key.len;
         memcpy(lr->buf_, key.s, key.len);
         memcpy(lr->buf_ + key.len, val.s, val.len);
+        release_fence();
+        lr->command_ = command;
         return sizeof(*lr) + key.len + val.len;
     }
     static bool check(const char *buf) {
@@ -136,13 +151,14 @@ struct logrec_kvdelta {
                         kvtimestamp_t prev_ts, kvtimestamp_t ts) {
         // XXX check alignment on some architectures
         logrec_kvdelta *lr = reinterpret_cast<logrec_kvdelta *>(buf);
-        lr->command_ = command;
         lr->size_ = sizeof(*lr) + key.len + val.len;
         lr->ts_ = ts;
         lr->prev_ts_ = prev_ts;
         lr->keylen_ = key.len;
         memcpy(lr->buf_, key.s, key.len);
         memcpy(lr->buf_ + key.len, val.s, val.len);
+        release_fence();
+        lr->command_ = command;
         return sizeof(*lr) + key.len + val.len;
     }
     static bool check(const char *buf) {
@@ -152,9 +168,300 @@ struct logrec_kvdelta {
     }
 };
 
+// A compressed batch. The payload is the batch's records with logcmd_skip
+// records dropped and each key stored as the length of its common prefix
+// with the previous key plus the remaining suffix:
+//
+//   kv:      command ts prefixlen suffixlen vallen suffix val
+//   kvdelta: command ts prev_ts prefixlen suffixlen vallen suffix val
+//   other:   command size body
+//
+// with commands 4 bytes, timestamps 8, and lengths varints. With
+// log_compress_lz4 the payload is then LZ4-compressed. Replay expands
+// blocks back into ordinary records.
+struct logrec_block {
+    uint32_t command_;
+    uint32_t size_;
+    uint32_t codec_;
+    uint32_t streamlen_;        // length of the prefix-coded payload
+    uint32_t rawlen_;           // length of the expanded records
+    uint32_t reserved_;
+    char buf_[0];
+};
+
+static inline char* put_varint(char* p, uint32_t x) {
+    while (x >= 0x80) {
+        *p++ = char(x | 0x80);
+        x >>= 7;
+    }
+    *p++ = char(x);
+    return p;
+}
+
+static inline const char* get_varint(const char* p, const char* end,
+                                      uint32_t& x) {
+    x = 0;
+    for (int shift = 0; p != end && shift < 35; shift += 7) {
+        uint8_t c = *p++;
+        x |= uint32_t(c & 0x7F) << shift;
+        if (!(c & 0x80))
+            return p;
+    }
+    return 0;
+}
+
+template <typename T>
+static inline char* put_fixed(char* p, T x) {
+    memcpy(p, &x, sizeof(x));
+    return p + sizeof(x);
+}
+
+template <typename T>
+static inline const char* get_fixed(const char* p, const char* end, T& x) {
+    if (size_t(end - p) < sizeof(x))
+        return 0;
+    memcpy(&x, p, sizeof(x));
+    return p + sizeof(x);
+}
+
+static inline bool logcmd_is_kv(uint32_t command) {
+    return command == logcmd_put || command == logcmd_replace
+        || command == logcmd_remove || command == logcmd_modify
+        || command == logcmd_remove_range;
+}
+
+bool log_compress_supported(int codec) {
+#if HAVE_LZ4_H && HAVE_LIBLZ4
+    return codec >= log_compress_none && codec <= log_compress_lz4;
+#else
+    return codec >= log_compress_none && codec <= log_compress_prefix;
+#endif
+}
+
+// Upper bound on the block size for a batch of rawlen bytes. Each record
+// is at least 8 bytes and grows by at most 7 when prefix-coded.
+static size_t logblock_bound(size_t rawlen) {
+    size_t n = rawlen * 2;
+#if HAVE_LZ4_H && HAVE_LIBLZ4
+    n = std::max(n, size_t(LZ4_compressBound(n)));
+#endif
+    return sizeof(logrec_block) + n;
+}
+
+// Prefix-code the complete records in raw[0, rawlen) into out. Returns the
+// payload length and sets outrawlen to the length of the kept records.
+static size_t logblock_encode_stream(const char* raw, size_t rawlen,
+                                     char* out, uint32_t& outrawlen) {
+    const char* end = raw + rawlen;
+    char* p = out;
+    Str prev_key;
+    outrawlen = 0;
+    while (raw < end) {
+        const logrec_base* lr = reinterpret_cast<const logrec_base*>(raw);
+        uint32_t command = lr->command_;
+        if (command == logcmd_skip) {
+            raw += lr->size_;
+            continue;
+        }
+        outrawlen += lr->size_;
+        p = put_fixed(p, command);
+        if (logcmd_is_kv(command)) {
+            Str key, val;
+            if (command == logcmd_modify) {
+                const logrec_kvdelta* lk =
+                    reinterpret_cast<const logrec_kvdelta*>(raw);
+                p = put_fixed(p, lk->ts_);
+                p = put_fixed(p, lk->prev_ts_);
+                key.assign(lk->buf_, lk->keylen_);
+                val.assign(lk->buf_ + lk->keylen_,
+                           lk->size_ - sizeof(*lk) - lk->keylen_);
+            } else {
+                const logrec_kv* lk = reinterpret_cast<const logrec_kv*>(raw);
+                p = put_fixed(p, lk->ts_);
+                key.assign(lk->buf_, lk->keylen_);
+                val.assign(lk->buf_ + lk->keylen_,
+                           lk->size_ - sizeof(*lk) - lk->keylen_);
+            }
+            int prefix = 0, maxprefix = std::min(key.len, prev_key.len);
+            while (prefix < maxprefix && key.s[prefix] == prev_key.s[prefix])
+                ++prefix;
+            p = put_varint(p, prefix);
+            p = put_varint(p, key.len - prefix);
+            p = put_varint(p, val.len);
+            memcpy(p, key.s + prefix, key.len - prefix);
+            p += key.len - prefix;
+            memcpy(p, val.s, val.len);
+            p += val.len;
+            prev_key = key;
+        } else {
+            p = put_varint(p, lr->size_);
+            memcpy(p, raw + sizeof(*lr), lr->size_ - sizeof(*lr));
+            p += lr->size_ - sizeof(*lr);
+        }
+        raw += lr->size_;
+    }
+    return p - out;
+}
+
+// Encode raw[0, rawlen) as one logcmd_block record in out, which has room
+// for logblock_bound(rawlen) bytes. scratch has room for 2 * rawlen bytes.
+// Returns the record's size.
+static size_t logblock_encode(const char* raw, size_t rawlen, int codec,
+                              char* out, char* scratch) {
+    logrec_block* lb = reinterpret_cast<logrec_block*>(out);
+    size_t payload;
+#if HAVE_LZ4_H && HAVE_LIBLZ4
+    if (codec == log_compress_lz4) {
+        lb->streamlen_ = logblock_encode_stream(raw, rawlen, scratch, lb->rawlen_);
+        int r = LZ4_compress_default(scratch, lb->buf_, lb->streamlen_,
+                                     LZ4_compressBound(lb->streamlen_));
+        always_assert(r > 0);
+        payload = r;
+    } else
+#endif
+    {
+        (void) scratch;
+        codec = log_compress_prefix;
+        payload = lb->streamlen_ =
+            logblock_encode_stream(raw, rawlen, lb->buf_, lb->rawlen_);
+    }
+    lb->codec_ = codec;
+    lb->reserved_ = 0;
+    lb->size_ = sizeof(*lb) + payload;
+    lb->command_ = logcmd_block;
+    return lb->size_;
+}
+
+// Expand the prefix-coded payload s[0, len) into out[0, rawlen). Returns
+// false if the payload is malformed.
+static bool logblock_decode_stream(const char* s, size_t len,
+                                   char* out, size_t rawlen) {
+    const char* end = s + len;
+    char* p = out;
+    char* outend = out + rawlen;
+    Str prev_key;
+    while (s && s < end) {
+        uint32_t command;
+        s = get_fixed(s, end, command);
+        if (!s)
+            return false;
+        if (logcmd_is_kv(command)) {
+            kvtimestamp_t ts, prev_ts = 0;
+            uint32_t prefix, suffixlen, vallen;
+            s = get_fixed(s, end, ts);
+            if (s && command == logcmd_modify)
+                s = get_fixed(s, end, prev_ts);
+            if (s)
+                s = get_varint(s, end, prefix);
+            if (s)
+                s = get_varint(s, end, suffixlen);
+            if (s)
+                s = get_varint(s, end, vallen);
+            if (!s || prefix > uint32_t(prev_key.len)
+                || size_t(end - s) < size_t(suffixlen) + vallen
+                || prefix + suffixlen > MASSTREE_MAXKEYLEN)
+                return false;
+            size_t hdr = command == logcmd_modify ? sizeof(logrec_kvdelta)
+                : sizeof(logrec_kv);
+            if (size_t(outend - p) < hdr + prefix + suffixlen + vallen)
+                return false;
+            // Records are sized by sizeof() but their data starts at buf_,
+            // so there is some slack at the end. prev_key points into out,
+            // before p.
+            size_t data = command == logcmd_modify
+                ? offsetof(logrec_kvdelta, buf_) : offsetof(logrec_kv, buf_);
+            char* keyp = p + data;
+            memcpy(keyp, prev_key.s, prefix);
+            memcpy(keyp + prefix, s, suffixlen + vallen);
+            memset(keyp + prefix + suffixlen + vallen, 0, hdr - data);
+            if (command == logcmd_modify) {
+                logrec_kvdelta* lk = reinterpret_cast<logrec_kvdelta*>(p);
+                lk->ts_ = ts;
+                lk->prev_ts_ = prev_ts;
+                lk->keylen_ = prefix + suffixlen;
+            } else {
+                logrec_kv* lk = reinterpret_cast<logrec_kv*>(p);
+                lk->ts_ = ts;
+                lk->keylen_ = prefix + suffixlen;
+            }
+            logrec_base* lr = reinterpret_cast<logrec_base*>(p);
+            lr->command_ = command;
+            lr->size_ = hdr + prefix + suffixlen + vallen;
+            prev_key = Str(keyp, prefix + suffixlen);
+            p += lr->size_;
+            s += suffixlen + vallen;
+        } else {
+            uint32_t size;
+            s = get_varint(s, end, size);
+            if (!s || size < sizeof(logrec_base)
+                || size_t(end - s) < size - sizeof(logrec_base)
+                || size_t(outend - p) < size)
+                return false;
+            logrec_base* lr = reinterpret_cast<logrec_base*>(p);
+            lr->command_ = command;
+            lr->size_ = size;
+            memcpy(p + sizeof(*lr), s, size - sizeof(*lr));
+            s += size - sizeof(*lr);
+            p += size;
+        }
+    }
+    return s && p == outend;
+}
+
+// Expand a logcmd_block record into out, which has room for lb->rawlen_
+// bytes.
+static bool logblock_decode(const logrec_block* lb, char* out) {
+    size_t payload = lb->size_ - sizeof(*lb);
+    if (lb->codec_ == log_compress_prefix)
+        return payload == lb->streamlen_
+            && logblock_decode_stream(lb->buf_, payload, out, lb->rawlen_);
+#if HAVE_LZ4_H && HAVE_LIBLZ4
+    else if (lb->codec_ == log_compress_lz4) {
+        char* stream = (char*) malloc(std::max(lb->streamlen_, 1U));
+        int r = LZ4_decompress_safe(lb->buf_, stream, payload, lb->streamlen_);
+        bool ok = r >= 0 && uint32_t(r) == lb->streamlen_
+            && logblock_decode_stream(stream, r, out, lb->rawlen_);
+        free(stream);
+        return ok;
+    }
+#endif
+    else
+        return false;
+}
+
+
+// A batch is a closed buffer on its way to disk. With io_uring, each batch
+// is a linked write and fdatasync, up to log_io_depth batches are in
+// flight, and a reaper thread retires them in log order. Without it, the
+// flusher writes and syncs each batch itself.
+struct loginfo::logbatch {
+    char* buf;
+    uint64_t len;
+    char* wbuf;                 // bytes to write: buf, or a compressed block
+    uint64_t wlen;
+    uint64_t lsn;
+    uint64_t offset;            // file offset
+    kvepoch_t epoch;
+    double t0;
+    int pending;                // outstanding completions
+    bool resynced;              // short write finished synchronously
+};
+
+struct loginfo::logio {
+    int fd;
+    uint64_t offset;            // file offset of the next batch
+    io_ring* ring;
+    std::vector<char*> bufs;    // every buffer, in registration order
+    std::vector<char*> free;
+    std::deque<logbatch> inflight;
+    uint64_t seq;               // batch number of inflight.front()
+    pthread_mutex_t mu;
+    pthread_cond_t cond;        // signaled when a buffer is freed
+    pthread_t reaper;
+};
 
 logset* logset::make(int size) {
-    static_assert(sizeof(loginfo) == 2 * CACHE_LINE_SIZE, "unexpected sizeof(loginfo)");
+    static_assert(sizeof(loginfo) % CACHE_LINE_SIZE == 0, "unexpected sizeof(loginfo)");
     assert(size > 0 && size <= 64);
     char* x = new char[sizeof(loginfo) * size + sizeof(loginfo::logset_info) + CACHE_LINE_SIZE];
     char* ls_pos = x + sizeof(loginfo::logset_info);
@@ -175,16 +482,60 @@ void logset::free(logset* ls) {
     delete[] (reinterpret_cast<char*>(ls) + ls->li_[-1].lsi_.allocation_offset_);
 }
 
+// group-commit statistics, summed over all logs
+void logset::json_stats(lcdf::Json& j) const {
+    kvhistogram flush_usec, batch_bytes, compress_usec;
+    uint64_t stalls = 0, durable_timeouts = 0, buffer_waits = 0, flushed_bytes = 0;
+    uint64_t raw_bytes = 0, written_bytes = 0, lag_bytes = 0, lag_epochs = 0;
+    bool uring = false;
+    for (int i = 0; i != size(); ++i) {
+        const loginfo::commit& c = li_[i].c_;
+        // buffered but not yet durable; racy, so clamp
+        uint64_t end = c.lsn_base_ + loginfo::tail_pos(li_[i].f_.tail_);
+        if (end > c.flushed_lsn_)
+            lag_bytes += end - c.flushed_lsn_;
+        // an idle (quiescent) log's flushed epoch stops advancing
+        kvepoch_t fe = li_[i].flushed_epoch_;
+        if (fe && !li_[i].quiescent() && global_log_epoch > fe)
+            lag_epochs = std::max(lag_epochs, uint64_t(global_log_epoch - fe));
+        flush_usec.merge_relaxed(*c.flush_usec_);
+        batch_bytes.merge_relaxed(*c.batch_bytes_);
+        compress_usec.merge_relaxed(*c.compress_usec_);
+        stalls += c.stalls_;
+        durable_timeouts += c.durable_timeouts_;
+        buffer_waits += c.buffer_waits_;
+        flushed_bytes += c.flushed_lsn_;
+        raw_bytes += c.lsn_base_;
+        written_bytes += c.written_bytes_;
+        uring = uring || (c.io_ && c.io_->ring);
+    }
+    j.set("log", lcdf::Json().set("flushed_bytes", flushed_bytes)
+          .set("stalls", stalls)
+          .set("durable_timeouts", durable_timeouts)
+          .set("buffer_waits", buffer_waits)
+          .set("io_uring", uring)
+          .set("flush_lag_bytes", lag_bytes)
+          .set("flush_lag_epochs", lag_epochs)
+          .set("flush_usec", flush_usec.unparse_json())
+          .set("batch_bytes", batch_bytes.unparse_json()));
+    if (log_compress != log_compress_none)
+        j.get_insert("log").set("written_bytes", written_bytes)
+            .set("compression_ratio", written_bytes ? double(raw_bytes) / written_bytes : 1.0)
+            .set("compress_usec", compress_usec.unparse_json());
+}
+
 
 loginfo::loginfo(logset* ls, int logindex) {
+    f_.tail_ = tail_quiescent; // first record takes the slow path
     f_.lock_ = 0;
-    f_.waiting_ = 0;
     f_.filename_ = String().internal_rep();
     f_.filename_.ref();
 
+    // Buffers must start zeroed: a nonzero command word marks a complete
+    // record. The slack holds the header of a reservation that straddles
+    // len_.
     len_ = 20 * 1024 * 1024;
-    pos_ = 0;
-    buf_ = (char *) malloc(len_);
+    buf_ = (char *) calloc(len_ + logrec_base::size(), 1);
     always_assert(buf_);
     log_epoch_ = 0;
     quiescent_epoch_ = 0;
@@ -195,12 +546,39 @@ loginfo::loginfo(logset* ls, int logindex) {
     f_.logset_ = ls;
     logindex_ = logindex;
 
+    pthread_mutex_init(&c_.mu_, 0);
+    pthread_cond_init(&c_.flush_cond_, 0);
+    pthread_cond_init(&c_.space_cond_, 0);
+    pthread_cond_init(&c_.durable_cond_, 0);
+    c_.lsn_base_ = c_.flushed_lsn_ = 0;
+    c_.flush_requested_ = false;
+    c_.io_ = 0;
+    c_.stalls_ = c_.durable_timeouts_ = c_.buffer_waits_ = 0;
+    c_.written_bytes_ = 0;
+    c_.flush_usec_ = new kvhistogram;
+    c_.batch_bytes_ = new kvhistogram;
+    c_.compress_usec_ = new kvhistogram;
+
     (void) padding1_;
+    (void) padding2_;
 }
 
 loginfo::~loginfo() {
     f_.filename_.deref();
-    free(buf_);
+    if (c_.io_) {
+        for (char* b : c_.io_->bufs)
+            free(b);
+        delete c_.io_->ring;
+        delete c_.io_;
+    } else
+        free(buf_);
+    delete c_.flush_usec_;
+    delete c_.batch_bytes_;
+    delete c_.compress_usec_;
+    pthread_mutex_destroy(&c_.mu_);
+    pthread_cond_destroy(&c_.flush_cond_);
+    pthread_cond_destroy(&c_.space_cond_);
+    pthread_cond_destroy(&c_.durable_cond_);
 }
 
 void* loginfo::trampoline(void* x) {
@@ -232,156 +610,474 @@ static void check_epoch() {
     }
 }
 
+static void unlock_mutex(void* mu) {
+    pthread_mutex_unlock(static_cast<pthread_mutex_t*>(mu));
+}
+
 void* loginfo::run() {
     {
         logreplay replayer(f_.filename_);
         replayer.replay(ti_->index(), ti_);
     }
 
-    int fd = open(String(f_.filename_).c_str(),
-                  O_WRONLY | O_APPEND | O_CREAT, 0666);
+    int fd = open(String(f_.filename_).c_str(), O_WRONLY | O_CREAT, 0666);
     always_assert(fd >= 0);
-    char *x_buf = (char *) malloc(len_);
-    always_assert(x_buf);
+    start_io(fd);
 
     while (1) {
-        uint32_t nb = 0;
+        uint64_t nb = 0;
         acquire();
         kvepoch_t ge = global_log_epoch, we = global_wake_epoch;
         if (wake_epoch_ != we) {
             wake_epoch_ = we;
-            quiescent_epoch_ = 0;
+            if (quiescent_epoch_) {
+                quiescent_epoch_ = 0;
+                reserve_locked(log_epoch_, false, 0);
+            }
         }
-        // If the writing threads appear quiescent, and aren't about to write
-        // to the log (f_.waiting_ != 0), then write a quiescence
-        // notification.
-        if (!recovering && pos_ == 0 && !quiescent_epoch_
-            && ge != log_epoch_ && ge != we && !f_.waiting_) {
-            quiescent_epoch_ = log_epoch_ = ge;
-            char *p = buf_;
-            p += logrec_epoch::store(p, logcmd_epoch, log_epoch_);
-            if (log_epoch_ == wake_epoch_)
-                p += logrec_base::store(p, logcmd_wake);
-            p += logrec_base::store(p, logcmd_quiesce);
-            pos_ = p - buf_;
+        // If the writing threads appear quiescent, then write a quiescence
+        // notification. A racing writer lands either before the
+        // notification, in the old epoch, or after it, where it sees the
+        // quiescent bit and wakes the log.
+        if (!recovering && tail_pos(f_.tail_) == 0 && !quiescent_epoch_
+            && ge != log_epoch_ && ge != we) {
+            size_t n = logrec_epoch::size() + logrec_base::size()
+                + (ge == wake_epoch_ ? logrec_base::size() : 0);
+            uint64_t pos = tail_pos(reserve_locked(ge, true, n));
+            if (pos + n <= len_) {
+                char *p = buf_ + pos;
+                p += logrec_epoch::store(p, logcmd_epoch, ge);
+                if (ge == wake_epoch_)
+                    p += logrec_base::store(p, logcmd_wake);
+                p += logrec_base::store(p, logcmd_quiesce);
+                quiescent_epoch_ = log_epoch_ = ge;
+            } else if (pos < len_)
+                logrec_base::store(buf_ + pos, logcmd_skip, n);
         }
-        if (!recovering && pos_ > 0) {
-            uint32_t x_pos = pos_;
-            std::swap(buf_, x_buf);
-            pos_ = 0;
+        uint64_t t = f_.tail_;
+        if (!recovering && tail_pos(t) > 0) {
+            // Close the buffer: later reservations land past len_ and wait.
+            t = fetch_and_add(&f_.tail_, uint64_t(len_));
             kvepoch_t x_epoch = log_epoch_;
             release();
-            ssize_t r = write(fd, x_buf, x_pos);
-            always_assert(r == ssize_t(x_pos));
-            fsync(fd);
-            flushed_epoch_ = x_epoch;
-            // printf("log %d %d\n", ti_->index(), x_pos);
+
+            uint64_t x_pos = complete_prefix(buf_, std::min(tail_pos(t), uint64_t(len_)));
+            char* x_buf = buf_;
+            buf_ = take_buffer();
+            uint64_t x_lsn = c_.lsn_base_ += x_pos;
+            acquire();
+            release_fence();
+            f_.tail_ = make_tail(log_epoch_, quiescent_epoch_ || !log_epoch_, 0);
+            release();
+
+            // writers blocked on a full buffer can proceed during the write
+            pthread_mutex_lock(&c_.mu_);
+            pthread_cond_broadcast(&c_.space_cond_);
+            pthread_mutex_unlock(&c_.mu_);
+
+            submit_batch(x_buf, x_pos, x_lsn, x_epoch);
             nb = x_pos;
         } else
             release();
-        if (nb < len_ / 4)
-            napms(200);
         if (ti_->index() == 0)
             check_epoch();
+        // a big batch means we're behind; go again without waiting
+        if (nb < log_group_commit_bytes)
+            wait_for_work();
     }
 
     return 0;
 }
 
+void loginfo::start_io(int fd) {
+    logio* io = new logio;
+    io->fd = fd;
+    off_t off = lseek(fd, 0, SEEK_END);
+    always_assert(off >= 0);
+    io->offset = off;
+    io->ring = io_ring::make(2 * log_io_depth);
+    io->seq = 0;
+    pthread_mutex_init(&io->mu, 0);
+    pthread_cond_init(&io->cond, 0);
+
+    // buf_ is writers' buffer; the rest are free or in flight
+    int nbufs = io->ring ? log_io_depth + 1 : 2;
+    io->bufs.push_back(buf_);
+    for (int i = 1; i != nbufs; ++i) {
+        char* b = (char*) calloc(len_ + logrec_base::size(), 1);
+        always_assert(b);
+        io->bufs.push_back(b);
+        io->free.push_back(b);
+    }
+    if (io->ring) {
+        // Pinning may exceed RLIMIT_MEMLOCK; then writes aren't fixed.
+        std::vector<struct iovec> iov(nbufs);
+        for (int i = 0; i != nbufs; ++i) {
+            iov[i].iov_base = io->bufs[i];
+            iov[i].iov_len = len_ + logrec_base::size();
+        }
+        io->ring->register_buffers(iov.data(), nbufs);
+    }
+    c_.io_ = io;
+    if (io->ring) {
+        int r = pthread_create(&io->reaper, 0, reap_trampoline, this);
+        always_assert(r == 0);
+    }
+}
+
+// Return a free buffer, waiting for an in-flight batch to retire if
+// necessary.
+char* loginfo::take_buffer() {
+    logio* io = c_.io_;
+    char* b;
+    pthread_mutex_lock(&io->mu);
+    pthread_cleanup_push(unlock_mutex, &io->mu);
+    if (io->free.empty())
+        ++c_.buffer_waits_;
+    while (io->free.empty())
+        pthread_cond_wait(&io->cond, &io->mu);
+    b = io->free.back();
+    io->free.pop_back();
+    pthread_cleanup_pop(1);
+    return b;
+}
+
+static void write_fully(int fd, const char* buf, uint64_t len, uint64_t off) {
+    while (len) {
+        ssize_t w = pwrite(fd, buf, len, off);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0) {
+            perror("log write");
+            always_assert(0);
+        }
+        buf += w;
+        len -= w;
+        off += w;
+    }
+}
+
+void loginfo::submit_batch(char* buf, uint64_t len, uint64_t lsn,
+                           kvepoch_t epoch) {
+    logio* io = c_.io_;
+    logbatch b = {buf, len, buf, len, lsn, io->offset, epoch, now(), 2, false};
+    if (log_compress != log_compress_none && len) {
+        double t0 = now();
+        char* scratch = (char*) malloc(len * 2);
+        b.wbuf = (char*) malloc(logblock_bound(len));
+        always_assert(scratch && b.wbuf);
+        b.wlen = logblock_encode(buf, len, log_compress, b.wbuf, scratch);
+        free(scratch);
+        c_.compress_usec_->add_relaxed((uint64_t) ((now() - t0) * 1000000));
+    }
+    c_.written_bytes_ += b.wlen;
+    io->offset += b.wlen;
+    if (!io->ring) {
+        write_fully(io->fd, b.wbuf, b.wlen, b.offset);
+        fdatasync(io->fd);
+        finish_batch(b);
+        return;
+    }
+
+    pthread_mutex_lock(&io->mu);
+    uint64_t tag = (io->seq + io->inflight.size()) << 1;
+    io->inflight.push_back(b);
+    pthread_mutex_unlock(&io->mu);
+
+    auto it = std::find(io->bufs.begin(), io->bufs.end(), b.wbuf);
+    int index = it == io->bufs.end() ? -1 : it - io->bufs.begin();
+    io->ring->write(io->fd, b.wbuf, b.wlen, b.offset, index, tag, true);
+    io->ring->fdatasync(io->fd, tag | 1);
+    int r = io->ring->submit();
+    if (r < 0) {
+        errno = -r;
+        perror("log submit");
+        always_assert(0);
+    }
+}
+
+// Mark a batch durable. Called in log order.
+void loginfo::finish_batch(const logbatch& b) {
+    flushed_epoch_ = b.epoch;
+    c_.flush_usec_->add_relaxed((uint64_t) ((now() - b.t0) * 1000000));
+    c_.batch_bytes_->add_relaxed(b.len);
+    memset(b.buf, 0, b.len + logrec_base::size());
+    if (b.wbuf != b.buf)
+        free(b.wbuf);
+
+    pthread_mutex_lock(&c_.mu_);
+    c_.flushed_lsn_ = b.lsn;
+    pthread_cond_broadcast(&c_.durable_cond_);
+    pthread_mutex_unlock(&c_.mu_);
+
+    logio* io = c_.io_;
+    pthread_mutex_lock(&io->mu);
+    io->free.push_back(b.buf);
+    pthread_cond_signal(&io->cond);
+    pthread_mutex_unlock(&io->mu);
+}
+
+// Reap io_uring completions and retire finished batches in order.
+void* loginfo::reap() {
+    logio* io = c_.io_;
+    io_ring::completion c;
+    while (io->ring->wait(c)) {
+        pthread_mutex_lock(&io->mu);
+        logbatch& b = io->inflight[(c.tag >> 1) - io->seq];
+        pthread_mutex_unlock(&io->mu);
+
+        if (!(c.tag & 1) && c.result >= 0 && uint64_t(c.result) < b.wlen) {
+            // A short write breaks the link and cancels the sync.
+            write_fully(io->fd, b.wbuf + c.result, b.wlen - c.result,
+                        b.offset + c.result);
+            fdatasync(io->fd);
+            b.resynced = true;
+        } else if (c.result < 0 && !(c.result == -ECANCELED && b.resynced)) {
+            errno = -c.result;
+            perror(c.tag & 1 ? "log fdatasync" : "log write");
+            always_assert(0);
+        }
+
+        pthread_mutex_lock(&io->mu);
+        --b.pending;
+        while (!io->inflight.empty() && !io->inflight.front().pending) {
+            logbatch x = io->inflight.front();
+            io->inflight.pop_front();
+            ++io->seq;
+            pthread_mutex_unlock(&io->mu);
+            finish_batch(x);
+            pthread_mutex_lock(&io->mu);
+        }
+        pthread_mutex_unlock(&io->mu);
+    }
+    perror("log reap");
+    always_assert(0);
+    return 0;
+}
+
+void* loginfo::reap_trampoline(void* x) {
+    return static_cast<loginfo*>(x)->reap();
+}
+
+// Wait for every record reserved in buf[0, end) to complete, and return
+// the length of the prefix to write: end, or the start of a reservation
+// that straddled the end of the buffer.
+uint64_t loginfo::complete_prefix(const char* buf, uint64_t end) const {
+    uint64_t pos = 0;
+    while (pos < end) {
+        const volatile logrec_base* lr =
+            reinterpret_cast<const volatile logrec_base*>(buf + pos);
+        while (!lr->command_) {
+            relax_fence();
+            pthread_testcancel();
+        }
+        acquire_fence();
+        if (pos + lr->size_ > len_)
+            return pos;
+        pos += lr->size_;
+    }
+    return end;
+}
+
+// Sleep until there is a batch worth flushing, a flush is requested, or
+// log_group_commit_interval passes.
+void loginfo::wait_for_work() {
+    struct timespec ts;
+    set_timespec(ts, now() + log_group_commit_interval);
+    pthread_mutex_lock(&c_.mu_);
+    pthread_cleanup_push(unlock_mutex, &c_.mu_);
+    while (!c_.flush_requested_ && tail_pos(f_.tail_) < log_group_commit_bytes)
+        if (pthread_cond_timedwait(&c_.flush_cond_, &c_.mu_, &ts) == ETIMEDOUT)
+            break;
+    c_.flush_requested_ = false;
+    pthread_cleanup_pop(1);
+}
+
+void loginfo::wake_flusher() {
+    pthread_mutex_lock(&c_.mu_);
+    c_.flush_requested_ = true;
+    pthread_cond_signal(&c_.flush_cond_);
+    pthread_mutex_unlock(&c_.mu_);
+}
+
+// Wait until the log is durable through position lsn, as returned by
+// record(), or until timeout seconds pass (forever if timeout <= 0).
+// Returns true if the position is durable.
+bool loginfo::wait_durable(uint64_t lsn, double timeout) {
+    struct timespec ts;
+    set_timespec(ts, now() + timeout);
+    bool durable;
+    pthread_mutex_lock(&c_.mu_);
+    pthread_cleanup_push(unlock_mutex, &c_.mu_);
+    if (c_.flushed_lsn_ < lsn) {
+        c_.flush_requested_ = true;
+        pthread_cond_signal(&c_.flush_cond_);
+    }
+    while (c_.flushed_lsn_ < lsn) {
+        if (timeout <= 0)
+            pthread_cond_wait(&c_.durable_cond_, &c_.mu_);
+        else if (pthread_cond_timedwait(&c_.durable_cond_, &c_.mu_, &ts) == ETIMEDOUT)
+            break;
+    }
+    durable = c_.flushed_lsn_ >= lsn;
+    if (!durable)
+        ++c_.durable_timeouts_;
+    pthread_cleanup_pop(1);
+    return durable;
+}
+
+
 
 
 // log entry format: see log.hh
-void loginfo::record(int command, const query_times& qtimes,
-                     Str key, Str value) {
+// Wait until the flusher reopens a full buffer.
+void loginfo::wait_for_space() {
+    fetch_and_add(&c_.stalls_, uint64_t(1));
+    pthread_mutex_lock(&c_.mu_);
+    pthread_cleanup_push(unlock_mutex, &c_.mu_);
+    c_.flush_requested_ = true;
+    pthread_cond_signal(&c_.flush_cond_);
+    while (tail_pos(f_.tail_) >= len_)
+        pthread_cond_wait(&c_.space_cond_, &c_.mu_);
+    pthread_cleanup_pop(1);
+}
+
+// Reserve n bytes and set the log context to (epoch, quiescent). Only the
+// holder of f_.lock_ changes the context bits, so a single fetch_and_add
+// does both. Returns the old tail; the reservation is good only if it fits
+// before len_. If it doesn't, the flusher restores the context bits from
+// log_epoch_ and quiescent_epoch_ when it reopens the buffer.
+uint64_t loginfo::reserve_locked(kvepoch_t epoch, bool quiescent, size_t n) {
+    uint64_t want = make_tail(epoch, quiescent, 0);
+    uint64_t have = f_.tail_ & ~tail_pos_mask;
+    return fetch_and_add(&f_.tail_, n + (want - have));
+}
+
+uint64_t loginfo::record(int command, const query_times& qtimes,
+                         Str key, Str value) {
     assert(!recovering);
-    size_t n = logrec_kvdelta::size(key.len, value.len)
-        + logrec_epoch::size() + logrec_base::size();
-    waitlist wait = { &wait };
-    int stalls = 0;
+    bool delta = command == logcmd_put && qtimes.prev_ts
+        && !(qtimes.prev_ts & 1);
+    size_t n = delta ? logrec_kvdelta::size(key.len, value.len)
+        : logrec_kv::size(key.len, value.len);
+    uint32_t tag = epoch_tag(qtimes.epoch);
+    char* slot;
+    uint64_t lsn;
+
     while (1) {
-        if (len_ - pos_ >= n
-            && (wait.next == &wait || f_.waiting_ == &wait)) {
-            kvepoch_t we = global_wake_epoch;
-
-            // Potentially record a new epoch.
-            if (qtimes.epoch != log_epoch_) {
-                log_epoch_ = qtimes.epoch;
-                pos_ += logrec_epoch::store(buf_ + pos_, logcmd_epoch, qtimes.epoch);
-            }
+        uint64_t t = f_.tail_;
+        if (tail_pos(t) >= len_) {
+            wait_for_space();
+            continue;
+        }
+        if ((t & tail_quiescent) || tag_before(tail_tag(t), tag)
+            || global_wake_epoch != wake_epoch_) {
+            lsn = record_slow(qtimes, n, slot);
+            break;
+        }
 
-            if (quiescent_epoch_) {
-                // We're recording a new log record on a log that's been
-                // quiescent for a while. If the quiescence marker has been
-                // flushed, then all epochs less than the query epoch are
-                // effectively on disk.
-                if (flushed_epoch_ == quiescent_epoch_)
-                    flushed_epoch_ = qtimes.epoch;
-                quiescent_epoch_ = 0;
-                while (we < qtimes.epoch)
-                    we = cmpxchg(&global_wake_epoch, we, qtimes.epoch);
-            }
+        // Fast path. A tag later than ours is fine: the write isn't
+        // visible yet, so it may as well have happened in that epoch.
+        t = fetch_and_add(&f_.tail_, uint64_t(n));
+        uint64_t pos = tail_pos(t);
+        if (pos + n <= len_ && !(t & tail_quiescent)
+            && !tag_before(tail_tag(t), tag)) {
+            slot = buf_ + pos;
+            lsn = c_.lsn_base_ + pos + n;
+            break;
+        }
+        if (pos < len_)
+            logrec_base::store(buf_ + pos, logcmd_skip, n);
+    }
 
-            // Log epochs should be recorded in monotonically increasing
-            // order, but the wake epoch may be ahead of the query epoch (if
-            // the query took a while). So potentially record an EARLIER
-            // wake_epoch. This will get fixed shortly by the next log
-            // record.
-            if (we != wake_epoch_ && qtimes.epoch < we)
-                we = qtimes.epoch;
-            if (we != wake_epoch_) {
-                wake_epoch_ = we;
-                pos_ += logrec_base::store(buf_ + pos_, logcmd_wake);
-            }
+    uint64_t pos = slot - buf_;
+    if (delta)
+        logrec_kvdelta::store(slot, logcmd_modify, key, value,
+                              qtimes.prev_ts, qtimes.ts);
+    else
+        logrec_kv::store(slot, command, key, value, qtimes.ts);
+    if (pos < log_group_commit_bytes
+        && pos + n >= log_group_commit_bytes)
+        wake_flusher();
+    return lsn;
+}
 
-            if (command == logcmd_put && qtimes.prev_ts
-                && !(qtimes.prev_ts & 1))
-                pos_ += logrec_kvdelta::store(buf_ + pos_,
-                                              logcmd_modify, key, value,
-                                              qtimes.prev_ts, qtimes.ts);
-            else
-                pos_ += logrec_kv::store(buf_ + pos_,
-                                         command, key, value, qtimes.ts);
-
-            if (f_.waiting_ == &wait)
-                f_.waiting_ = wait.next;
+// Reserve n bytes for a record, preceded by whatever epoch and wake records
+// the log needs. Returns the record's log position and sets slot.
+uint64_t loginfo::record_slow(const query_times& qtimes, size_t n,
+                              char*& slot) {
+    acquire();
+    while (1) {
+        kvepoch_t epoch = qtimes.epoch;
+        if (log_epoch_ && epoch < log_epoch_)
+            epoch = log_epoch_;
+        kvepoch_t we = global_wake_epoch;
+        // Log epochs should be recorded in monotonically increasing
+        // order, but the wake epoch may be ahead of the query epoch (if
+        // the query took a while). So potentially record an EARLIER
+        // wake_epoch. This will get fixed shortly by the next log
+        // record.
+        kvepoch_t record_we = we;
+        if (record_we != wake_epoch_ && epoch < record_we)
+            record_we = epoch;
+        bool need_epoch = epoch != log_epoch_;
+        bool need_wake = record_we != wake_epoch_;
+        size_t total = (need_epoch ? logrec_epoch::size() : 0)
+            + (need_wake ? logrec_base::size() : 0) + n;
+
+        uint64_t pos = tail_pos(reserve_locked(epoch, false, total));
+        if (pos + total > len_) {
+            if (pos < len_)
+                logrec_base::store(buf_ + pos, logcmd_skip, total);
             release();
-            return;
+            wait_for_space();
+            acquire();
+            continue;
         }
 
-        // Otherwise must spin
-        if (wait.next == &wait) {
-            waitlist** p = &f_.waiting_;
-            while (*p)
-                p = &(*p)->next;
-            *p = &wait;
-            wait.next = 0;
+        char* p = buf_ + pos;
+        if (need_epoch) {
+            log_epoch_ = epoch;
+            p += logrec_epoch::store(p, logcmd_epoch, epoch);
+        }
+        if (quiescent_epoch_) {
+            // We're recording a new log record on a log that's been
+            // quiescent for a while. If the quiescence marker has been
+            // flushed, then all epochs less than the query epoch are
+            // effectively on disk.
+            if (flushed_epoch_ == quiescent_epoch_)
+                flushed_epoch_ = epoch;
+            quiescent_epoch_ = 0;
+            while (we < epoch)
+                we = cmpxchg(&global_wake_epoch, we, epoch);
+        }
+        if (need_wake) {
+            wake_epoch_ = record_we;
+            p += logrec_base::store(p, logcmd_wake);
         }
+        uint64_t lsn = c_.lsn_base_ + pos + total;
         release();
-        if (stalls == 0)
-            printf("stall\n");
-        else if (stalls % 25 == 0)
-            printf("stall %d\n", stalls);
-        ++stalls;
-        napms(50);
-        acquire();
+        slot = p;
+        return lsn;
     }
 }
 
-void loginfo::record(int command, const query_times& qtimes, Str key,
-                     const lcdf::Json* req, const lcdf::Json* end_req) {
+uint64_t loginfo::record(int command, const query_times& qtimes, Str key,
+                         const lcdf::Json* req, const lcdf::Json* end_req) {
+    // same format as the tail of a put request; see parse_changeset
     lcdf::StringAccum sa(128);
     msgpack::unparser<lcdf::StringAccum> cu(sa);
-    cu.write_array_header(end_req - req);
     for (; req != end_req; ++req)
         cu << *req;
-    record(command, qtimes, key, Str(sa.data(), sa.length()));
+    return record(command, qtimes, key, Str(sa.data(), sa.length()));
 }
 
 
 // replay
 
 logreplay::logreplay(const String &filename)
-    : filename_(filename), errno_(0), buf_()
+    : filename_(filename), errno_(0), buf_(), decoded_(false),
+      repbegin_(), repend_()
 {
     int fd = open(filename_.c_str(), O_RDONLY);
     if (fd == -1) {
@@ -409,6 +1105,60 @@ logreplay::logreplay(const String &filename)
     }
 
     (void) close(fd);
+    decode_blocks();
+}
+
+// If the log contains compressed blocks, replace buf_ with a copy in
+// which every block is expanded into ordinary records. Replay then
+// rewrites the log uncompressed.
+void
+logreplay::decode_blocks()
+{
+    const char *buf = buf_, *end = buf_ + size_;
+    size_t rawsize = 0;
+    bool any = false;
+    while (buf && buf + sizeof(logrec_base) <= end) {
+        const logrec_base *lr = reinterpret_cast<const logrec_base *>(buf);
+        if (lr->size_ < sizeof(logrec_base) || buf + lr->size_ > end)
+            break;
+        if (lr->command_ == logcmd_block) {
+            const logrec_block *lb = reinterpret_cast<const logrec_block *>(buf);
+            if (lr->size_ < sizeof(*lb))
+                break;
+            rawsize += lb->rawlen_;
+            any = true;
+        } else
+            rawsize += lr->size_;
+        buf += lr->size_;
+    }
+    if (!any)
+        return;
+
+    char *out = (char *) malloc(std::max(rawsize, size_t(1)));
+    always_assert(out);
+    char *p = out;
+    const char *stop = buf;
+    for (buf = buf_; buf != stop; ) {
+        const logrec_base *lr = reinterpret_cast<const logrec_base *>(buf);
+        if (lr->command_ == logcmd_block) {
+            const logrec_block *lb = reinterpret_cast<const logrec_block *>(buf);
+            if (!logblock_decode(lb, p)) {
+                fprintf(stderr, "replay %s: bad block, CORRUPT @%zu\n",
+                        filename_.c_str(), buf - buf_);
+                break;
+            }
+            p += lb->rawlen_;
+        } else {
+            memcpy(p, buf, lr->size_);
+            p += lr->size_;
+        }
+        buf += lr->size_;
+    }
+
+    unmap();
+    buf_ = out;
+    size_ = p - out;
+    decoded_ = true;
 }
 
 logreplay::~logreplay()
@@ -420,10 +1170,12 @@ int
 logreplay::unmap()
 {
     int r = 0;
-    if (buf_) {
+    if (buf_ && decoded_)
+        free(buf_);
+    else if (buf_)
         r = munmap(buf_, size_);
-        buf_ = 0;
-    }
+    buf_ = 0;
+    decoded_ = false;
     return r;
 }
 
@@ -438,11 +1190,11 @@ struct logrecord {
 
     const char *extract(const char *buf, const char *end);
 
-    template <typename T>
-    void run(T& table, std::vector<lcdf::Json>& jrepo, threadinfo& ti);
-
-  private:
-    inline void apply(row_type*& value, bool found,
+    template <typename R>
+    inline void apply(R*& value, bool found,
+                      std::vector<lcdf::Json>& jrepo, threadinfo& ti);
+    template <typename R>
+    inline void apply(R& value, bool found,
                       std::vector<lcdf::Json>& jrepo, threadinfo& ti);
 };
 
@@ -459,9 +1211,12 @@ logrecord::extract(const char *buf, const char *end)
         return end;
     }
 
+    // fields other than epoch belong to this record alone
     command = lr->command_;
+    key = val = Str();
+    ts = prev_ts = 0;
     if (command == logcmd_put || command == logcmd_replace
-        || command == logcmd_remove) {
+        || command == logcmd_remove || command == logcmd_remove_range) {
         const logrec_kv *lk = reinterpret_cast<const logrec_kv *>(buf);
         if (unlikely(lk->size_ < sizeof(*lk)
                      || lk->keylen_ > MASSTREE_MAXKEYLEN
@@ -489,23 +1244,6 @@ logrecord::extract(const char *buf, const char *end)
     return buf + lr->size_;
 }
 
-template <typename T>
-void logrecord::run(T& table, std::vector<lcdf::Json>& jrepo, threadinfo& ti) {
-    row_marker m;
-    if (command == logcmd_remove) {
-        ts |= 1;
-        m.marker_type_ = row_marker::mt_remove;
-        val = Str((const char*) &m, sizeof(m));
-    }
-
-    typename T::cursor_type lp(table, key);
-    bool found = lp.find_insert(ti);
-    if (!found)
-        ti.observe_phantoms(lp.node());
-    apply(lp.value(), found, jrepo, ti);
-    lp.finish(1, ti);
-}
-
 static lcdf::Json* parse_changeset(Str changeset,
                                    std::vector<lcdf::Json>& jrepo) {
     msgpack::parser mp(changeset.udata());
@@ -523,9 +1261,17 @@ static lcdf::Json* parse_changeset(Str changeset,
     return jrepo.data() + pos;
 }
 
-inline void logrecord::apply(row_type*& value, bool found,
+template <typename R>
+inline void logrecord::apply(R*& value, bool found,
                              std::vector<lcdf::Json>& jrepo, threadinfo& ti) {
-    row_type** cur_value = &value;
+    row_marker m;
+    if (command == logcmd_remove) {
+        ts |= 1;
+        m.marker_type_ = row_marker::mt_remove;
+        val = Str((const char*) &m, sizeof(m));
+    }
+
+    R** cur_value = &value;
     if (!found)
         *cur_value = 0;
 
@@ -540,7 +1286,7 @@ inline void logrecord::apply(row_type*& value, bool found,
 
     // if not modifying, delete everything earlier
     if (command != logcmd_modify)
-        while (row_type* old_value = *cur_value) {
+        while (R* old_value = *cur_value) {
             if (row_is_delta_marker(old_value)) {
                 ti.mark(tc_replay_remove_delta);
                 *cur_value = row_get_delta_marker(old_value)->prev_;
@@ -549,16 +1295,16 @@ inline void logrecord::apply(row_type*& value, bool found,
             old_value->deallocate(ti);
         }
 
-    // actually apply change
-    if (command == logcmd_replace)
-        *cur_value = row_type::create1(val, ts, ti);
+    // actually apply change; a remove's val is its marker, not a changeset
+    if (command == logcmd_replace || command == logcmd_remove)
+        *cur_value = R::create1(val, ts, ti);
     else if (command != logcmd_modify
              || (*cur_value && (*cur_value)->timestamp() == prev_ts)) {
         lcdf::Json* end_req = parse_changeset(val, jrepo);
         if (command != logcmd_modify)
-            *cur_value = row_type::create(jrepo.data(), end_req, ts, ti);
+            *cur_value = R::create(jrepo.data(), end_req, ts, ti);
         else {
-            row_type* old_value = *cur_value;
+            R* old_value = *cur_value;
             *cur_value = old_value->update(jrepo.data(), end_req, ts, ti);
             if (*cur_value != old_value)
                 old_value->deallocate(ti);
@@ -566,10 +1312,10 @@ inline void logrecord::apply(row_type*& value, bool found,
     } else {
         // XXX assume that memory exists before saved request -- it does
         // in conventional log replay, but that's an ugly interface
-        val.s -= sizeof(row_delta_marker<row_type>);
-        val.len += sizeof(row_delta_marker<row_type>);
-        row_type* new_value = row_type::create1(val, ts | 1, ti);
-        row_delta_marker<row_type>* dm = row_get_delta_marker(new_value, true);
+        val.s -= sizeof(row_delta_marker<R>);
+        val.len += sizeof(row_delta_marker<R>);
+        R* new_value = R::create1(val, ts | 1, ti);
+        row_delta_marker<R>* dm = row_get_delta_marker(new_value, true);
         dm->marker_type_ = row_marker::mt_delta;
         dm->prev_ts_ = prev_ts;
         dm->prev_ = *cur_value;
@@ -579,17 +1325,17 @@ inline void logrecord::apply(row_type*& value, bool found,
 
     // clean up
     while (value && row_is_delta_marker(value)) {
-        row_type **prev = 0, **trav = &value;
+        R **prev = 0, **trav = &value;
         while (*trav && row_is_delta_marker(*trav)) {
             prev = trav;
             trav = &row_get_delta_marker(*trav)->prev_;
         }
         if (prev && *trav
             && row_get_delta_marker(*prev)->prev_ts_ == (*trav)->timestamp()) {
-            row_type *old_prev = *prev;
+            R *old_prev = *prev;
             Str req = old_prev->col(0);
-            req.s += sizeof(row_delta_marker<row_type>);
-            req.len -= sizeof(row_delta_marker<row_type>);
+            req.s += sizeof(row_delta_marker<R>);
+            req.len -= sizeof(row_delta_marker<R>);
             const lcdf::Json* end_req = parse_changeset(req, jrepo);
             *prev = (*trav)->update(jrepo.data(), end_req, old_prev->timestamp() - 1, ti);
             if (*prev != *trav)
@@ -601,6 +1347,31 @@ inline void logrecord::apply(row_type*& value, bool found,
     }
 }
 
+// Rows stored in the slot itself have one column, so a put or delta
+// overwrites the whole row, and there is no need for delta markers.
+template <typename R>
+inline void logrecord::apply(R& value, bool found,
+                             std::vector<lcdf::Json>& jrepo, threadinfo& ti) {
+    if (command == logcmd_remove)
+        ts |= 1;
+    if (found && value.timestamp() >= ts)
+        return;
+
+    if (command == logcmd_remove) {
+        row_marker m;
+        m.marker_type_ = row_marker::mt_remove;
+        value = R::create1(Str((const char*) &m, sizeof(m)), ts, ti);
+    } else if (command == logcmd_replace)
+        value = R::create1(val, ts, ti);
+    else {
+        lcdf::Json* end_req = parse_changeset(val, jrepo);
+        if (found && !row_is_marker(&value))
+            value = value.update(jrepo.data(), end_req, ts);
+        else
+            value = R::create(jrepo.data(), end_req, ts, ti);
+    }
+}
+
 
 logreplay::info_type
 logreplay::info() const
@@ -619,7 +1390,8 @@ logreplay::info() const
             break;
         } else if (unlikely(buf + lr->size_ > end))
             break;
-        x.quiescent = lr->command_ == logcmd_quiesce;
+        if (lr->command_ != logcmd_skip)
+            x.quiescent = lr->command_ == logcmd_quiesce;
         if (lr->command_ == logcmd_epoch) {
             const logrec_epoch *lre =
                 reinterpret_cast<const logrec_epoch *>(buf);
@@ -639,7 +1411,9 @@ logreplay::info() const
                  && lr->command_ != logcmd_replace
                  && lr->command_ != logcmd_modify
                  && lr->command_ != logcmd_remove
-                 && lr->command_ != logcmd_quiesce) {
+                 && lr->command_ != logcmd_remove_range
+                 && lr->command_ != logcmd_quiesce
+                 && lr->command_ != logcmd_skip) {
             log_corrupt = true;
             break;
         }
@@ -687,21 +1461,62 @@ logreplay::min_post_quiescent_wake_epoch(kvepoch_t quiescent_epoch) const
     return 0;
 }
 
+// Parallel replay. Each logger thread decodes its own log and routes the
+// records to be replayed by key hash to one of rec_replay_nworkers
+// workers (the loggers and the checkpoint threads), so all records for a
+// key land on the same worker. Each worker sorts its records by key and
+// timestamp, then applies each key's records in order with one cursor.
+struct logroute {
+    Str key;
+    kvtimestamp_t ts;
+    const char* rec;
+
+    bool operator<(const logroute& x) const {
+        int cmp = key.compare(x.key);
+        return cmp < 0 || (cmp == 0 && ts < x.ts);
+    }
+};
+
+static int rec_replay_nlogs;
+static int rec_replay_nworkers;
+// rec_replay_routes[log * rec_replay_nworkers + worker]
+static std::vector<logroute>* rec_replay_routes;
+// range tombstones, by log; key is the first key in the range
+static std::vector<logroute>* rec_replay_ranges;
+
+void
+logreplay::prepare(int nlogs, int nworkers)
+{
+    rec_replay_nlogs = nlogs;
+    rec_replay_nworkers = nworkers;
+    rec_replay_routes = new std::vector<logroute>[nlogs * nworkers];
+    rec_replay_ranges = new std::vector<logroute>[nlogs];
+}
+
+void
+logreplay::cleanup()
+{
+    delete[] rec_replay_routes;
+    rec_replay_routes = 0;
+    delete[] rec_replay_ranges;
+    rec_replay_ranges = 0;
+}
+
+// Decode this log and route the records in [min_epoch, max_epoch) to
+// workers. Sets repbegin_ and repend_ to the part of the log to keep.
 uint64_t
-logreplay::replayandclean1(kvepoch_t min_epoch, kvepoch_t max_epoch,
-                           threadinfo *ti)
+logreplay::route(int which, kvepoch_t min_epoch, kvepoch_t max_epoch)
 {
     uint64_t nr = 0;
     const char *pos = buf_, *end = buf_ + size_;
     const char *repbegin = 0, *repend = 0;
-    logrecord lr;
-    std::vector<lcdf::Json> jrepo;
+    logrecord lr{};
+    std::vector<logroute>* routes = rec_replay_routes + which * rec_replay_nworkers;
 
-    // XXX
     while (pos < end) {
         const char *nextpos = lr.extract(pos, end);
         if (lr.command == logcmd_none) {
-            fprintf(stderr, "replay %s: %" PRIu64 " entries replayed, CORRUPT @%zu\n",
+            fprintf(stderr, "replay %s: %" PRIu64 " entries routed, CORRUPT @%zu\n",
                     filename_.c_str(), nr, pos - buf_);
             break;
         }
@@ -726,30 +1541,100 @@ logreplay::replayandclean1(kvepoch_t min_epoch, kvepoch_t max_epoch,
         // correctness of checkpoint scheme.
         assert(repbegin);
         repend = nextpos;
-        if (lr.key.len) { // skip empty entry
-            if (lr.command == logcmd_put
-                || lr.command == logcmd_replace
-                || lr.command == logcmd_modify
-                || lr.command == logcmd_remove)
-                lr.run(tree->table(), jrepo, *ti);
+        if (lr.command == logcmd_remove_range) {
+            // an empty first key starts the range at the beginning
+            logroute r = {lr.key, lr.ts, pos};
+            rec_replay_ranges[which].push_back(r);
+            ++nr;
+        } else if (logcmd_is_kv(lr.command) && lr.key.len) { // skip empty entry
+            logroute r = {lr.key, lr.ts, pos};
+            routes[lr.key.hashcode() % unsigned(rec_replay_nworkers)].push_back(r);
             ++nr;
-            if (nr % 100000 == 0)
-                fprintf(stderr,
-                        "replay %s: %" PRIu64 " entries replayed\n",
-                        filename_.c_str(), nr);
         }
-        // XXX RCU
         pos = nextpos;
     }
 
-    // rewrite portion of log
     if (!repbegin)
         repbegin = repend = buf_;
     else if (!repend) {
         fprintf(stderr, "replay %s: surprise repend\n", filename_.c_str());
         repend = pos;
     }
+    repbegin_ = repbegin;
+    repend_ = repend;
+    return nr;
+}
+
+// Apply every record routed to worker.
+uint64_t
+logreplay::apply(int worker, threadinfo *ti)
+{
+    std::vector<logroute> routes;
+    for (int i = 0; i != rec_replay_nlogs; ++i) {
+        std::vector<logroute>& r = rec_replay_routes[i * rec_replay_nworkers + worker];
+        routes.insert(routes.end(), r.begin(), r.end());
+        std::vector<logroute>().swap(r);
+    }
+    std::sort(routes.begin(), routes.end());
+
+    logrecord lr{};
+    std::vector<lcdf::Json> jrepo;
+    for (auto it = routes.begin(); it != routes.end(); ) {
+        auto next = it + 1;
+        while (next != routes.end() && next->key == it->key)
+            ++next;
+        Masstree::server_table::cursor_type lp(tree->table(), it->key);
+        bool found = lp.find_insert(*ti);
+        if (!found)
+            ti->observe_phantoms(lp.node());
+        for (; it != next; ++it) {
+            lr.extract(it->rec, it->rec + reinterpret_cast<const logrec_base*>(it->rec)->size_);
+            lr.apply(lp.value(), found, jrepo, *ti);
+            found = true;
+        }
+        lp.finish(1, *ti);
+    }
+    return routes.size();
+}
+
+// A range tombstone removes the rows in its range older than itself,
+// whatever order its records were replayed in.
+namespace {
+struct logreplay_range_remover {
+    kvtimestamp_t ts;
 
+    template <typename N>
+    void visit_leaf(N*, threadinfo&) {
+    }
+    bool visit_value(Str, row_slot<row_type>::type& value, threadinfo& ti) {
+        row_type* row = row_slot<row_type>::row(value);
+        if (!circular_int<kvtimestamp_t>::less(row->timestamp(), ts | 1))
+            return false;
+        row->deallocate(ti);
+        return true;
+    }
+};
+}
+
+uint64_t
+logreplay::apply_ranges(threadinfo *ti)
+{
+    uint64_t n = 0;
+    logrecord lr{};
+    for (int i = 0; i != rec_replay_nlogs; ++i)
+        for (const logroute& r : rec_replay_ranges[i]) {
+            lr.extract(r.rec, r.rec + reinterpret_cast<const logrec_base*>(r.rec)->size_);
+            logreplay_range_remover remover = {lr.ts};
+            n += tree->table().remove_range(lr.key, lr.val, remover, *ti);
+        }
+    return n;
+}
+
+// Rewrite the log to hold only [repbegin_, repend_), and unmap it.
+void
+logreplay::rewrite()
+{
+    const char *repbegin = repbegin_, *repend = repend_;
     char tmplog[256];
     int r = snprintf(tmplog, sizeof(tmplog), "%s.tmp", filename_.c_str());
     always_assert(r >= 0 && size_t(r) < sizeof(tmplog));
@@ -758,7 +1643,7 @@ logreplay::replayandclean1(kvepoch_t min_epoch, kvepoch_t max_epoch,
            filename_.c_str(), size_, repend - repbegin,
            repbegin - buf_, repend - buf_);
 
-    bool need_copy = repbegin != buf_;
+    bool need_copy = repbegin != buf_ || decoded_;
     int fd;
     if (!need_copy)
         fd = replay_truncate(repend - repbegin);
@@ -782,7 +1667,6 @@ logreplay::replayandclean1(kvepoch_t min_epoch, kvepoch_t max_epoch,
         }
     }
 
-    return nr;
 }
 
 int
@@ -857,10 +1741,20 @@ logreplay::replay(int which, threadinfo *ti)
     inactive();
 
     waituntilphase(REC_LOG_REPLAY);
+    uint64_t nr = 0;
+    if (buf_)
+        nr = route(which, rec_replay_min_epoch, rec_replay_max_epoch);
+    inactive();
+
+    waituntilphase(REC_LOG_APPLY);
+    ti->rcu_start();
+    apply(which, ti);
+    ti->rcu_stop();
+    inactive();
+
+    waituntilphase(REC_LOG_REWRITE);
     if (buf_) {
-        ti->rcu_start();
-        uint64_t nr = replayandclean1(rec_replay_min_epoch, rec_replay_max_epoch, ti);
-        ti->rcu_stop();
+        rewrite();
         printf("recovered %" PRIu64 " records from %s\n", nr, filename_.c_str());
     }
     inactive();
@@ -19,6 +19,7 @@
 #include "string.hh"
 #include "kvproto.hh"
 #include "str.hh"
+#include "kvstats.hh"
 #include <pthread.h>
 class logset;
 using lcdf::Str;
@@ -30,9 +31,6 @@ class loginfo {
   public:
     void initialize(const lcdf::String& logfile);
 
-    inline void acquire();
-    inline void release();
-
     inline kvepoch_t flushed_epoch() const;
     inline bool quiescent() const;
 
@@ -42,18 +40,29 @@ class loginfo {
         kvtimestamp_t ts;
         kvtimestamp_t prev_ts;
     };
-    // NB may block!
-    void record(int command, const query_times& qt, Str key, Str value);
-    void record(int command, const query_times& qt, Str key,
-                const lcdf::Json* req, const lcdf::Json* end_req);
+    // Call before the write becomes visible (i.e., with the row locked),
+    // so the record lands in an epoch no earlier than any write that
+    // depends on it. NB may block if the buffer is full!
+    // Returns the log position just past the record, for wait_durable().
+    uint64_t record(int command, const query_times& qt, Str key, Str value);
+    uint64_t record(int command, const query_times& qt, Str key,
+                    const lcdf::Json* req, const lcdf::Json* end_req);
+
+    // group commit
+    bool wait_durable(uint64_t lsn, double timeout);
 
   private:
-    struct waitlist {
-        waitlist* next;
-    };
+    // Writers reserve buffer space with one fetch_and_add on tail_, which
+    // packs the buffer position with the log's current epoch tag and a
+    // quiescent bit. A reservation is usable if the tag is no earlier than
+    // the writer's epoch and the log isn't quiescent; anything else (a new
+    // epoch, a wake record, leaving quiescence) takes the slow path under
+    // lock_, whose holder alone changes the tag bits. Each record's
+    // command word is stored last and marks it complete for the flusher;
+    // abandoned reservations become logcmd_skip records.
     struct front {
+        uint64_t tail_;
         uint32_t lock_;
-        waitlist* waiting_;
         lcdf::String::rep_type filename_;
         logset* logset_;
     };
@@ -62,9 +71,38 @@ class loginfo {
         int allocation_offset_;
     };
 
+    // The flusher sleeps on flush_cond_ until log_group_commit_bytes are
+    // buffered, log_group_commit_interval passes, or someone asks for a
+    // flush. Writers that find the buffer full sleep on space_cond_;
+    // wait_durable() sleeps on durable_cond_.
+    struct logio;
+    struct logbatch;
+    struct commit {
+        pthread_mutex_t mu_;
+        pthread_cond_t flush_cond_;
+        pthread_cond_t space_cond_;
+        pthread_cond_t durable_cond_;
+        uint64_t lsn_base_;     // log position of buf_[0]
+        uint64_t flushed_lsn_;  // log position fsync()ed to disk
+        bool flush_requested_;
+        logio* io_;
+        // statistics
+        uint64_t stalls_;
+        uint64_t durable_timeouts_;
+        uint64_t buffer_waits_;
+        uint64_t written_bytes_;    // after compression
+        kvhistogram* flush_usec_;
+        kvhistogram* batch_bytes_;
+        kvhistogram* compress_usec_;
+    };
+
     front f_;
     char padding1_[CACHE_LINE_SIZE - sizeof(front)];
 
+    commit c_;
+    char padding2_[(sizeof(commit) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE
+                   * CACHE_LINE_SIZE - sizeof(commit)];
+
     kvepoch_t log_epoch_;       // epoch written to log (non-quiescent)
     kvepoch_t quiescent_epoch_; // epoch we went quiescent
     kvepoch_t wake_epoch_;      // epoch for which we recorded a wake command
@@ -73,7 +111,6 @@ class loginfo {
     union {
         struct {
             char *buf_;
-            uint32_t pos_;
             uint32_t len_;
 
             // We have logged all writes up to, but not including,
@@ -93,10 +130,49 @@ class loginfo {
         };
     };
 
+    static constexpr int tail_pos_bits = 40;
+    static constexpr uint64_t tail_pos_mask = (uint64_t(1) << tail_pos_bits) - 1;
+    static constexpr uint64_t tail_quiescent = uint64_t(1) << tail_pos_bits;
+    static constexpr int tail_tag_shift = tail_pos_bits + 1;
+    static constexpr uint32_t tail_tag_mask = (1U << (64 - tail_tag_shift)) - 1;
+
+    static uint64_t tail_pos(uint64_t t) {
+        return t & tail_pos_mask;
+    }
+    static uint32_t tail_tag(uint64_t t) {
+        return t >> tail_tag_shift;
+    }
+    static uint32_t epoch_tag(kvepoch_t e) {
+        return e.value() & tail_tag_mask;
+    }
+    // Return true if epoch tag a is earlier than epoch tag b.
+    static bool tag_before(uint32_t a, uint32_t b) {
+        uint32_t d = (b - a) & tail_tag_mask;
+        return d && d <= (tail_tag_mask >> 1);
+    }
+    static uint64_t make_tail(kvepoch_t epoch, bool quiescent, uint64_t pos) {
+        return (uint64_t(epoch_tag(epoch)) << tail_tag_shift)
+            | (quiescent ? tail_quiescent : 0) | pos;
+    }
+
     loginfo(logset* ls, int logindex);
     ~loginfo();
     void* run();
     static void* trampoline(void*);
+    inline void acquire();
+    inline void release();
+    uint64_t record_slow(const query_times& qt, size_t n, char*& slot);
+    uint64_t reserve_locked(kvepoch_t epoch, bool quiescent, size_t n);
+    uint64_t complete_prefix(const char* buf, uint64_t end) const;
+    void wait_for_space();
+    void wait_for_work();
+    void wake_flusher();
+    void start_io(int fd);
+    char* take_buffer();
+    void submit_batch(char* buf, uint64_t len, uint64_t lsn, kvepoch_t epoch);
+    void finish_batch(const logbatch& b);
+    void* reap();
+    static void* reap_trampoline(void*);
 
     friend class logset;
 };
@@ -110,6 +186,8 @@ class logset {
     inline loginfo& log(int i);
     inline const loginfo& log(int i) const;
 
+    void json_stats(lcdf::Json& j) const;
+
   private:
     loginfo li_[0];
 };
@@ -117,6 +195,16 @@ class logset {
 extern kvepoch_t global_log_epoch;
 extern kvepoch_t global_wake_epoch;
 extern struct timeval log_epoch_interval;
+extern uint32_t log_group_commit_bytes;
+extern double log_group_commit_interval;
+extern int log_io_depth;
+extern int log_compress;
+
+// Compressed logs write each flushed batch as one logcmd_block record.
+// Keys are prefix-coded against the previous record in the batch, and the
+// result is optionally LZ4-compressed.
+enum { log_compress_none = 0, log_compress_prefix, log_compress_lz4 };
+bool log_compress_supported(int codec);
 
 enum logcommand {
     logcmd_none = 0,
@@ -124,9 +212,12 @@ enum logcommand {
     logcmd_replace = 0x3155506B,        // "kPU1"
     logcmd_modify = 0x444F4D6B,         // "kMOD"
     logcmd_remove = 0x4D45526B,         // "kREM"
+    logcmd_remove_range = 0x4752526B,   // "kRRG": key is first, value last
     logcmd_epoch = 0x4F50456B,          // "kEPO"
     logcmd_quiesce = 0x4955516B,        // "kQUI"
-    logcmd_wake = 0x4B41576B            // "kWAK"
+    logcmd_wake = 0x4B41576B,           // "kWAK"
+    logcmd_skip = 0x504B536B,           // "kSKP"
+    logcmd_block = 0x4B4C426B           // "kBLK"
 };
 
 
@@ -148,20 +239,33 @@ class logreplay {
 
     void replay(int i, threadinfo *ti);
 
+    // Set up and tear down parallel replay: records from nlogs logs are
+    // applied by nworkers workers. Workers other than the log threads
+    // call apply() during REC_LOG_APPLY.
+    static void prepare(int nlogs, int nworkers);
+    static uint64_t apply(int worker, threadinfo *ti);
+    // Then apply the range tombstones, once every key is replayed.
+    static uint64_t apply_ranges(threadinfo *ti);
+    static void cleanup();
+
   private:
     lcdf::String filename_;
     int errno_;
     off_t size_;
     char *buf_;
+    bool decoded_;              // buf_ is malloced, not the mapped file
+    const char *repbegin_;      // part of the log kept after replay
+    const char *repend_;
 
-    uint64_t replayandclean1(kvepoch_t min_epoch, kvepoch_t max_epoch,
-                             threadinfo *ti);
+    void decode_blocks();
+    uint64_t route(int which, kvepoch_t min_epoch, kvepoch_t max_epoch);
+    void rewrite();
     int replay_truncate(size_t len);
     int replay_copy(const char *tmpname, const char *first, const char *last);
 };
 
-enum { REC_NONE, REC_CKP, REC_LOG_TS, REC_LOG_ANALYZE_WAKE,
-       REC_LOG_REPLAY, REC_DONE };
+enum { REC_NONE, REC_CKP, REC_CKP_BUILD, REC_CKP_DELTA, REC_LOG_TS, REC_LOG_ANALYZE_WAKE,
+       REC_LOG_REPLAY, REC_LOG_APPLY, REC_LOG_REWRITE, REC_DONE };
 extern void recphase(int nactive, int state);
 extern void waituntilphase(int phase);
 extern void inactive();
@@ -31,12 +31,15 @@ template <int LW = 15, int IW = LW> struct nodeparams {
     static constexpr int internode_width = IW;
     static constexpr bool concurrent = true;
     static constexpr bool prefetch = true;
-    static constexpr int bound_method = bound_method_binary;
+    static constexpr int bound_method = MASSTREE_BOUND_METHOD;
     static constexpr int debug_level = 0;
     typedef uint64_t ikey_type;
     typedef uint32_t nodeversion_value_type;
     static constexpr bool need_phantom_epoch = true;
     typedef uint64_t phantom_epoch_type;
+    // If true, keys are at most sizeof(ikey_type) bytes long: leaves keep
+    // no key suffixes and the tree has no layers.
+    static constexpr bool ikey_only = false;
     static constexpr ssize_t print_max_indent_depth = 12;
     typedef key_unparse_printable_string key_unparse_type;
 };
@@ -53,6 +56,7 @@ template <typename P> class key;
 template <typename P> class basic_table;
 template <typename P> class unlocked_tcursor;
 template <typename P> class tcursor;
+template <typename P> class bulk_loader;
 
 template <typename P>
 class basic_table {
@@ -73,17 +77,35 @@ class basic_table {
     inline node_type* root() const;
     inline node_type* fix_root();
 
+    // A remove that leaves a leaf with at most merge_fill() keys tries to
+    // merge that leaf with a neighbor. 0 (the default) disables merging.
+    inline int merge_fill() const;
+    inline void set_merge_fill(int n);
+
+    // Return true if key can be inserted. Tables whose parameters set
+    // ikey_only hold only keys of at most sizeof(ikey_type) bytes.
+    static bool key_fits(Str key) {
+        return !P::ikey_only
+            || key.length() <= int(sizeof(typename P::ikey_type));
+    }
+
     bool get(Str key, value_type& value, threadinfo& ti) const;
+    void prefetch_paths(const Str* keys, int n, threadinfo& ti) const;
 
     template <typename F>
     int scan(Str firstkey, bool matchfirst, F& scanner, threadinfo& ti) const;
     template <typename F>
     int rscan(Str firstkey, bool matchfirst, F& scanner, threadinfo& ti) const;
 
+    template <typename F>
+    uint64_t remove_range(Str firstkey, Str lastkey, F& remover,
+                          threadinfo& ti);
+
     inline void print(FILE* f = 0) const;
 
   private:
     node_type* root_;
+    int merge_fill_;
 
     template <typename H, typename F>
     int scan(H helper, Str firstkey, bool matchfirst,
@@ -91,6 +113,54 @@ class basic_table {
 
     friend class unlocked_tcursor<P>;
     friend class tcursor<P>;
+    friend class bulk_loader<P>;
+};
+
+/** @brief Remembers the leaf where a thread's last lookup ended.
+
+    A cursor built with a finger first tries that leaf, and descends from
+    the root if the key is outside it. Nearly sequential keys thus skip
+    the internodes. A miss costs the leaf and its successor's bound, so
+    after max_misses misses in a row the finger goes unused for
+    skip_lookups lookups before it is tried again; random keys then pay
+    almost nothing. A finger is only trusted within the RCU epoch that
+    recorded it, while its leaf cannot have been freed. */
+class finger {
+  public:
+    finger()
+        : table_(), misses_() {
+    }
+    void clear() {
+        table_ = 0;
+    }
+
+  private:
+    enum { max_prefix = 32, max_misses = 4, skip_lookups = 64 };
+    const void* table_;
+    void* leaf_;
+    void* root_;                // root of leaf_'s layer
+    uint64_t epoch_;
+    int prefixlen_;             // bytes of key consumed by upper layers
+    unsigned misses_;           // consecutive misses, then skipped lookups
+    char prefix_[max_prefix];
+
+    template <typename P>
+    leaf<P>* start(const basic_table<P>& table, key<typename P::ikey_type>& ka,
+                   node_base<P>*& root,
+                   typename node_base<P>::nodeversion_type& v,
+                   typename P::threadinfo_type& ti);
+    template <typename P>
+    leaf<P>* try_start(const basic_table<P>& table,
+                       key<typename P::ikey_type>& ka, node_base<P>*& root,
+                       typename node_base<P>::nodeversion_type& v,
+                       typename P::threadinfo_type& ti) const;
+    template <typename P>
+    void remember(const basic_table<P>& table, leaf<P>* n, node_base<P>* root,
+                  const key<typename P::ikey_type>& ka,
+                  typename P::threadinfo_type& ti);
+
+    template <typename P> friend class unlocked_tcursor;
+    template <typename P> friend class tcursor;
 };
 
 } // namespace Masstree
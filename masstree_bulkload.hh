@@ -0,0 +1,268 @@
+/* Masstree
+ * Eddie Kohler, Yandong Mao, Robert Morris
+ * Copyright (c) 2012-2014 President and Fellows of Harvard College
+ * Copyright (c) 2012-2014 Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Masstree LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Masstree LICENSE file; the license in that file
+ * is legally binding.
+ */
+#ifndef MASSTREE_BULKLOAD_HH
+#define MASSTREE_BULKLOAD_HH
+#include "masstree_struct.hh"
+#include <vector>
+namespace Masstree {
+
+/** @brief Builds a tree bottom-up from keys in sorted order.
+
+    add_leaves() packs sorted, unique keys into a chain of full leaves,
+    creating a layer wherever two or more keys share an 8-byte slice.
+    Chains built independently for adjacent key ranges, for instance by
+    different threads, can be joined with splice(); install() then builds
+    the internodes above the chain and makes it the root of an empty
+    table. Nothing is visible to other threads until install(), so no
+    locking is done. */
+template <typename P>
+class bulk_loader {
+  public:
+    typedef typename P::value_type value_type;
+    typedef typename P::ikey_type ikey_type;
+    typedef typename P::threadinfo_type threadinfo;
+    typedef node_base<P> node_type;
+    typedef leaf<P> leaf_type;
+    typedef internode<P> internode_type;
+    typedef typename leaf_type::leafvalue_type leafvalue_type;
+    typedef typename leaf_type::permuter_type permuter_type;
+    typedef key<ikey_type> key_type;
+
+    struct entry {
+        Str key;
+        value_type value;
+    };
+
+    inline bulk_loader();
+
+    /** @brief Return the ikey of @a k in the top layer.
+
+        Leaves never split keys with equal ikeys, so callers dividing
+        work among several loaders must divide at ikey boundaries. */
+    static ikey_type ikey(Str k) {
+        return key_type(k).ikey();
+    }
+
+    /** @pre [@a first, @a last) is sorted, and every key in it is greater
+        than every key previously added, with a different ikey. */
+    void add_leaves(const entry* first, const entry* last, threadinfo& ti);
+    void splice(bulk_loader<P>& x, threadinfo& ti);
+    bool empty() const {
+        return !head_ && !npending_;
+    }
+    size_t nleaves() const {
+        return nleaves_;
+    }
+
+    void install(basic_table<P>& table, threadinfo& ti);
+
+  private:
+    struct slot {
+        ikey_type ikey;
+        int keylenx;
+        Str suffix;
+        leafvalue_type lv;
+    };
+
+    int offset_;
+    leaf_type* head_;
+    leaf_type* tail_;
+    size_t nleaves_;
+    int npending_;
+    slot pending_[leaf_type::width];
+
+    void flush_leaf(threadinfo& ti);
+    node_type* finish(threadinfo& ti);
+    Str layer_key(const entry* e) const {
+        return Str(e->key.s + offset_, e->key.len - offset_);
+    }
+};
+
+template <typename P>
+inline bulk_loader<P>::bulk_loader()
+    : offset_(0), head_(), tail_(), nleaves_(0), npending_(0) {
+}
+
+template <typename P>
+void bulk_loader<P>::add_leaves(const entry* first, const entry* last,
+                                threadinfo& ti)
+{
+    while (first != last) {
+        // collect the group of keys sharing this ikey; shorter keys
+        // sort first, so keys that need a suffix are at the end
+        key_type ka(layer_key(first));
+        const entry* long_first = first;
+        const entry* group_last = first;
+        while (group_last != last) {
+            key_type kx(layer_key(group_last));
+            if (kx.ikey() != ka.ikey())
+                break;
+            if (!kx.has_suffix())
+                long_first = group_last + 1;
+            ++group_last;
+        }
+        int nslots = (long_first - first) + (long_first != group_last);
+        masstree_invariant(nslots <= leaf_type::width);
+        if (npending_ + nslots > leaf_type::width)
+            flush_leaf(ti);
+
+        for (; first != long_first; ++first) {
+            slot& s = pending_[npending_];
+            ++npending_;
+            s.ikey = ka.ikey();
+            s.keylenx = key_type(layer_key(first)).length();
+            s.lv = leafvalue_type(first->value);
+        }
+        if (long_first + 1 == group_last) {
+            slot& s = pending_[npending_];
+            ++npending_;
+            key_type kx(layer_key(long_first));
+            s.ikey = ka.ikey();
+            s.keylenx = leaf_type::ksuf_keylenx;
+            s.suffix = kx.suffix();
+            s.lv = leafvalue_type(long_first->value);
+        } else if (long_first != group_last) {
+            bulk_loader<P> sub;
+            sub.offset_ = offset_ + sizeof(ikey_type);
+            sub.add_leaves(long_first, group_last, ti);
+            slot& s = pending_[npending_];
+            ++npending_;
+            s.ikey = ka.ikey();
+            s.keylenx = leaf_type::layer_keylenx;
+            s.lv = leafvalue_type(sub.finish(ti));
+        }
+        first = group_last;
+    }
+}
+
+template <typename P>
+void bulk_loader<P>::flush_leaf(threadinfo& ti)
+{
+    if (!npending_)
+        return;
+    size_t ksufsize = 0;
+    for (int p = 0; p != npending_; ++p)
+        if (pending_[p].keylenx == leaf_type::ksuf_keylenx)
+            ksufsize += pending_[p].suffix.len;
+    if (ksufsize)
+        ksufsize += leaf_type::internal_ksuf_type::overhead(leaf_type::width);
+
+    leaf_type* n = leaf_type::make(ksufsize, typename P::phantom_epoch_type(), ti);
+    for (int p = 0; p != npending_; ++p) {
+        const slot& s = pending_[p];
+        n->lv_[p] = s.lv;
+        n->ikey0_[p] = s.ikey;
+        n->keylenx_[p] = s.keylenx;
+        if (s.keylenx == leaf_type::ksuf_keylenx)
+            n->assign_ksuf(p, s.suffix, true, ti);
+    }
+    n->permutation_ = permuter_type::make_sorted(npending_);
+    n->next_.ptr = 0;
+    n->prev_ = tail_;
+    if (tail_)
+        tail_->next_.ptr = n;
+    else
+        head_ = n;
+    tail_ = n;
+    ++nleaves_;
+    npending_ = 0;
+}
+
+/** @brief Append @a x's leaves to this chain, leaving @a x empty.
+    @pre Every key in @a x is greater than every key in *this, with a
+    different ikey. */
+template <typename P>
+void bulk_loader<P>::splice(bulk_loader<P>& x, threadinfo& ti)
+{
+    masstree_precondition(offset_ == x.offset_);
+    flush_leaf(ti);
+    x.flush_leaf(ti);
+    if (!x.head_)
+        return;
+    if (tail_) {
+        tail_->next_.ptr = x.head_;
+        x.head_->prev_ = tail_;
+    } else
+        head_ = x.head_;
+    tail_ = x.tail_;
+    nleaves_ += x.nleaves_;
+    x.head_ = x.tail_ = 0;
+    x.nleaves_ = 0;
+}
+
+/** @brief Build internodes over the leaf chain and return the layer root. */
+template <typename P>
+node_base<P>* bulk_loader<P>::finish(threadinfo& ti)
+{
+    flush_leaf(ti);
+    if (!head_)
+        return leaf_type::make_root(0, 0, ti);
+
+    std::vector<node_type*> level;
+    std::vector<ikey_type> bounds;
+    for (leaf_type* n = head_; n; n = n->safe_next()) {
+        level.push_back(n);
+        bounds.push_back(n->ikey_bound());
+    }
+
+    uint32_t height = 0;
+    while (level.size() > 1) {
+        ++height;
+        size_t out = 0;
+        for (size_t i = 0; i != level.size(); ++out) {
+            size_t nchild = std::min(level.size() - i,
+                                     size_t(internode_type::width + 1));
+            // don't leave a single child for the last internode
+            if (level.size() - i - nchild == 1)
+                --nchild;
+            internode_type* in = internode_type::make(height, ti);
+            in->child_[0] = level[i];
+            level[i]->set_parent(in);
+            for (size_t k = 1; k != nchild; ++k) {
+                in->ikey0_[k - 1] = bounds[i + k];
+                in->child_[k] = level[i + k];
+                level[i + k]->set_parent(in);
+            }
+            in->nkeys_ = nchild - 1;
+            bounds[out] = bounds[i];
+            level[out] = in;
+            i += nchild;
+        }
+        level.resize(out);
+        bounds.resize(out);
+    }
+
+    level[0]->make_layer_root();
+    head_ = tail_ = 0;
+    return level[0];
+}
+
+/** @brief Make the loaded keys the contents of @a table.
+    @pre @a table is empty and not in use by any other thread. */
+template <typename P>
+void bulk_loader<P>::install(basic_table<P>& table, threadinfo& ti)
+{
+    node_type* root = finish(ti);
+    node_type* old_root = table.root_;
+    masstree_precondition(old_root->isleaf()
+                          && static_cast<leaf_type*>(old_root)->size() == 0);
+    fence();
+    table.root_ = root;
+    static_cast<leaf_type*>(old_root)->deallocate(ti);
+}
+
+} // namespace Masstree
+#endif
@@ -19,6 +19,85 @@
 #include "masstree_key.hh"
 namespace Masstree {
 
+/** @brief Return the remembered leaf to start a search for @a ka from.
+
+    Returns null if the finger is resting after repeated misses, or if
+    try_start() misses. */
+template <typename P>
+leaf<P>* finger::start(const basic_table<P>& table,
+                       key<typename P::ikey_type>& ka, node_base<P>*& root,
+                       typename node_base<P>::nodeversion_type& v,
+                       typename P::threadinfo_type& ti)
+{
+    if (misses_ >= max_misses) {
+        if (++misses_ != max_misses + skip_lookups)
+            return nullptr;
+        // one more try; another miss rests the finger again
+        misses_ = max_misses - 1;
+    }
+    leaf<P>* n = try_start(table, ka, root, v, ti);
+    misses_ = n ? 0 : misses_ + 1;
+    return n;
+}
+
+/** @brief Return the remembered leaf if @a ka lies in it.
+
+    Returns null if the finger is stale, belongs to another table or
+    layer, or if @a ka lies outside its leaf. Otherwise shifts @a ka to
+    the leaf's layer, sets @a root to the layer's root and @a v to the
+    leaf's stable version. */
+template <typename P>
+leaf<P>* finger::try_start(const basic_table<P>& table,
+                           key<typename P::ikey_type>& ka,
+                           node_base<P>*& root,
+                           typename node_base<P>::nodeversion_type& v,
+                           typename P::threadinfo_type& ti) const
+{
+    if (table_ != &table || !epoch_ || epoch_ != ti.gc_epoch()
+        || (prefixlen_
+            && (ka.length() <= prefixlen_
+                || memcmp(ka.full_string().s, prefix_, prefixlen_) != 0)))
+        return nullptr;
+
+    key<typename P::ikey_type> k(ka);
+    if (prefixlen_)
+        k.shift_by(prefixlen_);
+    leaf<P>* n = static_cast<leaf<P>*>(leaf_);
+    v = n->stable_annotated(ti.stable_fence());
+    // a leaf's ikey_bound() doesn't change until it is deleted
+    if (v.deleted() || n->deleted_layer()
+        || (n->prev_ && compare(k.ikey(), n->ikey_bound()) < 0))
+        return nullptr;
+    leaf<P>* next = n->safe_next();
+    if (next && compare(k.ikey(), next->ikey_bound()) >= 0)
+        return nullptr;
+
+    ka = k;
+    root = static_cast<node_base<P>*>(root_);
+    return n;
+}
+
+template <typename P>
+void finger::remember(const basic_table<P>& table, leaf<P>* n,
+                      node_base<P>* root,
+                      const key<typename P::ikey_type>& ka,
+                      typename P::threadinfo_type& ti)
+{
+    // a resting finger needs only the leaf before its next try
+    if (misses_ >= max_misses && misses_ != max_misses + skip_lookups - 1)
+        return;
+    prefixlen_ = ka.prefix_length();
+    epoch_ = ti.gc_epoch();
+    if (prefixlen_ > max_prefix || !epoch_) {
+        table_ = nullptr;
+        return;
+    }
+    table_ = &table;
+    leaf_ = n;
+    root_ = root;
+    memcpy(prefix_, ka.full_string().s, prefixlen_);
+}
+
 template <typename P>
 bool unlocked_tcursor<P>::find_unlocked(threadinfo& ti)
 {
@@ -26,6 +105,14 @@ bool unlocked_tcursor<P>::find_unlocked(threadinfo& ti)
     key_indexed_position kx;
     node_base<P>* root = const_cast<node_base<P>*>(root_);
 
+    if (finger_) {
+        if ((n_ = finger_->start(*table_, ka_, root, v_, ti))) {
+            ti.mark(tc_finger_hit);
+            goto forward;
+        }
+        ti.mark(tc_finger_miss);
+    }
+
  retry:
     n_ = root->reach_leaf(ka_, v_, ti);
 
@@ -52,8 +139,10 @@ bool unlocked_tcursor<P>::find_unlocked(threadinfo& ti)
         ka_.shift_by(-match);
         root = lv_.layer();
         goto retry;
-    } else
-        return match;
+    }
+    if (finger_)
+        finger_->remember(*table_, n_, root, ka_, ti);
+    return match;
 }
 
 template <typename P>
@@ -67,6 +156,52 @@ inline bool basic_table<P>::get(Str key, value_type &value,
     return found;
 }
 
+/** @brief Prefetch the lookup paths for @a n keys.
+
+    Walks the keys toward their leaves in lockstep, one tree level per
+    round, so the prefetch of each key's next node overlaps the searches
+    of the others. The walk takes no versions and may go astray under
+    concurrent splits; it only warms the cache for following lookups.
+    Stops at the first layer. Call within an RCU critical section. */
+template <typename P>
+void basic_table<P>::prefetch_paths(const Str* keys, int n,
+                                    threadinfo&) const
+{
+    enum { max_group = 16 };
+    const node_base<P>* node[max_group];
+    const node_base<P>* r = root_;
+    while (!r->is_root())
+        r = r->maybe_parent();
+
+    for (int g = 0; g < n; g += max_group) {
+        int m = std::min(n - g, int(max_group));
+        for (int i = 0; i != m; ++i)
+            node[i] = r;
+        for (bool more = true; more; ) {
+            more = false;
+            for (int i = 0; i != m; ++i)
+                if (node[i] && !node[i]->isleaf()) {
+                    const internode<P>* in =
+                        static_cast<const internode<P>*>(node[i]);
+                    key<typename P::ikey_type> ka(keys[g + i]);
+                    int kp = internode<P>::bound_type::upper(ka, *in);
+                    if ((node[i] = in->child_[kp])) {
+                        node[i]->prefetch_full();
+                        more = true;
+                    }
+                }
+        }
+        for (int i = 0; i != m; ++i)
+            if (node[i]) {
+                const leaf<P>* lf = static_cast<const leaf<P>*>(node[i]);
+                key<typename P::ikey_type> ka(keys[g + i]);
+                key_indexed_position kx = leaf<P>::bound_type::lower(ka, *lf);
+                if (kx.p >= 0)
+                    lf->lv_[kx.p].prefetch(lf->keylenx_[kx.p]);
+            }
+    }
+}
+
 template <typename P>
 bool tcursor<P>::find_locked(threadinfo& ti)
 {
@@ -74,6 +209,14 @@ bool tcursor<P>::find_locked(threadinfo& ti)
     nodeversion_type v;
     permuter_type perm;
 
+    if (finger_) {
+        if ((n_ = finger_->start(*table_, ka_, root, v, ti))) {
+            ti.mark(tc_finger_hit);
+            goto forward;
+        }
+        ti.mark(tc_finger_miss);
+    }
+
  retry:
     n_ = root->reach_leaf(ka_, v, ti);
 
@@ -114,6 +257,8 @@ bool tcursor<P>::find_locked(threadinfo& ti)
         n_->unlock();
         goto retry;
     }
+    if (finger_)
+        finger_->remember(*table_, n_, root, ka_, ti);
     return state_;
 }
 
@@ -22,6 +22,7 @@ namespace Masstree {
 template <typename P>
 bool tcursor<P>::find_insert(threadinfo& ti)
 {
+    masstree_precondition(!P::ikey_only || !ka_.has_suffix());
     find_locked(ti);
     original_n_ = n_;
     original_v_ = n_->full_unlocked_version_value();
@@ -34,7 +35,7 @@ bool tcursor<P>::find_insert(threadinfo& ti)
     state_ = 2;
 
     // maybe we need a new layer
-    if (kx_.p >= 0)
+    if (!P::ikey_only && kx_.p >= 0)
         return make_new_layer(ti);
 
     // mark insertion if we are changing modification state
@@ -168,11 +168,89 @@ bool tcursor<P>::finish_remove(threadinfo& ti) {
     permuter_type perm(n_->permutation_);
     perm.remove(kx_.i);
     n_->permutation_ = perm.value();
-    if (perm.size()) {
-        return false;
-    } else {
+    return coalesce(perm.size(), ti);
+}
+
+/** Clean up n_ after removing keys from it, leaving @a size keys.
+ * @pre n_ is locked
+ * @return true iff n_ was unlocked (it was removed or merged away) */
+template <typename P>
+bool tcursor<P>::coalesce(int size, threadinfo& ti) {
+    if (!size) {
         return remove_leaf(n_, root_, ka_.prefix_string(), ti);
+    } else if (size > merge_fill_) {
+        return false;
+    }
+
+    // The leaf is underfull. Fold it into its predecessor, or, for the
+    // first leaf in a layer, fold the successor into it. We already hold
+    // n_, so neighbors are only try-locked.
+    if (leaf_type* prev = n_->prev_) {
+        if (prev->try_lock(ti.lock_fence(tc_leaf_lock))) {
+            bool merged = n_->prev_ == prev && !prev->deleted()
+                && merge_leaf(prev, n_, ti);
+            prev->unlock();
+            if (merged) {
+                return true;
+            }
+        }
+    } else if (leaf_type* next = n_->safe_next()) {
+        if (next->try_lock(ti.lock_fence(tc_leaf_lock))) {
+            if (!(n_->safe_next() == next && next->prev_ == n_
+                  && !next->deleted() && merge_leaf(n_, next, ti))) {
+                next->unlock();
+            }
+        }
     }
+    return false;
+}
+
+/** Move every key in @a from to the end of @a into, then remove @a from.
+ * @pre @a into and @a from are locked, into->next_ == from
+ * @return true iff the keys fit; then @a from has been unlocked and removed
+ *
+ * Readers of @a into retry because it is marked inserting, and readers of
+ * @a from see it marked deleted once its keys are all present in @a into.
+ * Internodes left empty by the removal collapse as in remove_leaf. */
+template <typename P>
+bool tcursor<P>::merge_leaf(leaf_type* into, leaf_type* from,
+                            threadinfo& ti)
+{
+    permuter_type iperm(into->permutation_);
+    permuter_type fperm(from->permutation_);
+    // don't reuse position 0, which holds the ikey_bound
+    int nfree = into->width - iperm.size();
+    for (int i = iperm.size(); into->prev_ && i != into->width; ++i) {
+        nfree -= iperm[i] == 0;
+    }
+    if (fperm.size() > nfree) {
+        ti.mark(tc_leaf_merge_skip);
+        return false;
+    }
+
+    into->mark_insert();
+    into->modstate_ = leaf<P>::modstate_insert;
+    for (int i = 0; i != fperm.size(); ++i) {
+        int si = iperm.size();
+        if (into->prev_ && iperm[si] == 0) {
+            ++si;
+        }
+        int p = iperm[si], xp = fperm[i];
+        into->lv_[p] = from->lv_[xp];
+        into->ikey0_[p] = from->ikey0_[xp];
+        into->keylenx_[p] = from->keylenx_[xp];
+        // assign_ksuf copies only suffixes in the published permutation,
+        // so publish each key before assigning the next
+        if (from->has_ksuf(xp)) {
+            into->assign_ksuf(p, from->ksuf(xp), false, ti);
+        }
+        iperm.insert_selected(iperm.size(), si);
+        fence();
+        into->permutation_ = iperm.value();
+    }
+
+    ti.mark(tc_leaf_merge);
+    return remove_leaf(from, root_, ka_.prefix_string(), ti);
 }
 
 template <typename P>
@@ -275,6 +353,141 @@ void tcursor<P>::redirect(internode_type* n, ikey_type ikey,
     n->unlock();
 }
 
+/** Remove the keys in [@a firstkey, @a lastkey) that @a remover accepts.
+ * An empty @a lastkey means no upper bound. Returns the number removed.
+ *
+ * Each leaf is locked once and loses all its keys in range with one
+ * permutation update. Emptied leaves are unlinked as by remove_leaf, and
+ * emptied layers are handed to gc_layer. The range is not removed
+ * atomically: concurrent writers see it drained leaf by leaf.
+ *
+ * With the leaf locked, @a remover sees remover.visit_leaf(leaf, ti),
+ * then remover.visit_value(key, value, ti) for each key in range, which
+ * should return true iff it has disposed of value and the key should go. */
+template <typename P> template <typename F>
+uint64_t basic_table<P>::remove_range(Str firstkey, Str lastkey,
+                                      F& remover, threadinfo& ti)
+{
+    typedef typename P::ikey_type ikey_type;
+    char key[MASSTREE_MAXKEYLEN + sizeof(ikey_type) + 1];
+    masstree_precondition(firstkey.len <= MASSTREE_MAXKEYLEN);
+    memcpy(key, firstkey.s, firstkey.len);
+    int keylen = firstkey.len;
+    uint64_t count = 0;
+
+    while (!lastkey || Str(key, keylen) < lastkey) {
+        tcursor<P> lp(*this, key, keylen);
+        lp.find_locked(ti);
+        if (!lp.remove_range_leaf(key, keylen, lastkey, remover, count, ti)) {
+            break;
+        }
+    }
+    return count;
+}
+
+/** Remove keys in [@a key, @a lastkey) from the locked leaf n_ and
+ * unlock it. Then set @a key to where the range continues and return
+ * true, or return false if the range is done.
+ *
+ * @a key is the string ka_ was built from, so it is only overwritten once
+ * n_ is unlocked. */
+template <typename P> template <typename F>
+bool tcursor<P>::remove_range_leaf(char* key, int& keylen, Str lastkey,
+                                   F& remover, uint64_t& count,
+                                   threadinfo& ti)
+{
+    char buf[MASSTREE_MAXKEYLEN + sizeof(ikey_type) + 1];
+    Str prefix = ka_.prefix_string();
+    Str start(key, keylen);
+    memcpy(buf, prefix.s, prefix.len);
+    char* ikeyp = buf + prefix.len;
+    permuter_type perm(n_->permutation_);
+    int nremoved = 0, i = 0;
+    bool more = true, descend = false;
+
+    remover.visit_leaf(n_, ti);
+    while (i < perm.size()) {
+        int p = perm[i];
+        int keylenx = n_->keylenx_[p];
+        string_slice<ikey_type>::unparse_comparable(ikeyp, sizeof(ikey_type),
+                                                    n_->ikey0_[p],
+                                                    sizeof(ikey_type));
+        int len = prefix.len;
+        if (n_->keylenx_is_layer(keylenx)) {
+            // smallest key in the layer
+            ikeyp[sizeof(ikey_type)] = 0;
+            len += sizeof(ikey_type) + 1;
+        } else if (n_->keylenx_has_ksuf(keylenx)) {
+            Str suffix = n_->ksuf(p);
+            memcpy(ikeyp + sizeof(ikey_type), suffix.s, suffix.len);
+            len += sizeof(ikey_type) + suffix.len;
+        } else {
+            len += keylenx;
+        }
+
+        Str k(buf, len);
+        if (lastkey && k >= lastkey) {
+            more = false;
+            break;
+        } else if (n_->keylenx_is_layer(keylenx)) {
+            // find_locked descends into any layer holding start, so this
+            // layer is entirely before or after it
+            if (start <= k) {
+                descend = true;
+                break;
+            }
+        } else if (start <= k
+                   && remover.visit_value(k, n_->lv_[p].value(), ti)) {
+            if (!nremoved && n_->modstate_ == leaf<P>::modstate_insert) {
+                n_->mark_insert();
+                n_->modstate_ = leaf<P>::modstate_remove;
+            }
+            perm.remove(i);
+            ++nremoved;
+            continue;
+        }
+        ++i;
+    }
+
+    // find where the range continues
+    int nextlen = prefix.len;
+    if (descend) {
+        nextlen += sizeof(ikey_type) + 1;
+    } else if (!more) {
+        /* done */;
+    } else if (leaf_type* next = n_->safe_next()) {
+        nextlen += string_slice<ikey_type>::unparse_comparable
+            (ikeyp, sizeof(ikey_type), next->ikey_bound());
+    } else {
+        // end of this layer: continue after every key with its prefix
+        while (nextlen && (unsigned char) buf[nextlen - 1] == 255) {
+            --nextlen;
+        }
+        if (nextlen) {
+            ++buf[nextlen - 1];
+        } else {
+            more = false;
+        }
+        if (nremoved && prefix.len) {
+            gc_layer_rcu_callback<P>::make(root_, prefix, ti);
+        }
+    }
+
+    count += nremoved;
+    if (nremoved) {
+        n_->permutation_ = perm.value();
+    }
+    if (!nremoved || !coalesce(perm.size(), ti)) {
+        n_->unlock();
+    }
+
+    if (more) {
+        memcpy(key, buf, nextlen);
+        keylen = nextlen;
+    }
+    return more;
+}
+
 template <typename P>
 struct destroy_rcu_callback : public P::threadinfo_type::mrcu_callback {
     typedef typename P::threadinfo_type threadinfo;
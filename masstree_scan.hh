@@ -99,9 +99,14 @@ struct forward_scan_helper {
     int next(int ki) const {
         return ki + 1;
     }
-    template <typename N, typename K>
-    N *advance(const N *n, const K &) const {
-        return n->safe_next();
+    // A neighbor merged into n is unlinked only after n's version changes,
+    // so recheck the version after reading next_: if it changed, rescan n
+    // rather than skip the keys it just absorbed.
+    template <typename N, typename V, typename K>
+    N *advance(const N *n, const V &v, const K &) const {
+        N *next = n->safe_next();
+        fence();
+        return n->has_changed(v) ? const_cast<N *>(n) : next;
     }
     template <typename N, typename K>
     typename N::nodeversion_type stable(const N *n, const K &) const {
@@ -149,8 +154,8 @@ struct reverse_scan_helper {
     void mark_key_complete() const {
         upper_bound_ = false;
     }
-    template <typename N, typename K>
-    N *advance(const N *n, K &k) const {
+    template <typename N, typename V, typename K>
+    N *advance(const N *n, const V &, K &k) const {
         k.assign_store_ikey(n->ikey_bound());
         k.assign_store_length(0);
         return n->prev_;
@@ -291,7 +296,7 @@ int scanstackelt<P>::find_next(H &helper, key_type &ka, leafvalue_type &entry)
     }
 
     if (!n_->has_changed(v_)) {
-        n_ = helper.advance(n_, ka);
+        n_ = helper.advance(n_, v_, ka);
         if (!n_) {
             helper.mark_key_complete();
             return scan_up;
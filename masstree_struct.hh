@@ -137,6 +137,9 @@ class internode : public node_base<P> {
     ikey_type ikey(int p) const {
         return ikey0_[p];
     }
+    const ikey_type* ikey_array() const {
+        return ikey0_;
+    }
     int compare_key(ikey_type a, int bp) const {
         return ::compare(a, ikey(bp));
     }
@@ -196,14 +199,25 @@ class leafvalue {
   public:
     typedef typename P::value_type value_type;
     typedef typename make_prefetcher<P>::type prefetcher_type;
+    // Values are stored inline in the slot. A value_type wider than a
+    // pointer can't be read atomically, so tcursor::mark_value_update()
+    // marks the leaf and unlocked readers retry on the version change.
+    static constexpr bool wide_value = sizeof(value_type) > sizeof(uintptr_t);
+    static_assert(sizeof(value_type) <= 2 * sizeof(uintptr_t),
+                  "value_type too large to store inline");
+    static constexpr int nwords = wide_value ? 2 : 1;
 
     leafvalue() {
     }
     leafvalue(value_type v) {
+        if (sizeof(value_type) < sizeof(u_.x))
+            u_.x[nwords - 1] = 0;
         u_.v = v;
     }
     leafvalue(node_base<P>* n) {
-        u_.x = reinterpret_cast<uintptr_t>(n);
+        if (wide_value)
+            u_.x[nwords - 1] = 0;
+        u_.x[0] = reinterpret_cast<uintptr_t>(n);
     }
 
     static leafvalue<P> make_empty() {
@@ -212,10 +226,14 @@ class leafvalue {
 
     typedef bool (leafvalue<P>::*unspecified_bool_type)() const;
     operator unspecified_bool_type() const {
-        return u_.x ? &leafvalue<P>::empty : 0;
+        return empty() ? 0 : &leafvalue<P>::empty;
     }
+    // A wide value may have a zero first word, so check the whole slot.
     bool empty() const {
-        return !u_.x;
+        for (int i = 0; i != nwords; ++i)
+            if (u_.x[i])
+                return false;
+        return true;
     }
 
     value_type value() const {
@@ -226,7 +244,7 @@ class leafvalue {
     }
 
     node_base<P>* layer() const {
-        return reinterpret_cast<node_base<P>*>(u_.x);
+        return reinterpret_cast<node_base<P>*>(u_.x[0]);
     }
 
     void prefetch(int keylenx) const {
@@ -240,7 +258,7 @@ class leafvalue {
     union {
         node_base<P>* n;
         value_type v;
-        uintptr_t x;
+        uintptr_t x[nwords];
     } u_;
 };
 
@@ -297,6 +315,8 @@ class leaf : public node_base<P> {
     }
 
     static leaf<P>* make(int ksufsize, phantom_epoch_type phantom_epoch, threadinfo& ti) {
+        if (P::ikey_only)
+            ksufsize = 0;
         size_t sz = iceil(sizeof(leaf<P>) + std::min(ksufsize, 128), 64);
         void* ptr = ti.pool_allocate(sz, memtag_masstree_leaf);
         leaf<P>* n = new(ptr) leaf<P>(sz, phantom_epoch);
@@ -364,6 +384,9 @@ class leaf : public node_base<P> {
     ikey_type ikey(int p) const {
         return ikey0_[p];
     }
+    const ikey_type* ikey_array() const {
+        return ikey0_;
+    }
     ikey_type ikey_bound() const {
         return ikey0_[0];
     }
@@ -377,10 +400,10 @@ class leaf : public node_base<P> {
                                    threadinfo& ti) const;
 
     static bool keylenx_is_layer(int keylenx) {
-        return keylenx > 127;
+        return !P::ikey_only && keylenx > 127;
     }
     static bool keylenx_has_ksuf(int keylenx) {
-        return keylenx == ksuf_keylenx;
+        return !P::ikey_only && keylenx == ksuf_keylenx;
     }
 
     bool is_layer(int p) const {
@@ -410,7 +433,7 @@ class leaf : public node_base<P> {
     // Returns 1 if match & not layer, 0 if no match, <0 if match and layer
     int ksuf_matches(int p, const key_type& ka) const {
         int keylenx = keylenx_[p];
-        if (keylenx < ksuf_keylenx)
+        if (P::ikey_only || keylenx < ksuf_keylenx)
             return 1;
         if (keylenx == layer_keylenx)
             return -(int) sizeof(ikey_type);
@@ -497,7 +520,7 @@ class leaf : public node_base<P> {
     inline void assign(int p, const key_type& ka, threadinfo& ti) {
         lv_[p] = leafvalue_type::make_empty();
         ikey0_[p] = ka.ikey();
-        if (!ka.has_suffix()) {
+        if (P::ikey_only || !ka.has_suffix()) {
             keylenx_[p] = ka.length();
         } else {
             keylenx_[p] = ksuf_keylenx;
@@ -507,7 +530,7 @@ class leaf : public node_base<P> {
     inline void assign_initialize(int p, const key_type& ka, threadinfo& ti) {
         lv_[p] = leafvalue_type::make_empty();
         ikey0_[p] = ka.ikey();
-        if (!ka.has_suffix()) {
+        if (P::ikey_only || !ka.has_suffix()) {
             keylenx_[p] = ka.length();
         } else {
             keylenx_[p] = ksuf_keylenx;
@@ -535,6 +558,7 @@ class leaf : public node_base<P> {
                    threadinfo& ti);
 
     template <typename PP> friend class tcursor;
+    template <typename PP> friend class bulk_loader;
 };
 
 
@@ -779,7 +803,7 @@ void leaf<P>::assign_ksuf(int p, Str s, bool initializing, threadinfo& ti) {
 
 template <typename P>
 inline basic_table<P>::basic_table()
-    : root_(0) {
+    : root_(0), merge_fill_(0) {
 }
 
 template <typename P>
@@ -787,6 +811,16 @@ inline node_base<P>* basic_table<P>::root() const {
     return root_;
 }
 
+template <typename P>
+inline int basic_table<P>::merge_fill() const {
+    return merge_fill_;
+}
+
+template <typename P>
+inline void basic_table<P>::set_merge_fill(int n) {
+    merge_fill_ = std::max(0, std::min(n, leaf_type::width - 1));
+}
+
 template <typename P>
 inline node_base<P>* basic_table<P>::fix_root() {
     node_base<P>* root = root_;
@@ -30,34 +30,47 @@ class unlocked_tcursor {
     typedef typename leaf<P>::nodeversion_type nodeversion_type;
     typedef typename nodeversion_type::value_type nodeversion_value_type;
     typedef typename leaf<P>::permuter_type permuter_type;
+    typedef typename P::ikey_type ikey_type;
+    static constexpr int width = P::leaf_width;
 
     inline unlocked_tcursor(const basic_table<P>& table, Str str)
         : ka_(str), lv_(leafvalue<P>::make_empty()),
-          root_(table.root()) {
+          root_(table.root()), finger_() {
     }
     inline unlocked_tcursor(basic_table<P>& table, Str str)
         : ka_(str), lv_(leafvalue<P>::make_empty()),
-          root_(table.fix_root()) {
+          root_(table.fix_root()), finger_() {
+    }
+    // Start from, and then update, the leaf remembered by @a f.
+    inline unlocked_tcursor(const basic_table<P>& table, Str str, finger& f)
+        : ka_(str), lv_(leafvalue<P>::make_empty()),
+          root_(table.root()), finger_(&f), table_(&table) {
+    }
+    inline unlocked_tcursor(basic_table<P>& table, Str str, finger& f)
+        : ka_(str), lv_(leafvalue<P>::make_empty()),
+          root_(table.fix_root()), finger_(&f), table_(&table) {
     }
     inline unlocked_tcursor(const basic_table<P>& table,
                             const char* s, int len)
         : ka_(s, len), lv_(leafvalue<P>::make_empty()),
-          root_(table.root()) {
+          root_(table.root()), finger_() {
     }
     inline unlocked_tcursor(basic_table<P>& table,
                             const char* s, int len)
         : ka_(s, len), lv_(leafvalue<P>::make_empty()),
-          root_(table.fix_root()) {
+          root_(table.fix_root()), finger_() {
     }
     inline unlocked_tcursor(const basic_table<P>& table,
                             const unsigned char* s, int len)
         : ka_(reinterpret_cast<const char*>(s), len),
-          lv_(leafvalue<P>::make_empty()), root_(table.root()) {
+          lv_(leafvalue<P>::make_empty()), root_(table.root()),
+          finger_() {
     }
     inline unlocked_tcursor(basic_table<P>& table,
                             const unsigned char* s, int len)
         : ka_(reinterpret_cast<const char*>(s), len),
-          lv_(leafvalue<P>::make_empty()), root_(table.fix_root()) {
+          lv_(leafvalue<P>::make_empty()), root_(table.fix_root()),
+          finger_() {
     }
 
     bool find_unlocked(threadinfo& ti);
@@ -74,6 +87,9 @@ class unlocked_tcursor {
     inline int compare_key(const key_type& a, int bp) const {
         return n_->compare_key(a, bp);
     }
+    inline const ikey_type* ikey_array() const {
+        return n_->ikey_array();
+    }
     inline nodeversion_value_type full_version_value() const {
         static_assert(int(nodeversion_type::traits_type::top_stable_bits) >= int(leaf<P>::permuter_type::size_bits), "not enough bits to add size to version");
         return (v_.version_value() << leaf<P>::permuter_type::size_bits) + perm_.size();
@@ -86,6 +102,8 @@ class unlocked_tcursor {
     permuter_type perm_;
     leafvalue<P> lv_;
     const node_base<P>* root_;
+    finger* finger_;
+    const basic_table<P>* table_;
 };
 
 template <typename P>
@@ -106,19 +124,28 @@ class tcursor {
     typedef small_vector<std::pair<leaf_type*, nodeversion_value_type>, new_nodes_size> new_nodes_type;
 
     tcursor(basic_table<P>& table, Str str)
-        : ka_(str), root_(table.fix_root()) {
+        : ka_(str), root_(table.fix_root()),
+          merge_fill_(table.merge_fill_), finger_() {
+    }
+    // Start from, and then update, the leaf remembered by @a f.
+    tcursor(basic_table<P>& table, Str str, finger& f)
+        : ka_(str), root_(table.fix_root()),
+          merge_fill_(table.merge_fill_), finger_(&f), table_(&table) {
     }
     tcursor(basic_table<P>& table, const char* s, int len)
-        : ka_(s, len), root_(table.fix_root()) {
+        : ka_(s, len), root_(table.fix_root()),
+          merge_fill_(table.merge_fill_), finger_() {
     }
     tcursor(basic_table<P>& table, const unsigned char* s, int len)
-        : ka_(reinterpret_cast<const char*>(s), len), root_(table.fix_root()) {
+        : ka_(reinterpret_cast<const char*>(s), len), root_(table.fix_root()),
+          merge_fill_(table.merge_fill_), finger_() {
     }
     tcursor(node_base<P>* root, const char* s, int len)
-        : ka_(s, len), root_(root) {
+        : ka_(s, len), root_(root), merge_fill_(0), finger_() {
     }
     tcursor(node_base<P>* root, const unsigned char* s, int len)
-        : ka_(reinterpret_cast<const char*>(s), len), root_(root) {
+        : ka_(reinterpret_cast<const char*>(s), len), root_(root),
+          merge_fill_(0), finger_() {
     }
 
     inline bool has_value() const {
@@ -127,6 +154,18 @@ class tcursor {
     inline value_type& value() const {
         return n_->lv_[kx_.p].value();
     }
+    // Call before changing a found key's value through value(). Wide
+    // values can't be written atomically, so this marks the leaf and
+    // unlocked readers that copied a torn value retry.
+    inline void mark_value_update() const {
+        if (leafvalue<P>::wide_value)
+            n_->mark_insert();
+    }
+    // Replace the value of a found key in place.
+    inline void assign_value(value_type v) const {
+        mark_value_update();
+        n_->lv_[kx_.p].value() = v;
+    }
 
     inline bool is_first_layer() const {
         return !ka_.is_shifted();
@@ -166,6 +205,9 @@ class tcursor {
     key_indexed_position kx_;
     node_base<P>* root_;
     int state_;
+    int merge_fill_;
+    finger* finger_;
+    const basic_table<P>* table_;
 
     leaf_type* original_n_;
     nodeversion_value_type original_v_;
@@ -182,6 +224,10 @@ class tcursor {
     friend class leaf<P>;
     inline void finish_insert();
     inline bool finish_remove(threadinfo& ti);
+    bool coalesce(int size, threadinfo& ti);
+    template <typename F>
+    bool remove_range_leaf(char* key, int& keylen, Str lastkey, F& remover,
+                           uint64_t& count, threadinfo& ti);
 
     static void redirect(internode_type* n, ikey_type ikey,
                          ikey_type replacement, threadinfo& ti);
@@ -193,8 +239,11 @@ class tcursor {
     static bool remove_leaf(leaf_type* leaf, node_type* root,
                             Str prefix, threadinfo& ti);
 
+    bool merge_leaf(leaf_type* into, leaf_type* from, threadinfo& ti);
+
     bool gc_layer(threadinfo& ti);
     friend struct gc_layer_rcu_callback<P>;
+    friend class basic_table<P>;
 };
 
 template <typename P>
@@ -104,6 +104,24 @@ struct quick_istr {
     }
 };
 
+// integer keys for tables that store only ikeys: 8 big-endian bytes
+struct quick_bekey {
+    char buf_[8];
+    quick_bekey() {
+        set(0);
+    }
+    quick_bekey(unsigned long x) {
+        set(x);
+    }
+    void set(unsigned long x) {
+        uint64_t y = host_to_net_order(uint64_t(x));
+        memcpy(buf_, &y, sizeof(buf_));
+    }
+    lcdf::Str string() const {
+        return lcdf::Str(buf_, sizeof(buf_));
+    }
+};
+
 struct Clp_Parser;
 int clp_parse_suffixdouble(struct Clp_Parser *clp, const char *vstr,
                            int complain, void *user_data);
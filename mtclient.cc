@@ -98,6 +98,9 @@ void aget(struct child *c, long ikey, long iwanted, get_async_cb fn);
 void aget_col(struct child *c, const Str& key, int col, const Str& wanted,
               get_async_cb fn);
 int get(struct child *c, const Str &key, char *val, int max);
+bool get_row(struct child *c, const Str &key);
+// returns one row per key, in order: null if absent, else its columns
+Json multiget(struct child *c, const Str *keys, int n);
 
 void asyncgetcb(struct child *, struct async *a, bool, const Str &val);
 void asyncgetcb_int(struct child *, struct async *a, bool, const Str &val);
@@ -111,6 +114,16 @@ void asyncputcb(struct child *, struct async *a, int status);
 
 void aremove(struct child *c, const Str &key, remove_async_cb fn);
 bool remove(struct child *c, const Str &key);
+uint64_t remove_range(struct child *c, const Str &first, const Str &last);
+bool increment(struct child *c, const Str &key, int col, int64_t delta,
+               int64_t &value);
+// returns the column's new length, or -1 if the row can't hold it
+int append(struct child *c, const Str &key, int col, const Str &suffix);
+bool cas(struct child *c, const Str &key, int col, const Json &expected,
+         const Str &value, Json &current, uint64_t &ts);
+void scan_range(struct child *c, const Str &first, int n, const Json &options,
+                std::vector<Str> &keys, std::vector<Str> &values);
+Json stats(struct child *c);
 
 void udp1(struct child *);
 void w1b(struct child *);
@@ -128,6 +141,10 @@ void volt1b(struct child *);
 void volt2a(struct child *);
 void volt2b(struct child *);
 void scantest(struct child *);
+void rmrange_rec1(struct child *);
+void rmrange_rec2(struct child *);
+void stats1(struct child *);
+void ckptomb1(struct child *);
 
 static int children = 1;
 static uint64_t nkeys = 0;
@@ -193,6 +210,17 @@ struct kvtest_client {
     int prefixLen() const {
         return ::prefixLen;
     }
+    String row_type_name() const {
+        return c_->conn->row_type_name();
+    }
+    // leaves merged by the whole server; null if it doesn't count them.
+    // A server that counts always has allocations to report.
+    Json leaf_merges() const {
+        Json counters = ::stats(c_)["counters"];
+        if (!counters.is_o())
+            return Json();
+        return Json(counters["leaf_merge"].as_u(0));
+    }
     Json param(const String& name, Json default_value = Json()) {
         return test_param.count(name) ? test_param.at(name) : default_value;
     }
@@ -216,6 +244,12 @@ struct kvtest_client {
         quick_istr key(ikey);
         return ::get(c_, key.string(), got, sizeof(got)) >= 0;
     }
+    bool get_row_sync(Str key) {
+        return ::get_row(c_, key);
+    }
+    Json multiget_sync(const Str* keys, int n) {
+        return ::multiget(c_, keys, n);
+    }
     void get_check(long ikey, long iexpected) {
         aget(c_, ikey, iexpected, 0);
     }
@@ -233,8 +267,10 @@ struct kvtest_client {
         quick_istr key(ikey, 10), expected(iexpected);
         aget(c_, key.string(), expected.string(), 0);
     }
-    void many_get_check(int, long [], long []) {
-        assert(0);
+    void many_get_check(int nk, long ikey[], long iexpected[]) {
+        // the server interleaves requests that arrive together
+        for (int i = 0; i != nk; ++i)
+            aget(c_, ikey[i], iexpected[i], 0);
     }
     void get_col_check(const Str &key, int col, const Str &value) {
         aget_col(c_, key, col, value, 0);
@@ -247,6 +283,13 @@ struct kvtest_client {
         quick_istr key(ikey, 10), value(ivalue);
         get_col_check(key.string(), col, value.string());
     }
+    void get_check_absent(const Str &key) {
+        // a get reply can't tell a missing key from a value equal to it
+        if (::get_row(c_, key)) {
+            fprintf(stderr, "key %.*s, expected absent\n", key.len, key.s);
+            always_assert(0);
+        }
+    }
     void get_check_sync(long ikey, long iexpected) {
         char key[512], val[512], got[512];
         sprintf(key, "%010ld", ikey);
@@ -313,6 +356,23 @@ struct kvtest_client {
         quick_istr key(ikey);
         return ::remove(c_, key.string());
     }
+    uint64_t remove_range_sync(Str first, Str last) {
+        return ::remove_range(c_, first, last);
+    }
+    bool increment_sync(Str key, int col, int64_t delta, int64_t& value) {
+        return ::increment(c_, key, col, delta, value);
+    }
+    int append_sync(Str key, int col, Str suffix) {
+        return ::append(c_, key, col, suffix);
+    }
+    bool cas_sync(Str key, int col, const Json& expected, Str value,
+                  Json& current, uint64_t& ts) {
+        return ::cas(c_, key, col, expected, value, current, ts);
+    }
+    void scan_range_sync(Str first, int n, const Json& options,
+                         std::vector<Str>& keys, std::vector<Str>& values) {
+        ::scan_range(c_, first, n, options, keys, values);
+    }
 
     int ruscale_partsz() const {
         return ::rscale_partsz;
@@ -387,6 +447,7 @@ MAKE_TESTRUNNER(rw4, kvtest_rw4(client));
 MAKE_TESTRUNNER(rw1fixed, kvtest_rw1fixed(client));
 MAKE_TESTRUNNER(rw16, kvtest_rw16(client));
 MAKE_TESTRUNNER(sync_rw1, kvtest_sync_rw1(client));
+MAKE_TESTRUNNER(lat1, kvtest_lat1(client));
 MAKE_TESTRUNNER(r1, kvtest_r1_seed(client, kvtest_first_seed + client.id()));
 MAKE_TESTRUNNER(w1, kvtest_w1_seed(client, kvtest_first_seed + client.id()));
 MAKE_TESTRUNNER(w1b, w1b(client.child()));
@@ -399,6 +460,18 @@ MAKE_TESTRUNNER(wd1m1check, kvtest_wd1_check(100000000, 1, client));
 MAKE_TESTRUNNER(wd1m2check, kvtest_wd1_check(1000000000, 4, client));
 MAKE_TESTRUNNER(wd2, kvtest_wd2(client));
 MAKE_TESTRUNNER(wd2check, kvtest_wd2_check(client));
+MAKE_TESTRUNNER(rmrange1, kvtest_rmrange1(client));
+MAKE_TESTRUNNER(rmw1, kvtest_rmw1(client));
+MAKE_TESTRUNNER(vlen1, kvtest_vlen1(client));
+MAKE_TESTRUNNER(scanrange1, kvtest_scanrange1(client));
+MAKE_TESTRUNNER(multiget1, kvtest_multiget1(client));
+MAKE_TESTRUNNER(merge1, kvtest_merge1(client));
+MAKE_TESTRUNNER(ycsba, kvtest_ycsb(client, 'a'));
+MAKE_TESTRUNNER(ycsbb, kvtest_ycsb(client, 'b'));
+MAKE_TESTRUNNER(ycsbc, kvtest_ycsb(client, 'c'));
+MAKE_TESTRUNNER(ycsbd, kvtest_ycsb(client, 'd'));
+MAKE_TESTRUNNER(ycsbe, kvtest_ycsb(client, 'e'));
+MAKE_TESTRUNNER(ycsbf, kvtest_ycsb(client, 'f'));
 MAKE_TESTRUNNER(tri1, kvtest_tri1(10000000, 1, client));
 MAKE_TESTRUNNER(tri1check, kvtest_tri1_check(10000000, 1, client));
 MAKE_TESTRUNNER(same, kvtest_same(client));
@@ -421,6 +494,10 @@ MAKE_TESTRUNNER(volt1b, volt1b(client.child()));
 MAKE_TESTRUNNER(volt2a, volt2a(client.child()));
 MAKE_TESTRUNNER(volt2b, volt2b(client.child()));
 MAKE_TESTRUNNER(scantest, scantest(client.child()));
+MAKE_TESTRUNNER(rmrange_rec1, rmrange_rec1(client.child()));
+MAKE_TESTRUNNER(rmrange_rec2, rmrange_rec2(client.child()));
+MAKE_TESTRUNNER(stats1, stats1(client.child()));
+MAKE_TESTRUNNER(ckptomb1, ckptomb1(client.child()));
 MAKE_TESTRUNNER(wscale, kvtest_wscale(client));
 MAKE_TESTRUNNER(ruscale_init, kvtest_ruscale_init(client));
 MAKE_TESTRUNNER(rscale, kvtest_rscale(client));
@@ -719,6 +796,10 @@ run_child(testrunner* test, int childno)
   if(udpflag){
     c.udp = 1;
     c.s = socket(AF_INET, SOCK_DGRAM, 0);
+    // room for a full window of replies, which udp servers may send in
+    // bursts
+    int sobuflen = 512*1024;
+    setsockopt(c.s, SOL_SOCKET, SO_RCVBUF, &sobuflen, sizeof(sobuflen));
   } else {
     c.s = socket(AF_INET, SOCK_STREAM, 0);
   }
@@ -810,6 +891,32 @@ get(struct child *c, const Str &key, char *val, int max)
     return result[2].as_s().length();
 }
 
+// fetch key's whole row; return false if it is absent
+bool
+get_row(struct child *c, const Str &key)
+{
+    return !multiget(c, &key, 1)[0].is_null();
+}
+
+Json
+multiget(struct child *c, const Str *keys, int n)
+{
+    always_assert(c->seq0_ == c->seq1_);
+
+    unsigned sseq = c->seq1_;
+    c->conn->sendmultiget(keys, n, sseq);
+    c->conn->flush();
+
+    const Json& result = c->conn->receive();
+    always_assert(result && result[0] == sseq && result[2].is_a()
+                  && result[2].size() == n);
+    ++c->seq0_;
+    ++c->seq1_;
+    ++c->nsent_;
+    // the reply's strings point into the connection's buffer
+    return Json::parse(result[2].unparse());
+}
+
 // builtin aget callback: no check
 void
 nocheck(struct child *, struct async *, bool, const Str &)
@@ -1088,6 +1195,130 @@ bool remove(struct child *c, const Str &key)
     return result[2].to_b();
 }
 
+uint64_t remove_range(struct child *c, const Str &first, const Str &last)
+{
+    always_assert(c->seq0_ == c->seq1_);
+
+    unsigned int sseq = c->seq1_;
+    c->conn->sendremoverange(first, last, sseq);
+    c->conn->flush();
+
+    const Json& result = c->conn->receive();
+    always_assert(result && result[0] == sseq);
+
+    ++c->seq0_;
+    ++c->seq1_;
+    ++c->nsent_;
+    return result[2].to_u64();
+}
+
+bool increment(struct child *c, const Str &key, int col, int64_t delta,
+               int64_t &value)
+{
+    always_assert(c->seq0_ == c->seq1_);
+
+    unsigned int sseq = c->seq1_;
+    c->conn->sendincrement(key, col, delta, sseq);
+    c->conn->flush();
+
+    const Json& result = c->conn->receive();
+    always_assert(result && result[0] == sseq);
+
+    ++c->seq0_;
+    ++c->seq1_;
+    ++c->nsent_;
+    value = result[2].as_i(0);
+    return !result[2].is_null();
+}
+
+int append(struct child *c, const Str &key, int col, const Str &suffix)
+{
+    always_assert(c->seq0_ == c->seq1_);
+
+    unsigned int sseq = c->seq1_;
+    c->conn->sendappend(key, col, suffix, sseq);
+    c->conn->flush();
+
+    const Json& result = c->conn->receive();
+    always_assert(result && result[0] == sseq);
+
+    ++c->seq0_;
+    ++c->seq1_;
+    ++c->nsent_;
+    return result[2].as_i(-1);
+}
+
+bool cas(struct child *c, const Str &key, int col, const Json &expected,
+         const Str &value, Json &current, uint64_t &ts)
+{
+    always_assert(c->seq0_ == c->seq1_);
+
+    unsigned int sseq = c->seq1_;
+    c->conn->sendcas(key, col, expected, value, sseq);
+    c->conn->flush();
+
+    const Json& result = c->conn->receive();
+    always_assert(result && result[0] == sseq && result.size() == 5);
+
+    ++c->seq0_;
+    ++c->seq1_;
+    ++c->nsent_;
+    // copy: the reply's strings point into the connection's buffer
+    Str cur = result[3].as_s();
+    current = result[3].is_s() ? Json(String(cur.data(), cur.length())) : Json();
+    ts = result[4].to_u64();
+    return result[2].to_b();
+}
+
+// keys and values point into the connection's buffer and are valid
+// until the next request.
+void scan_range(struct child *c, const Str &first, int n, const Json &options,
+                std::vector<Str> &keys, std::vector<Str> &values)
+{
+    always_assert(c->seq0_ == c->seq1_);
+
+    unsigned int sseq = c->seq1_;
+    c->conn->sendscanrange(first, n, options, sseq);
+    c->conn->flush();
+
+    const Json& result = c->conn->receive();
+    always_assert(result && result[0] == sseq);
+
+    ++c->seq0_;
+    ++c->seq1_;
+    ++c->nsent_;
+    keys.clear();
+    values.clear();
+    int step = options["keys"] ? 1 : 2;
+    for (int i = 2; i + step <= result.size(); i += step) {
+        keys.push_back(result[i].as_s());
+        // rows with several columns report the first
+        if (step == 2)
+            values.push_back(result[i + 1].is_s() ? result[i + 1].as_s()
+                             : result[i + 1][0].as_s());
+    }
+}
+
+// The reply's strings point into the connection's buffer and are valid
+// until the next request.
+Json stats(struct child *c)
+{
+    always_assert(c->seq0_ == c->seq1_);
+
+    unsigned int sseq = c->seq1_;
+    c->conn->sendstats(sseq);
+    c->conn->flush();
+
+    const Json& result = c->conn->receive();
+    always_assert(result && result[0] == sseq
+                  && result[1] == Cmd_Stats + 1 && result[2].is_o());
+
+    ++c->seq0_;
+    ++c->seq1_;
+    ++c->nsent_;
+    return result[2];
+}
+
 void
 aremove(struct child *c, const Str &key, remove_async_cb fn)
 {
@@ -1722,3 +1953,132 @@ scantest(struct child *c)
   fprintf(stderr, "scantest OK\n");
   printf("0\n");
 }
+
+// check that a stats reply reports the requests we just made
+void
+stats1(struct child *c)
+{
+  for (int i = 0; i < 100; i++) {
+    char key[32], val[32];
+    int kl = sprintf(key, "stats1-%d-%03d", c->childno, i);
+    sprintf(val, "%d", i);
+    aput(c, Str(key, kl), Str(val));
+  }
+  checkasync(c, 2);
+
+  char key[32], val[32];
+  sprintf(key, "stats1-%d-000", c->childno);
+  int ret = get(c, key, val, sizeof(val));
+  always_assert(ret == 1 && val[0] == '0');
+
+  Json j = stats(c);
+  fprintf(stderr, "%s\n", j.unparse(Json::indent_depth(1)).c_str());
+  always_assert(j["latency_ns"].is_o());
+  // aput() sends replace requests
+  always_assert(j["latency_ns"]["replace"]["n"].as_u() >= 100);
+  always_assert(j["latency_ns"]["get"]["n"].as_u() >= 1);
+  always_assert(j["latency_ns"]["get"]["p50"].is_number());
+  always_assert(j["limbo"]["used"].is_number()
+                && j["limbo"]["allocated"].is_number());
+  always_assert(!c->udp || j["udp"]["requests"].as_u() >= 101);
+  always_assert(!j.count("log") || j["log"].is_o());
+
+  fprintf(stderr, "stats1 OK\n");
+  printf("0\n");
+}
+
+// check that removed keys kept for the next delta checkpoint are freed
+// once a checkpoint is taken. Run as one child against a server that
+// takes delta checkpoints, such as mtd --checkpoint=3600, so none starts
+// on its own.
+void
+ckptomb1(struct child *c)
+{
+  always_assert(c->childno == 0);
+  enum { n = 1000 };
+  for (int i = 0; i < n; i++) {
+    char key[32];
+    int kl = sprintf(key, "ckptomb1-%04d", i);
+    aput(c, Str(key, kl), Str(key, kl));
+  }
+  checkasync(c, 2);
+  for (int i = 0; i < n; i++) {
+    char key[32];
+    int kl = sprintf(key, "ckptomb1-%04d", i);
+    always_assert(remove(c, Str(key, kl)));
+  }
+
+  // --ckp-max-tombstones may stop tracking early
+  uint64_t before = stats(c)["ckp_tombstones"].as_u(0);
+  fprintf(stderr, "%" PRIu64 " tombstones\n", before);
+  always_assert(before > 0 && before <= n);
+
+  c->conn->checkpoint(c->childno);
+  uint64_t after = before;
+  for (int i = 0; i < 100 && after; i++) {
+    usleep(100000);
+    after = stats(c)["ckp_tombstones"].as_u(n + 1);
+  }
+  always_assert(after == 0);
+
+  // tracking resumes after the checkpoint
+  for (int i = 0; i < 10; i++) {
+    char key[32];
+    int kl = sprintf(key, "ckptomb1-%04d", i);
+    aput(c, Str(key, kl), Str(key, kl));
+    checkasync(c, 2);
+    always_assert(remove(c, Str(key, kl)));
+  }
+  always_assert(stats(c)["ckp_tombstones"].as_u(0) == 10);
+
+  fprintf(stderr, "ckptomb1 OK\n");
+  printf("0\n");
+}
+
+// remove ranges with an empty first key and an empty last key, which
+// reach the ends of the tree. rmrange_rec2() checks that a restart
+// (after a crash, once the log is flushed) replays both removals.
+// Both run as one child on an otherwise empty server.
+void
+rmrange_rec1(struct child *c)
+{
+  always_assert(c->childno == 0);
+  for (int i = 0; i < 10; i++) {
+    char key[32];
+    int kl = sprintf(key, "a%d", i);
+    aput(c, Str(key, kl), Str(key, kl));
+    kl = sprintf(key, "z%d", i);
+    aput(c, Str(key, kl), Str(key, kl));
+  }
+  checkasync(c, 2);
+
+  uint64_t n1 = remove_range(c, "", "a5");
+  uint64_t n2 = remove_range(c, "z5", "");
+  always_assert(n1 == 5 && n2 == 5);
+
+  fprintf(stderr, "rmrange_rec1 OK\n");
+  printf("0\n");
+}
+
+void
+rmrange_rec2(struct child *c)
+{
+  always_assert(c->childno == 0);
+  for (int i = 0; i < 10; i++)
+    for (char prefix : {'a', 'z'}) {
+      char key[32], val[32];
+      int kl = sprintf(key, "%c%d", prefix, i);
+      bool removed = prefix == 'a' ? i < 5 : i >= 5;
+      if (get_row(c, Str(key, kl)) == removed) {
+        fprintf(stderr, "key %s %s\n", key, removed ? "present" : "absent");
+        always_assert(0);
+      }
+      if (!removed) {
+        int ret = get(c, Str(key, kl), val, sizeof(val));
+        always_assert(ret == kl && memcmp(key, val, kl) == 0);
+      }
+    }
+
+  fprintf(stderr, "rmrange_rec2 OK\n");
+  printf("0\n");
+}
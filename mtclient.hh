@@ -97,6 +97,24 @@ class KVConn {
         send();
     }
 
+    // The reply's third element is an array with one entry per key: null
+    // if the key is missing, or an array of the requested fields.
+    void sendmultiget(const Str* keys, int n, unsigned seq) {
+        sendmultiget(keys, n, std::vector<unsigned>(), seq);
+    }
+    void sendmultiget(const Str* keys, int n,
+                      const std::vector<unsigned>& f, unsigned seq) {
+        j_.resize(3 + f.size());
+        j_[0] = seq;
+        j_[1] = Cmd_MultiGet;
+        j_[2] = Json::make_array_reserve(n);
+        for (int i = 0; i != n; ++i)
+            j_[2].push_back(String::make_stable(keys[i]));
+        for (size_t i = 0; i != f.size(); ++i)
+            j_[3 + i] = f[i];
+        send();
+    }
+
     void sendputcol(Str key, int col, Str val, unsigned seq) {
         j_.resize(5);
         j_[0] = seq;
@@ -122,6 +140,56 @@ class KVConn {
         send();
     }
 
+    // remove [first, last); an empty last means no end. The reply's third
+    // element is the number of keys removed.
+    void sendremoverange(Str first, Str last, unsigned seq) {
+        j_.resize(4);
+        j_[0] = seq;
+        j_[1] = Cmd_RemoveRange;
+        j_[2] = String::make_stable(first);
+        j_[3] = String::make_stable(last);
+        send();
+    }
+
+    // add delta to a column holding a decimal integer. The reply's third
+    // element is the new value, or null if the column isn't an integer
+    // or the row can't hold the new value.
+    void sendincrement(Str key, int col, int64_t delta, unsigned seq) {
+        j_.resize(5);
+        j_[0] = seq;
+        j_[1] = Cmd_Increment;
+        j_[2] = String::make_stable(key);
+        j_[3] = col;
+        j_[4] = delta;
+        send();
+    }
+    // The reply's third element is the column's new length, or null if
+    // the row can't hold it.
+    void sendappend(Str key, int col, Str suffix, unsigned seq) {
+        j_.resize(5);
+        j_[0] = seq;
+        j_[1] = Cmd_Append;
+        j_[2] = String::make_stable(key);
+        j_[3] = col;
+        j_[4] = String::make_stable(suffix);
+        send();
+    }
+    // set a column to val if expected matches: a string matches the
+    // column's value, an integer the row's timestamp, and null a missing
+    // key. The reply is [seq, cmd, ok, current column value, timestamp];
+    // ok is null if the row can't hold val.
+    void sendcas(Str key, int col, const Json& expected, Str val,
+                 unsigned seq) {
+        j_.resize(6);
+        j_[0] = seq;
+        j_[1] = Cmd_CompareAndSwap;
+        j_[2] = String::make_stable(key);
+        j_[3] = col;
+        j_[4] = expected;
+        j_[5] = String::make_stable(val);
+        send();
+    }
+
     void sendscanwhole(Str firstkey, int numpairs, unsigned seq) {
         j_.resize(4);
         j_[0] = seq;
@@ -141,6 +209,29 @@ class KVConn {
         send();
     }
 
+    // scan up to numpairs pairs. options is an object that may set "end"
+    // (an exclusive end key), "keys" (return only keys), "reverse", and
+    // "max_bytes" (stop once the reply holds that many bytes). The reply
+    // is [seq, cmd, key, value, ...], or [seq, cmd, key, ...] for "keys".
+    void sendscanrange(Str firstkey, int numpairs, const Json& options,
+                       unsigned seq) {
+        j_.resize(5);
+        j_[0] = seq;
+        j_[1] = Cmd_Scan;
+        j_[2] = String::make_stable(firstkey);
+        j_[3] = numpairs;
+        j_[4] = options;
+        send();
+    }
+
+    // The reply is [seq, cmd, stats object]; see mtd's server_stats().
+    void sendstats(unsigned seq) {
+        j_.resize(2);
+        j_[0] = seq;
+        j_[1] = Cmd_Stats;
+        send();
+    }
+
     void checkpoint(int childno) {
 	always_assert(childno == 0);
         fprintf(stderr, "asking for a checkpoint\n");
@@ -157,6 +248,10 @@ class KVConn {
     void flush() {
         kvflush(out_);
     }
+    // the server's row type name, from the tcp handshake
+    const String& row_type_name() const {
+        return row_type_;
+    }
 
     int check(int tryhard) {
         if (inbufpos_ == inbuflen_ && tryhard)
@@ -191,6 +286,7 @@ class KVConn {
 
     int fdtoclose_;
     int partition_;
+    String row_type_;
 
     void handshake(int target_core) {
         j_.resize(3);
@@ -209,6 +305,9 @@ class KVConn {
             exit(EXIT_FAILURE);
         }
         partition_ = result[3].as_i();
+        // copy: the reply's strings point into inbuf_
+        Str row_type = result[4].as_s("");
+        row_type_ = String(row_type.data(), row_type.length());
     }
     inline void send() {
         msgpack::unparse(*out_, j_);
@@ -51,6 +51,10 @@ enum threadcounter {
     tc_stable_leaf_insert = tc_stable + 2,
     tc_stable_leaf_split = tc_stable + 3,
     // end tc_stable constants
+    tc_leaf_merge,
+    tc_leaf_merge_skip,
+    tc_finger_hit,
+    tc_finger_miss,
     tc_internode_lock,
     tc_leaf_lock,
     tc_max
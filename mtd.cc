@@ -53,6 +53,7 @@
 #include "clp.h"
 #include "log.hh"
 #include "checkpoint.hh"
+#include "iouring.hh"
 #include "file.hh"
 #include "kvproto.hh"
 #include "query_masstree.hh"
@@ -60,9 +61,11 @@
 #include "masstree_insert.hh"
 #include "masstree_remove.hh"
 #include "masstree_scan.hh"
+#include "masstree_bulkload.hh"
 #include "msgpack.hh"
 #include <algorithm>
 #include <deque>
+#include <map>
 using lcdf::StringAccum;
 
 enum { CKState_Quit, CKState_Uninit, CKState_Ready, CKState_Go };
@@ -70,7 +73,7 @@ enum { CKState_Quit, CKState_Uninit, CKState_Ready, CKState_Go };
 volatile bool timeout[2] = {false, false};
 double duration[2] = {10, 0};
 
-Masstree::default_table *tree;
+Masstree::server_table *tree;
 
 // all default to the number of cores
 static int udpthreads = 0;
@@ -88,6 +91,14 @@ volatile uint64_t active_epoch = 1;
 static int port = 2117;
 static uint64_t test_limit = ~uint64_t(0);
 static int doprint = 0;
+static int interleave = 1;  // requests per batch of interleaved traversals
+static int merge_fill = 0;  // merge leaves left this empty by a remove
+static bool tcp_fast_path = true; // decode simple tcp requests in place
+static bool tcp_reuseport = false; // each tcp thread accepts on its own socket
+enum { max_udp_batch = 64 };
+static int udp_batch = 32;  // datagrams received per call
+static double busy_poll_usec = 0; // tcp threads spin this long before sleeping
+static int socket_busy_poll = 0;  // SO_BUSY_POLL usec for client sockets
 int kvtest_first_seed = 31949;
 
 static volatile sig_atomic_t go_quit = 0;
@@ -102,6 +113,45 @@ volatile bool recovering = false; // so don't add log entries, and free old valu
 static double checkpoint_interval = 1000000;
 static kvepoch_t ckp_gen = 0; // recover from checkpoint
 static ckstate *cks = NULL; // checkpoint status of all checkpointing threads
+typedef Masstree::bulk_loader<Masstree::server_table::parameters_type> ckp_loader;
+struct ckp_partition { // one checkpoint file during recovery
+    char *map;
+    size_t mapsize;
+    std::vector<ckp_loader::entry> entries;
+    ckp_loader loader;
+};
+static ckp_partition *rec_ckp_parts;
+static size_t ckp_chunk_size = 8 << 20; // bytes buffered per checkpoint write
+static bool ckp_direct = false;
+static int ckp_full_every = 8; // write a full checkpoint every N generations
+static int ckp_max_deltas = 4; // merge deltas rather than keep more than N
+// longest checkpoint interval that takes delta checkpoints; beyond it,
+// keeping every removed key until the next checkpoint costs too much
+static const double ckp_delta_max_interval = 3600;
+static bool ckp_deltas = false; // some checkpoints are deltas
+static Json ckp_manifest; // contents of the last committed kvd-ckp-gen
+static std::vector<uint64_t> ckp_merge_gens; // deltas merged into this one
+static kvepoch_t rec_ckp_base; // full checkpoint to recover from
+static std::vector<uint64_t> rec_ckp_deltas; // then these deltas
+static int rec_ckp_nfiles;
+
+// Keys removed since the last checkpoint, written as tombstones in the
+// next delta checkpoint. Each thread appends to its own list. Past
+// ckp_max_tombstones keys tracking stops, and the next checkpoint is full.
+typedef std::pair<String, kvtimestamp_t> ckp_tombstone;
+struct ckp_tombstone_list {
+    pthread_mutex_t mu;
+    std::vector<ckp_tombstone> removed;
+};
+static volatile bool ckp_track_removes = false;
+static volatile bool ckp_tombstones_dropped = false;
+static uint64_t ckp_ntombstones = 0; // in all lists
+static uint64_t ckp_max_tombstones = 1 << 20;
+static pthread_mutex_t ckp_tombstone_mu = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<ckp_tombstone_list*> ckp_tombstone_lists;
+static __thread ckp_tombstone_list* my_ckp_tombstones;
+static std::vector<ckp_tombstone> ckp_tombstones; // for the current delta
+static double sync_commit_timeout = -1; // default durability wait; <0: none
 static pthread_cond_t rec_cond;
 pthread_mutex_t rec_mu;
 static int rec_nactive;
@@ -114,12 +164,44 @@ static pthread_mutex_t checkpoint_mu;
 
 static void prepare_thread(threadinfo *ti);
 static int* tcp_thread_pipes;
+static int* tcp_listen_fds;     // per-thread listeners, if tcp_reuseport
+
+// per-udp-thread statistics, reported at exit and by Cmd_Stats
+struct udp_stats {
+    uint64_t requests;
+    uint64_t failed;
+    uint64_t send_calls;
+    kvhistogram batch_size;     // datagrams per receive
+    udp_stats()
+        : requests(0), failed(0), send_calls(0) {
+    }
+};
+static udp_stats* udp_thread_stats;
+static const char* threadcounter_names[(int) tc_max];
+
+static void udp_json_stats(Json& j) {
+    udp_stats total;
+    for (int i = 0; i != udpthreads; ++i) {
+        total.requests += udp_thread_stats[i].requests;
+        total.failed += udp_thread_stats[i].failed;
+        total.send_calls += udp_thread_stats[i].send_calls;
+        total.batch_size.merge_relaxed(udp_thread_stats[i].batch_size);
+    }
+    j.set("udp", Json().set("requests", total.requests)
+          .set("failed", total.failed)
+          .set("send_calls", total.send_calls)
+          .set("batch_size", total.batch_size.unparse_json()));
+}
+
 static void* tcp_threadfunc(void* ti);
+static int tcp_listen(bool reuseport, int cpu);
+static void set_socket_busy_poll(int s);
 static void* udp_threadfunc(void* ti);
 
 static void log_init();
 static void recover(threadinfo*);
-static kvepoch_t read_checkpoint(threadinfo*, const char *path);
+static kvepoch_t read_checkpoint(threadinfo*, const char *path,
+                                 ckp_partition &part);
 
 static void* conc_checkpointer(void* ti);
 static void recovercheckpoint(threadinfo* ti);
@@ -141,6 +223,10 @@ void test_timeout(int) {
 }
 
 struct kvtest_client {
+    // integer-key tables store long keys as big-endian bytes
+    typedef std::conditional<Masstree::server_table::parameters_type::ikey_only,
+                             quick_bekey, quick_istr>::type ikey_string;
+
     kvtest_client()
         : checks_(0), kvo_() {
     }
@@ -169,8 +255,8 @@ struct kvtest_client {
     uint64_t limit() const {
         return test_limit;
     }
-    Json param(const String&) const {
-        return Json();
+    Json param(const String&, Json default_value = Json()) const {
+        return default_value;
     }
     double now() const {
         return ::now();
@@ -179,7 +265,7 @@ struct kvtest_client {
     void get(long ikey, Str *value);
     void get(const Str &key);
     void get(long ikey) {
-        quick_istr key(ikey);
+        ikey_string key(ikey);
         get(key.string());
     }
     void get_check(const Str &key, const Str &expected);
@@ -187,7 +273,8 @@ struct kvtest_client {
         get_check(Str(key, strlen(key)), Str(expected, strlen(expected)));
     }
     void get_check(long ikey, long iexpected) {
-        quick_istr key(ikey), expected(iexpected);
+        ikey_string key(ikey);
+        quick_istr expected(iexpected);
         get_check(key.string(), expected.string());
     }
     void get_check_key8(long ikey, long iexpected) {
@@ -198,6 +285,7 @@ struct kvtest_client {
         quick_istr key(ikey, 10), expected(iexpected);
         get_check(key.string(), expected.string());
     }
+    void many_get_check(int nk, long ikey[], long iexpected[]);
     void get_col_check(const Str &key, int col, const Str &expected);
     void get_col_check_key10(long ikey, int col, long iexpected) {
         quick_istr key(ikey, 10), expected(iexpected);
@@ -210,7 +298,8 @@ struct kvtest_client {
         put(Str(key, strlen(key)), Str(val, strlen(val)));
     }
     void put(long ikey, long ivalue) {
-        quick_istr key(ikey), value(ivalue);
+        ikey_string key(ikey);
+        quick_istr value(ivalue);
         put(key.string(), value.string());
     }
     void put_key8(long ikey, long ivalue) {
@@ -258,7 +347,7 @@ volatile int kvtest_client::failing;
 
 void kvtest_client::get(long ikey, Str *value)
 {
-    quick_istr key(ikey);
+    ikey_string key(ikey);
     if (!q_[0].run_get1(tree->table(), key.string(), 0, *value, *ti_))
         *value = Str();
 }
@@ -283,6 +372,24 @@ void kvtest_client::get_check(const Str &key, const Str &expected)
         ++checks_;
 }
 
+// check a batch of gets, interleaving their tree traversals
+void kvtest_client::many_get_check(int nk, long ikey[], long iexpected[])
+{
+    enum { max_batch = 64 };
+    always_assert(nk <= max_batch);
+    ikey_string ka[max_batch];
+    Str keys[max_batch];
+    for (int i = 0; i < nk; ++i) {
+        ka[i].set(ikey[i]);
+        keys[i] = ka[i].string();
+    }
+    tree->table().prefetch_paths(keys, nk, *ti_);
+    for (int i = 0; i < nk; ++i) {
+        quick_istr expected(iexpected[i]);
+        get_check(keys[i], expected.string());
+    }
+}
+
 void kvtest_client::get_col_check(const Str &key, int col, const Str &expected)
 {
     Str val;
@@ -300,7 +407,7 @@ void kvtest_client::get_col_check(const Str &key, int col, const Str &expected)
 }
 
 bool kvtest_client::get_sync(long ikey) {
-    quick_istr key(ikey);
+    ikey_string key(ikey);
     Str val;
     return q_[0].run_get1(tree->table(), key.string(), 0, val, *ti_);
 }
@@ -308,22 +415,21 @@ bool kvtest_client::get_sync(long ikey) {
 void kvtest_client::put(const Str &key, const Str &value) {
     while (failing)
         /* do nothing */;
+    if (!tree->table().key_fits(key))
+        fail("key too long for %s\n", tree->name());
     q_[0].run_replace(tree->table(), key, value, *ti_);
-    if (ti_->logger()) // NB may block
-        ti_->logger()->record(logcmd_replace, q_[0].query_times(), key, value);
 }
 
 void kvtest_client::put_col(const Str &key, int col, const Str &value) {
     while (failing)
         /* do nothing */;
+    if (!tree->table().key_fits(key))
+        fail("key too long for %s\n", tree->name());
 #if !MASSTREE_ROW_TYPE_STR
     if (!kvo_)
         kvo_ = new_kvout(-1, 2048);
     Json req[2] = {Json(col), Json(String::make_stable(value))};
     (void) q_[0].run_put(tree->table(), key, &req[0], &req[2], *ti_);
-    if (ti_->logger()) // NB may block
-        ti_->logger()->record(logcmd_put, q_[0].query_times(), key,
-                              &req[0], &req[2]);
 #else
     (void) key, (void) col, (void) value;
     assert(0);
@@ -331,11 +437,8 @@ void kvtest_client::put_col(const Str &key, int col, const Str &value) {
 }
 
 bool kvtest_client::remove_sync(long ikey) {
-    quick_istr key(ikey);
-    bool removed = q_[0].run_remove(tree->table(), key.string(), *ti_);
-    if (removed && ti_->logger()) // NB may block
-        ti_->logger()->record(logcmd_remove, q_[0].query_times(), key.string(), Str());
-    return removed;
+    ikey_string key(ikey);
+    return q_[0].run_remove(tree->table(), key.string(), *ti_);
 }
 
 String kvtest_client::make_message(StringAccum &sa) const {
@@ -462,12 +565,127 @@ void runtest(const char *testname, int nthreads) {
 }
 
 
+// A simple tcp request decoded in place: [seq, Cmd_Get, key, field...],
+// [seq, Cmd_Replace, key, value], or [seq, Cmd_Remove, key]. key and
+// value point into the connection's input buffer.
+struct fast_request {
+    enum { max_fields = 8 };
+    unsigned seq;
+    int command;
+    Str key;
+    Str value;
+    int nfields;
+    int fields[max_fields];
+};
+
+// Bounds-checked reader for the few msgpack formats fast requests use.
+class fast_request_reader {
+  public:
+    fast_request_reader(const char* first, const char* last)
+        : s_(reinterpret_cast<const uint8_t*>(first)),
+          end_(reinterpret_cast<const uint8_t*>(last)) {
+    }
+    const char* position() const {
+        return reinterpret_cast<const char*>(s_);
+    }
+    bool read_array_header(unsigned& size) {
+        if (s_ == end_ || !msgpack::format::is_fixarray(*s_))
+            return false;
+        size = *s_++ - msgpack::format::ffixarray;
+        return true;
+    }
+    bool read_unsigned(unsigned& x) {
+        using namespace msgpack::format;
+        if (s_ == end_)
+            return false;
+        else if (*s_ < nfixuint) {
+            x = *s_++;
+            return true;
+        } else if (*s_ == fuint8 && end_ - s_ >= 2) {
+            x = s_[1];
+            s_ += 2;
+            return true;
+        } else if (*s_ == fuint16 && end_ - s_ >= 3) {
+            x = read_in_net_order<uint16_t>(s_ + 1);
+            s_ += 3;
+            return true;
+        } else if (*s_ == fuint32 && end_ - s_ >= 5) {
+            x = read_in_net_order<uint32_t>(s_ + 1);
+            s_ += 5;
+            return true;
+        } else
+            return false;
+    }
+    bool read_string(Str& x) {
+        using namespace msgpack::format;
+        size_t hlen, len;
+        if (s_ == end_)
+            return false;
+        else if (is_fixstr(*s_)) {
+            hlen = 1;
+            len = *s_ - ffixstr;
+        } else if (*s_ == fstr8 && end_ - s_ >= 2) {
+            hlen = 2;
+            len = s_[1];
+        } else if (*s_ == fstr16 && end_ - s_ >= 3) {
+            hlen = 3;
+            len = read_in_net_order<uint16_t>(s_ + 1);
+        } else
+            return false;
+        if (size_t(end_ - s_) < hlen + len)
+            return false;
+        x.assign(reinterpret_cast<const char*>(s_ + hlen), len);
+        s_ += hlen + len;
+        return true;
+    }
+  private:
+    const uint8_t* s_;
+    const uint8_t* end_;
+};
+
+// Decode a fast request from [first, last). Returns its length, or 0 if
+// the data holds something else or only part of a request.
+static int decode_fast_request(const char* first, const char* last,
+                               fast_request& fr) {
+    fast_request_reader r(first, last);
+    unsigned size, command;
+    if (!r.read_array_header(size) || size < 3
+        || !r.read_unsigned(fr.seq) || !r.read_unsigned(command)
+        || !r.read_string(fr.key))
+        return 0;
+    fr.command = command;
+    fr.nfields = 0;
+    if (command == Cmd_Get && size - 3 <= fast_request::max_fields) {
+        for (unsigned i = 3; i != size; ++i) {
+            unsigned f;
+            if (!r.read_unsigned(f) || f > 255)
+                return 0;
+            fr.fields[fr.nfields++] = f;
+        }
+    } else if (command == Cmd_Replace && size == 4) {
+        if (!r.read_string(fr.value))
+            return 0;
+    } else if (command != Cmd_Remove || size != 3)
+        return 0;
+    return r.position() - first;
+}
+
 struct conn {
     int fd;
     enum { inbufsz = 20 * 1024, inbufrefill = 16 * 1024 };
+    // Responses to writes are held until the log is durable through
+    // durable_lsn, or durable_timeout seconds pass (<0: don't wait,
+    // 0: wait forever).
+    double durable_timeout;
+    uint64_t durable_lsn;
+    loginfo* logger;
+    // accepted by a tcp thread itself: the first request is the handshake
+    bool need_handshake;
 
     conn(int s)
-        : fd(s), inbuf_(new char[inbufsz]),
+        : fd(s), durable_timeout(sync_commit_timeout), durable_lsn(0),
+          logger(0), need_handshake(false),
+          inbuf_(new char[inbufsz]),
           inbufpos_(0), inbuflen_(0), kvout(new_kvout(s, 20 * 1024)),
           inbuftotal_(0) {
     }
@@ -490,6 +708,17 @@ struct conn {
             parser_.result() = Json();
         return parser_.result();
     }
+    // Decode the next request in place if it is a fast request that is
+    // entirely buffered. Otherwise consume nothing and return false; the
+    // caller should use receive(). fr is valid until the next receive.
+    bool receive_fast(fast_request& fr) {
+        if (!parser_.empty() || !check(2))
+            return false;
+        int n = decode_fast_request(inbuf_ + inbufpos_, inbuf_ + inbuflen_,
+                                    fr);
+        inbufpos_ += n;
+        return n != 0;
+    }
 
     int check(int tryhard) {
         if (inbufpos_ == inbuflen_ && tryhard)
@@ -543,8 +772,14 @@ void conn::hard_check(int tryhard) {
         struct timeval tv = {0, 0};
         if (select(fd + 1, &rfds, NULL, NULL, &tv) <= 0)
             return;
-    } else
+    } else {
+        // about to block: held responses must go out first
+        if (durable_lsn) {
+            logger->wait_durable(durable_lsn, durable_timeout);
+            durable_lsn = 0;
+        }
         kvflush(kvout);
+    }
 
     ssize_t r = read(fd, inbuf_ + inbufpos_, inbufsz - inbufpos_);
     if (r != -1)
@@ -562,7 +797,13 @@ struct conninfo {
 enum { clp_val_suffixdouble = Clp_ValFirstUser };
 enum { opt_nolog = 1, opt_pin, opt_logdir, opt_port, opt_ckpdir, opt_duration,
        opt_test, opt_test_name, opt_threads, opt_cores,
-       opt_print, opt_norun, opt_checkpoint, opt_limit, opt_epoch_interval };
+       opt_print, opt_norun, opt_checkpoint, opt_limit, opt_epoch_interval,
+       opt_ckp_chunk, opt_ckp_direct, opt_log_group_bytes,
+       opt_log_group_interval, opt_sync_commit, opt_io_uring, opt_log_io_depth,
+       opt_log_compress, opt_ckp_full_every, opt_ckp_max_deltas,
+       opt_ckp_max_tombstones,
+       opt_interleave, opt_merge_fill, opt_fast_path, opt_reuseport,
+       opt_udp_batch, opt_busy_poll, opt_socket_busy_poll };
 static const Clp_Option options[] = {
     { "no-log", 0, opt_nolog, 0, 0 },
     { 0, 'n', opt_nolog, 0, 0 },
@@ -575,6 +816,24 @@ static const Clp_Option options[] = {
     { "ckpdir", 0, opt_ckpdir, Clp_ValString, 0 },
     { "ckdir", 0, opt_ckpdir, Clp_ValString, 0 },
     { "cd", 0, opt_ckpdir, Clp_ValString, 0 },
+    { "ckp-chunk", 0, opt_ckp_chunk, Clp_ValDouble, 0 },
+    { "ckp-direct", 0, opt_ckp_direct, 0, Clp_Negate },
+    { "ckp-full-every", 0, opt_ckp_full_every, Clp_ValInt, 0 },
+    { "ckp-max-deltas", 0, opt_ckp_max_deltas, Clp_ValInt, 0 },
+    { "ckp-max-tombstones", 0, opt_ckp_max_tombstones, clp_val_suffixdouble, 0 },
+    { "log-group-bytes", 0, opt_log_group_bytes, clp_val_suffixdouble, 0 },
+    { "log-group-interval", 0, opt_log_group_interval, Clp_ValDouble, 0 },
+    { "sync-commit", 0, opt_sync_commit, Clp_ValDouble, Clp_Optional | Clp_Negate },
+    { "io-uring", 0, opt_io_uring, 0, Clp_Negate },
+    { "log-io-depth", 0, opt_log_io_depth, Clp_ValInt, 0 },
+    { "log-compress", 0, opt_log_compress, Clp_ValString, Clp_Optional | Clp_Negate },
+    { "interleave", 0, opt_interleave, Clp_ValInt, 0 },
+    { "merge-fill", 0, opt_merge_fill, Clp_ValInt, 0 },
+    { "fast-path", 0, opt_fast_path, 0, Clp_Negate },
+    { "reuseport", 0, opt_reuseport, 0, Clp_Negate },
+    { "udp-batch", 0, opt_udp_batch, Clp_ValInt, 0 },
+    { "busy-poll", 0, opt_busy_poll, Clp_ValDouble, Clp_Optional | Clp_Negate },
+    { "socket-busy-poll", 0, opt_socket_busy_poll, Clp_ValInt, 0 },
     { "port", 0, opt_port, Clp_ValInt, 0 },
     { "duration", 'd', opt_duration, Clp_ValDouble, 0 },
     { "limit", 'l', opt_limit, clp_val_suffixdouble, 0 },
@@ -599,6 +858,20 @@ main(int argc, char *argv[])
 {
   using std::swap;
   int s, ret, yes = 1, i = 1, firstcore = -1, corestride = 1;
+  threadcounter_names[(int) tc_root_retry] = "root_retry";
+  threadcounter_names[(int) tc_internode_retry] = "internode_retry";
+  threadcounter_names[(int) tc_leaf_retry] = "leaf_retry";
+  threadcounter_names[(int) tc_leaf_walk] = "leaf_walk";
+  threadcounter_names[(int) tc_stable_internode_insert] = "stable_internode_insert";
+  threadcounter_names[(int) tc_stable_internode_split] = "stable_internode_split";
+  threadcounter_names[(int) tc_stable_leaf_insert] = "stable_leaf_insert";
+  threadcounter_names[(int) tc_stable_leaf_split] = "stable_leaf_split";
+  threadcounter_names[(int) tc_leaf_merge] = "leaf_merge";
+  threadcounter_names[(int) tc_leaf_merge_skip] = "leaf_merge_skip";
+  threadcounter_names[(int) tc_finger_hit] = "finger_hit";
+  threadcounter_names[(int) tc_finger_miss] = "finger_miss";
+  threadcounter_names[(int) tc_internode_lock] = "internode_lock_retry";
+  threadcounter_names[(int) tc_leaf_lock] = "leaf_lock_retry";
   const char *dotest = 0;
   nlogger = tcpthreads = udpthreads = nckthreads = sysconf(_SC_NPROCESSORS_ONLN);
   Clp_Parser *clp = Clp_NewParser(argc, argv, (int) arraysize(options), options);
@@ -636,6 +909,135 @@ main(int argc, char *argv[])
           else
               checkpoint_interval = 30;
           break;
+      case opt_ckp_chunk:
+          if (clp->val.d <= 0 || clp->val.d >= 2048) {
+              Clp_OptionError(clp, "%<%O%> should be between 0 and 2048 MB");
+              exit(EXIT_FAILURE);
+          }
+          ckp_chunk_size = (size_t) (clp->val.d * (1 << 20));
+          break;
+      case opt_ckp_direct:
+          ckp_direct = !clp->negated;
+          break;
+      case opt_ckp_full_every:
+          if (clp->val.i < 1) {
+              Clp_OptionError(clp, "%<%O%> should be at least 1");
+              exit(EXIT_FAILURE);
+          }
+          ckp_full_every = clp->val.i;
+          break;
+      case opt_ckp_max_deltas:
+          if (clp->val.i < 1) {
+              Clp_OptionError(clp, "%<%O%> should be at least 1");
+              exit(EXIT_FAILURE);
+          }
+          ckp_max_deltas = clp->val.i;
+          break;
+      case opt_ckp_max_tombstones:
+          if (clp->val.d < 1) {
+              Clp_OptionError(clp, "%<%O%> should be at least 1");
+              exit(EXIT_FAILURE);
+          }
+          ckp_max_tombstones = (uint64_t) clp->val.d;
+          break;
+      case opt_interleave:
+          if (clp->val.i < 1 || clp->val.i > 64) {
+              Clp_OptionError(clp, "%<%O%> should be between 1 and 64");
+              exit(EXIT_FAILURE);
+          }
+          interleave = clp->val.i;
+          break;
+      case opt_merge_fill:
+          if (clp->val.i < 0) {
+              Clp_OptionError(clp, "%<%O%> should be nonnegative");
+              exit(EXIT_FAILURE);
+          }
+          merge_fill = clp->val.i;
+          break;
+      case opt_fast_path:
+          tcp_fast_path = !clp->negated;
+          break;
+      case opt_udp_batch:
+          if (clp->val.i < 1 || clp->val.i > max_udp_batch) {
+              Clp_OptionError(clp, "%<%O%> should be between 1 and 64");
+              exit(EXIT_FAILURE);
+          }
+          udp_batch = clp->val.i;
+          break;
+      case opt_busy_poll:
+          // spin budget in microseconds, 100 by default
+          if (clp->negated)
+              busy_poll_usec = 0;
+          else if (clp->have_val && clp->val.d < 0) {
+              Clp_OptionError(clp, "%<%O%> should be nonnegative");
+              exit(EXIT_FAILURE);
+          } else
+              busy_poll_usec = clp->have_val ? clp->val.d : 100;
+          break;
+      case opt_socket_busy_poll:
+#ifdef SO_BUSY_POLL
+          if (clp->val.i < 0) {
+              Clp_OptionError(clp, "%<%O%> should be nonnegative");
+              exit(EXIT_FAILURE);
+          }
+          socket_busy_poll = clp->val.i;
+#else
+          Clp_OptionError(clp, "%<%O%> not supported on this platform");
+          exit(EXIT_FAILURE);
+#endif
+          break;
+      case opt_reuseport:
+#ifdef SO_REUSEPORT
+          tcp_reuseport = !clp->negated;
+#else
+          Clp_OptionError(clp, "%<%O%> not supported on this platform");
+          exit(EXIT_FAILURE);
+#endif
+          break;
+      case opt_log_group_bytes:
+          if (clp->val.d < 0 || clp->val.d >= (1 << 30)) {
+              Clp_OptionError(clp, "%<%O%> out of range");
+              exit(EXIT_FAILURE);
+          }
+          log_group_commit_bytes = (uint32_t) clp->val.d;
+          break;
+      case opt_log_group_interval:
+          log_group_commit_interval = clp->val.d / 1000;
+          break;
+      case opt_sync_commit:
+          if (clp->negated)
+              sync_commit_timeout = -1;
+          else if (clp->have_val && clp->val.d > 0)
+              sync_commit_timeout = clp->val.d / 1000;
+          else
+              sync_commit_timeout = 0;
+          break;
+      case opt_io_uring:
+          io_ring::enabled = !clp->negated;
+          break;
+      case opt_log_io_depth:
+          if (clp->val.i <= 0 || clp->val.i > 64) {
+              Clp_OptionError(clp, "%<%O%> should be between 1 and 64");
+              exit(EXIT_FAILURE);
+          }
+          log_io_depth = clp->val.i;
+          break;
+      case opt_log_compress:
+          if (clp->negated)
+              log_compress = log_compress_none;
+          else if (!clp->have_val || strcmp(clp->val.s, "prefix") == 0)
+              log_compress = log_compress_prefix;
+          else if (strcmp(clp->val.s, "lz4") == 0)
+              log_compress = log_compress_lz4;
+          else {
+              Clp_OptionError(clp, "%<%O%> should be %<prefix%> or %<lz4%>");
+              exit(EXIT_FAILURE);
+          }
+          if (!log_compress_supported(log_compress)) {
+              Clp_OptionError(clp, "%<%O%>: not built with LZ4 support");
+              exit(EXIT_FAILURE);
+          }
+          break;
       case opt_port:
           port = clp->val.i;
           break;
@@ -742,8 +1144,9 @@ main(int argc, char *argv[])
   main_ti->pthread() = pthread_self();
 
   initial_timestamp = timestamp();
-  tree = new Masstree::default_table;
+  tree = new Masstree::server_table;
   tree->initialize(*main_ti);
+  tree->table().set_merge_fill(merge_fill);
   printf("%s, %s, pin-threads %s, ", tree->name(), row_type::name(),
          pinthreads ? "enabled" : "disabled");
   if(logging){
@@ -761,6 +1164,7 @@ main(int argc, char *argv[])
       printf("1 udp thread (port %d)\n", port);
   else
       printf("%d udp threads (ports %d-%d)\n", udpthreads, port, port + udpthreads - 1);
+  udp_thread_stats = new udp_stats[udpthreads];
   for(i = 0; i < udpthreads; i++){
     threadinfo *ti = threadinfo::make(threadinfo::TI_PROCESS, i);
     ret = pthread_create(&ti->pthread(), 0, udp_threadfunc, ti);
@@ -779,32 +1183,25 @@ main(int argc, char *argv[])
       exit(0);
   }
 
-  // TCP socket and threads
+  // TCP socket and threads. With --reuseport each thread gets its own
+  // listening socket, and the kernel spreads connections among them.
 
-  s = socket(AF_INET, SOCK_STREAM, 0);
-  always_assert(s >= 0);
-  setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
-  setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
-
-  struct sockaddr_in sin;
-  sin.sin_family = AF_INET;
-  sin.sin_addr.s_addr = INADDR_ANY;
-  sin.sin_port = htons(port);
-  ret = bind(s, (struct sockaddr *) &sin, sizeof(sin));
-  if (ret < 0) {
-      perror("bind");
-      exit(EXIT_FAILURE);
-  }
-
-  ret = listen(s, 100);
-  if (ret < 0) {
-      perror("listen");
-      exit(EXIT_FAILURE);
+  s = -1;
+  if (!tcp_reuseport)
+      s = tcp_listen(false, -1);
+  else {
+      tcp_listen_fds = new int[tcpthreads];
+      for (i = 0; i < tcpthreads; i++)
+          tcp_listen_fds[i] = tcp_listen(true, pinthreads ? cores[i] : -1);
   }
 
   threadinfo **tcpti = new threadinfo *[tcpthreads];
   tcp_thread_pipes = new int[tcpthreads * 2];
-  printf("%d tcp threads (port %d)\n", tcpthreads, port);
+  printf("%d tcp threads (port %d%s", tcpthreads, port,
+         tcp_reuseport ? ", reuseport" : "");
+  if (busy_poll_usec)
+      printf(", busy-poll %gus", busy_poll_usec);
+  printf(")\n");
   for(i = 0; i < tcpthreads; i++){
     threadinfo *ti = threadinfo::make(threadinfo::TI_PROCESS, i);
     ret = pipe(&tcp_thread_pipes[i * 2]);
@@ -820,6 +1217,10 @@ main(int argc, char *argv[])
   ret = pthread_create(&canceling_tid, NULL, canceling, NULL);
   always_assert(ret == 0);
 
+  if (tcp_reuseport)
+      while (1)
+          pause();
+
   static int next = 0;
   while(1){
     int s1;
@@ -830,6 +1231,7 @@ main(int argc, char *argv[])
     s1 = accept(s, (struct sockaddr *) &sin1, &sinlen);
     always_assert(s1 >= 0);
     setsockopt(s1, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    set_socket_busy_poll(s1);
 
     // Complete handshake.
     char buf[BUFSIZ];
@@ -867,6 +1269,68 @@ main(int argc, char *argv[])
   }
 }
 
+// Return a listening tcp socket on port. If reuseport, other sockets may
+// listen on the same port; if also cpu >= 0, the socket prefers
+// connections whose packets arrive on that cpu.
+static int tcp_listen(bool reuseport, int cpu) {
+  int yes = 1;
+  int s = socket(AF_INET, SOCK_STREAM, 0);
+  always_assert(s >= 0);
+  setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+#ifdef SO_REUSEPORT
+  if (reuseport && setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) < 0) {
+      perror("SO_REUSEPORT");
+      exit(EXIT_FAILURE);
+  }
+#endif
+#ifdef SO_INCOMING_CPU
+  if (reuseport && cpu >= 0)
+      setsockopt(s, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu));
+#endif
+  (void) cpu;
+  if (reuseport) {
+      // accepts happen in the event loop, which must not block
+      int flags = fcntl(s, F_GETFL);
+      fcntl(s, F_SETFL, flags | O_NONBLOCK);
+  }
+
+  struct sockaddr_in sin;
+  bzero(&sin, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = INADDR_ANY;
+  sin.sin_port = htons(port);
+  int ret = bind(s, (struct sockaddr *) &sin, sizeof(sin));
+  if (ret < 0) {
+      perror("bind");
+      exit(EXIT_FAILURE);
+  }
+
+  ret = listen(s, 100);
+  if (ret < 0) {
+      perror("listen");
+      exit(EXIT_FAILURE);
+  }
+  return s;
+}
+
+// Ask the kernel to busy-poll the device queue for up to
+// socket_busy_poll microseconds when s has no data ready.
+static void set_socket_busy_poll(int s) {
+#ifdef SO_BUSY_POLL
+  if (socket_busy_poll
+      && setsockopt(s, SOL_SOCKET, SO_BUSY_POLL, &socket_busy_poll,
+                    sizeof(socket_busy_poll)) < 0) {
+      static bool warned;
+      if (!warned)
+          perror("SO_BUSY_POLL");
+      warned = true;
+  }
+#else
+  (void) s;
+#endif
+}
+
 void
 catchint(int)
 {
@@ -924,6 +1388,13 @@ canceling(void *)
             always_assert(r == 0);
         }
     tree->stats(stderr);
+    Json j;
+    if (logs)
+        logs->json_stats(j);
+    if (udpthreads)
+        udp_json_stats(j);
+    if (j)
+        fprintf(stderr, "%s\n", j.unparse(Json::indent_depth(1).tab_width(2)).c_str());
     exit(0);
 }
 
@@ -955,8 +1426,112 @@ int handshake(Json& request, threadinfo& ti) {
     return request[2].as_b() ? 1 : -1;
 }
 
-// execute command, return result.
-int onego(query<row_type>& q, Json& request, Str request_str, threadinfo& ti) {
+// remember a removed key for the next delta checkpoint.
+// called within the remove's RCU critical section, so the checkpointer's
+// barrier sees it.
+static void ckp_note_remove(Str key, kvtimestamp_t ts) {
+    ckp_tombstone_list* t = my_ckp_tombstones;
+    if (!t) {
+        t = my_ckp_tombstones = new ckp_tombstone_list;
+        pthread_mutex_init(&t->mu, 0);
+        pthread_mutex_lock(&ckp_tombstone_mu);
+        ckp_tombstone_lists.push_back(t);
+        pthread_mutex_unlock(&ckp_tombstone_mu);
+    }
+    pthread_mutex_lock(&t->mu);
+    t->removed.push_back(ckp_tombstone(String(key), ts));
+    uint64_t n = fetch_and_add(&ckp_ntombstones, uint64_t(1)) + 1;
+    pthread_mutex_unlock(&t->mu);
+    if (n >= ckp_max_tombstones && ckp_track_removes) {
+        // the lists are freed at the next checkpoint, which must be full
+        ckp_track_removes = false;
+        ckp_tombstones_dropped = true;
+    }
+}
+
+// Per-thread latency histograms, in nanoseconds, indexed by command / 2.
+// Only the owning thread writes its histograms, with add_relaxed();
+// server_stats() merges them with merge_relaxed() and no lock, so it
+// may miss requests recorded meanwhile.
+struct cmd_latency {
+    kvloglinear_histogram h[Cmd_Max / 2 + 1];
+};
+static pthread_mutex_t cmd_latency_mu = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<cmd_latency*> cmd_latency_lists;
+static __thread cmd_latency* my_cmd_latency;
+static const char* const cmd_names[] = {
+    "none", "get", "scan", "put", "replace", "remove", "checkpoint",
+    "handshake", "multiget", "remove_range", "increment", "append",
+    "cas", "stats"
+};
+static_assert(sizeof(cmd_names) / sizeof(cmd_names[0]) == Cmd_Max / 2 + 1,
+              "cmd_names out of date");
+
+static inline uint64_t latency_clock() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * uint64_t(1000000000) + ts.tv_nsec;
+}
+
+static void record_latency(int command, uint64_t t0) {
+    cmd_latency* l = my_cmd_latency;
+    if (!l) {
+        l = my_cmd_latency = new cmd_latency;
+        pthread_mutex_lock(&cmd_latency_mu);
+        cmd_latency_lists.push_back(l);
+        pthread_mutex_unlock(&cmd_latency_mu);
+    }
+    l->h[command / 2].add_relaxed(latency_clock() - t0);
+}
+
+// Return the Cmd_Stats reply: per-command latency, thread counters,
+// limbo usage, and log and udp statistics.
+static Json server_stats() {
+    Json j;
+    kvloglinear_histogram h[Cmd_Max / 2 + 1];
+    pthread_mutex_lock(&cmd_latency_mu);
+    for (cmd_latency* l : cmd_latency_lists)
+        for (int i = 0; i != Cmd_Max / 2 + 1; ++i)
+            h[i].merge_relaxed(l->h[i]);
+    pthread_mutex_unlock(&cmd_latency_mu);
+    Json latency = Json::make_object();
+    for (int i = 0; i != Cmd_Max / 2 + 1; ++i)
+        if (h[i].count)
+            latency.set(cmd_names[i], h[i].unparse_json());
+    j.set("latency_ns", latency);
+
+    uint64_t counters[(int) tc_max] = {0};
+    size_t limbo_used = 0, limbo_allocated = 0;
+    for (threadinfo* ti = threadinfo::allthreads; ti; ti = ti->next()) {
+        for (int i = 0; i != tc_max; ++i)
+            counters[i] += ti->counter(threadcounter(i));
+        size_t used, allocated;
+        ti->limbo_usage(used, allocated);
+        limbo_used += used;
+        limbo_allocated += allocated;
+    }
+    Json cj;
+    for (int i = 0; i != tc_max; ++i)
+        if (counters[i] && threadcounter_names[i])
+            cj.set(threadcounter_names[i], counters[i]);
+    if (cj)
+        j.set("counters", cj);
+    j.set("limbo", Json().set("used", limbo_used)
+          .set("allocated", limbo_allocated));
+    if (logs)
+        logs->json_stats(j);
+    if (udpthreads)
+        udp_json_stats(j);
+    if (ckp_deltas)
+        j.set("ckp_tombstones", ckp_ntombstones);
+    return j;
+}
+
+// execute command, return result. If lsn is nonnull, it is set to the log
+// position of the command's log record, if any.
+int onego(query<row_type>& q, Json& request, Str request_str, threadinfo& ti,
+          uint64_t* lsn = 0) {
+    uint64_t t0 = latency_clock();
     int command = request[1].as_i();
     if (command == Cmd_Checkpoint) {
         // force checkpoint
@@ -966,42 +1541,119 @@ int onego(query<row_type>& q, Json& request, Str request_str, threadinfo& ti) {
         request.resize(2);
     } else if (command == Cmd_Get) {
         q.run_get(tree->table(), request, ti);
+    } else if (command == Cmd_MultiGet && request.size() > 2
+               && request[2].is_a()) {
+        q.run_multiget(tree->table(), request, ti);
     } else if (command == Cmd_Put && request.size() > 3
-               && (request.size() % 2) == 1) { // insert or update
-        Str key(request[2].as_s());
+               && (request.size() % 2) == 1
+               && tree->table().key_fits(request[2].as_s())) { // insert or update
         const Json* req = request.array_data() + 3;
         const Json* end_req = request.end_array_data();
-        request[2] = q.run_put(tree->table(), request[2].as_s(),
-                               req, end_req, ti);
+        Str changeset;
         if (ti.logger() && request_str) {
-            // use the client's parsed version of the request
+            // log the client's parsed version of the request
             msgpack::parser mp(request_str.data());
             mp.skip_array_size().skip_primitives(3);
-            ti.logger()->record(logcmd_put, q.query_times(), key, Str(mp.position(), request_str.end()));
-        } else if (ti.logger())
-            ti.logger()->record(logcmd_put, q.query_times(), key, req, end_req);
+            changeset = Str(mp.position(), request_str.end());
+        }
+        request[2] = q.run_put(tree->table(), request[2].as_s(),
+                               req, end_req, ti, changeset);
         request.resize(3);
-    } else if (command == Cmd_Replace) { // insert or update
+    } else if (command == Cmd_Replace
+               && tree->table().key_fits(request[2].as_s())) { // insert or update
         Str key(request[2].as_s()), value(request[3].as_s());
         request[2] = q.run_replace(tree->table(), key, value, ti);
-        if (ti.logger()) // NB may block
-            ti.logger()->record(logcmd_replace, q.query_times(), key, value);
         request.resize(3);
     } else if (command == Cmd_Remove) { // remove
         Str key(request[2].as_s());
         bool removed = q.run_remove(tree->table(), key, ti);
-        if (removed && ti.logger()) // NB may block
-            ti.logger()->record(logcmd_remove, q.query_times(), key, Str());
+        if (removed && ckp_track_removes)
+            ckp_note_remove(key, q.query_times().ts);
         request[2] = removed;
         request.resize(3);
-    } else if (command == Cmd_Scan) {
+    } else if (command == Cmd_RemoveRange && request.size() == 4
+               && request[2].is_s() && request[3].is_s()) {
+        // remove [request[2], request[3]); an empty end means no end
+        auto note = [](Str key, kvtimestamp_t ts) {
+            if (ckp_track_removes)
+                ckp_note_remove(key, ts);
+        };
+        request[2] = q.run_remove_range(tree->table(), request[2].as_s(),
+                                        request[3].as_s(), note, ti);
+        request.resize(3);
+    } else if ((command == Cmd_Increment || command == Cmd_Append
+                || command == Cmd_CompareAndSwap)
+               && request.size() == (command == Cmd_CompareAndSwap ? 6 : 5)
+               && request[2].is_s() && request[3].is_nonnegint()
+               && (command == Cmd_Increment ? request[4].is_int()
+                   : command == Cmd_Append ? request[4].is_s()
+                   : request[5].is_s())
+               && tree->table().key_fits(request[2].as_s())) {
+        if (command == Cmd_Increment)
+            q.run_increment(tree->table(), request, ti);
+        else if (command == Cmd_Append)
+            q.run_append(tree->table(), request, ti);
+        else
+            q.run_cas(tree->table(), request, ti);
+    } else if (command == Cmd_Scan && request.size() >= 4
+               && request[2].is_s() && request[3].is_int()) {
         q.run_scan(tree->table(), request, ti);
+    } else if (command == Cmd_Stats) {
+        request.resize(2);
+        request.push_back(server_stats());
     } else {
         request[1] = -1;
         request.resize(2);
         return -1;
     }
     request[1] = command + 1;
+    if (lsn)
+        *lsn = command == Cmd_Put || command == Cmd_Replace
+            || command == Cmd_Remove || command == Cmd_RemoveRange
+            || command == Cmd_Increment || command == Cmd_Append
+            || command == Cmd_CompareAndSwap ? q.log_position() : 0;
+    record_latency(command, t0);
+    return 1;
+}
+
+// execute a fast request, writing the reply straight to kvout.
+int onego_fast(query<row_type>& q, const fast_request& fr,
+               struct kvout* kvout, threadinfo& ti, uint64_t* lsn) {
+    uint64_t t0 = latency_clock();
+    msgpack::unparser<struct kvout> up(*kvout);
+    *lsn = 0;
+    if (fr.command == Cmd_Get) {
+        const row_type* row = q.run_get_row(tree->table(), fr.key, fr.fields,
+                                            fr.nfields, ti);
+        if (!row) {
+            // like run_get, leave the request's key and fields in place
+            up.write_array_header(3 + fr.nfields) << fr.seq
+                << fr.command + 1 << fr.key;
+            for (int i = 0; i != fr.nfields; ++i)
+                up << fr.fields[i];
+        } else {
+            int n = fr.nfields ? fr.nfields : row->ncol();
+            up.write_array_header(2 + n) << fr.seq << fr.command + 1;
+            for (int i = 0; i != n; ++i)
+                up << row->col(fr.nfields ? fr.fields[i] : i);
+        }
+    } else if (fr.command == Cmd_Replace
+               && tree->table().key_fits(fr.key)) {
+        int r = q.run_replace(tree->table(), fr.key, fr.value, ti);
+        up.write_array_header(3) << fr.seq << fr.command + 1 << r;
+        *lsn = q.log_position();
+    } else if (fr.command == Cmd_Remove) {
+        bool removed = q.run_remove(tree->table(), fr.key, ti);
+        if (removed && ckp_track_removes)
+            ckp_note_remove(fr.key, q.query_times().ts);
+        up.write_array_header(3) << fr.seq << fr.command + 1;
+        up << Json(removed);
+        *lsn = q.log_position();
+    } else {
+        up.write_array_header(2) << fr.seq << -1;
+        return -1;
+    }
+    record_latency(fr.command, t0);
     return 1;
 }
 
@@ -1024,8 +1676,9 @@ struct tcpfds {
 
     enum { max_events = 100 };
     typedef struct epoll_event eventset[max_events];
-    int wait(eventset &es) {
-        return epoll_wait(epollfd, es, max_events, -1);
+    // timeout_ms < 0 waits forever; 0 polls
+    int wait(eventset &es, int timeout_ms = -1) {
+        return epoll_wait(epollfd, es, max_events, timeout_ms);
     }
 
     conn *event_conn(eventset &es, int i) const {
@@ -1062,9 +1715,10 @@ class tcpfds {
     }
 
     typedef fd_set eventset;
-    int wait(eventset &es) {
+    int wait(eventset &es, int timeout_ms = -1) {
         es = rfds_;
-        int r = select(nfds_, &es, 0, 0, 0);
+        struct timeval tv = {timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+        int r = select(nfds_, &es, 0, 0, timeout_ms < 0 ? 0 : &tv);
         return r > 0 ? nfds_ : r;
     }
 
@@ -1108,6 +1762,52 @@ void prepare_thread(threadinfo *ti) {
         ti->set_logger(&logs->log(ti->index() % nlogger));
 }
 
+// one request in a tcp worker's batch. request is null for a fast
+// request, whose reply is written as it runs.
+struct tcp_request {
+    conn* c;
+    uint64_t xposition;
+    Json* request;
+    fast_request fast;
+    int ret;
+    uint64_t lsn;
+
+    tcp_request(conn* c_)
+        : c(c_), request(0), ret(-1), lsn(0) {
+    }
+};
+
+// Return true if request looks up a single key in request[2].
+static bool tcp_request_key(const Json& request) {
+    int command = request[1].as_i();
+    return (command == Cmd_Get || command == Cmd_Put
+            || command == Cmd_Replace || command == Cmd_Remove
+            || command == Cmd_Increment || command == Cmd_Append
+            || command == Cmd_CompareAndSwap)
+        && request.size() > 2 && request[2].is_s();
+}
+
+// Finish setting up a connection from its handshake request, which is
+// replaced by the reply and sent. Returns -1 if the connection should
+// be closed.
+static int tcp_start_conn(conn* c, Json& hs, threadinfo& ti) {
+    if (hs.size() >= 3 && hs[2].is_o() && hs[2].get("durable")) {
+        // "durable": true, or a bound in milliseconds
+        const Json& d = hs[2].get("durable");
+        if (d.is_b())
+            c->durable_timeout = d.as_b() ? 0 : -1;
+        else
+            c->durable_timeout = std::max(d.to_d(), 0.) / 1000;
+    }
+    c->logger = ti.logger();
+    if (!c->logger)
+        c->durable_timeout = -1;
+    int ret = handshake(hs, ti);
+    msgpack::unparse(*c->kvout, hs);
+    kvflush(c->kvout);
+    return ret;
+}
+
 void* tcp_threadfunc(void* x) {
     threadinfo* ti = reinterpret_cast<threadinfo*>(x);
     ti->pthread() = pthread_self();
@@ -1115,17 +1815,59 @@ void* tcp_threadfunc(void* x) {
 
     int myfd = tcp_thread_pipes[2 * ti->index()];
     tcpfds sloop(myfd);
+    int listenfd = -1;
+    if (tcp_reuseport) {
+        listenfd = tcp_listen_fds[ti->index()];
+        sloop.add(listenfd, (conn *) 2);
+    }
     tcpfds::eventset events;
     std::deque<conn*> ready;
+    std::vector<conn*> syncing;
+    std::vector<tcp_request> batch;
+    std::vector<Str> batchkeys;
     query<row_type> q;
+    double spin_until = 0;
 
     while (1) {
-        int nev = sloop.wait(events);
+        int nev = sloop.wait(events, busy_poll_usec ? 0 : -1);
+        if (nev == 0 && busy_poll_usec) {
+            // Busy-poll: keep polling until idle for busy_poll_usec,
+            // then fall back to sleeping in wait().
+            double t = now();
+            if (!spin_until)
+                spin_until = t + busy_poll_usec / 1000000;
+            if (t < spin_until) {
+                relax_fence();
+                continue;
+            }
+            nev = sloop.wait(events);
+        }
+        spin_until = 0;
         for (int i = 0; i < nev; i++)
             if (conn *c = sloop.event_conn(events, i))
                 ready.push_back(c);
 
-        while (!ready.empty()) {
+        while (!ready.empty() || !syncing.empty()) {
+            if (ready.empty()) {
+                // Group commit: wait once for every connection whose
+                // responses are held on durability, then flush them all.
+                uint64_t lsn = 0;
+                double timeout = -1;
+                for (conn* c : syncing) {
+                    lsn = std::max(lsn, c->durable_lsn);
+                    if (c->durable_timeout > 0
+                        && (timeout <= 0 || c->durable_timeout < timeout))
+                        timeout = c->durable_timeout;
+                }
+                ti->logger()->wait_durable(lsn, timeout);
+                for (conn* c : syncing) {
+                    c->durable_lsn = 0;
+                    kvflush(c->kvout);
+                }
+                syncing.clear();
+                continue;
+            }
+
             conn* c = ready.front();
             ready.pop_front();
 
@@ -1138,39 +1880,120 @@ void* tcp_threadfunc(void* x) {
                 for (int j = 0; j * sizeof(*ci) < (size_t) len; ++j) {
                     struct conn *c = new conn(ci[j]->s);
                     sloop.add(c->fd, c);
-                    int ret = handshake(ci[j]->handshake, *ti);
-                    msgpack::unparse(*c->kvout, ci[j]->handshake);
-                    kvflush(c->kvout);
-                    if (ret < 0) {
+                    if (tcp_start_conn(c, ci[j]->handshake, *ti) < 0) {
                         sloop.remove(c->fd);
                         delete c;
                     }
                     delete ci[j];
                 }
+            } else if (c == (conn *) 2) {
+                // new connections on this thread's own listener
+                int yes = 1;
+                for (int j = 0; j != MAX_NEWCONN; ++j) {
+                    int s1 = accept(listenfd, NULL, NULL);
+                    if (s1 < 0) {
+                        if (errno != EAGAIN && errno != EWOULDBLOCK
+                            && errno != EINTR && errno != ECONNABORTED)
+                            perror("accept");
+                        break;
+                    }
+                    setsockopt(s1, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+                    set_socket_busy_poll(s1);
+                    struct conn *c = new conn(s1);
+                    c->need_handshake = true;
+                    sloop.add(c->fd, c);
+                }
+            } else if (c && c->need_handshake) {
+                Json& hs = c->receive();
+                bool ok = hs.is_a() && hs.size() >= 2 && hs[1].is_i()
+                    && hs[1].as_i() == Cmd_Handshake
+                    && (hs.size() == 2 || hs[2].is_o());
+                if (!ok)
+                    fprintf(stderr, "failed handshake\n");
+                if (!ok || tcp_start_conn(c, hs, *ti) < 0) {
+                    sloop.remove(c->fd);
+                    delete c;
+                    continue;
+                }
+                hs.clear();
+                c->need_handshake = false;
+                if (c->check(0))
+                    ready.push_back(c);
             } else if (c) {
-                // Should not block as suggested by epoll
-                uint64_t xposition = c->xposition();
-                Json& request = c->receive();
-                int ret;
-                if (unlikely(!request))
-                    goto closed;
+                // Take up to `interleave` ready connections, one request
+                // each, and descend the tree for all their keys together
+                // so the cache misses overlap.
+                batch.clear();
+                batch.push_back(tcp_request(c));
+                while (int(batch.size()) < interleave && !ready.empty()
+                       && ready.front() != (conn*) 1
+                       && ready.front() != (conn*) 2
+                       && !ready.front()->need_handshake
+                       && std::find_if(batch.begin(), batch.end(),
+                                       [&](const tcp_request& r) {
+                                           return r.c == ready.front();
+                                       }) == batch.end()) {
+                    batch.push_back(tcp_request(ready.front()));
+                    ready.pop_front();
+                }
+
+                batchkeys.clear();
+                for (tcp_request& r : batch) {
+                    // Should not block as suggested by epoll
+                    r.xposition = r.c->xposition();
+                    if (tcp_fast_path && r.c->receive_fast(r.fast)) {
+                        if (batch.size() > 1)
+                            batchkeys.push_back(r.fast.key);
+                        continue;
+                    }
+                    r.request = &r.c->receive();
+                    if (batch.size() > 1 && *r.request
+                        && tcp_request_key(*r.request))
+                        batchkeys.push_back((*r.request)[2].as_s());
+                }
+
                 ti->rcu_start();
-                ret = onego(q, request, c->recent_string(xposition), *ti);
+                if (batchkeys.size() > 1)
+                    tree->table().prefetch_paths(batchkeys.data(),
+                                                 batchkeys.size(), *ti);
+                for (tcp_request& r : batch)
+                    if (!r.request)
+                        r.ret = onego_fast(q, r.fast, r.c->kvout, *ti, &r.lsn);
+                    else if (*r.request)
+                        r.ret = onego(q, *r.request,
+                                      r.c->recent_string(r.xposition),
+                                      *ti, &r.lsn);
                 ti->rcu_stop();
-                msgpack::unparse(*c->kvout, request);
-                request.clear();
-                if (likely(ret >= 0)) {
-                    if (c->check(0))
-                        ready.push_back(c);
-                    else
-                        kvflush(c->kvout);
-                    continue;
+
+                for (tcp_request& r : batch) {
+                    conn* c = r.c;
+                    if (r.request) {
+                        if (unlikely(!*r.request))
+                            goto closed;
+                        msgpack::unparse(*c->kvout, *r.request);
+                        r.request->clear();
+                    }
+                    if (likely(r.ret >= 0)) {
+                        if (r.lsn && c->durable_timeout >= 0) {
+                            if (std::find(syncing.begin(), syncing.end(), c)
+                                == syncing.end())
+                                syncing.push_back(c);
+                            c->durable_lsn = r.lsn;
+                        }
+                        if (c->check(0))
+                            ready.push_back(c);
+                        else if (!c->durable_lsn)
+                            kvflush(c->kvout);
+                        continue;
+                    }
+                    printf("socket read error\n");
+                closed:
+                    kvflush(c->kvout);
+                    syncing.erase(std::remove(syncing.begin(), syncing.end(), c),
+                                  syncing.end());
+                    sloop.remove(c->fd);
+                    delete c;
                 }
-                printf("socket read error\n");
-            closed:
-                kvflush(c->kvout);
-                sloop.remove(c->fd);
-                delete c;
             }
         }
     }
@@ -1194,41 +2017,116 @@ void* udp_threadfunc(void* x) {
   always_assert(ret == 0 && "bind failed");
   int sobuflen = 512*1024;
   setsockopt(s, SOL_SOCKET, SO_RCVBUF, &sobuflen, sizeof(sobuflen));
-
-  String buf = String::make_uninitialized(4096);
-  struct kvout *kvout = new_bufkvout();
+  set_socket_busy_poll(s);
+
+  // Receive up to udp_batch datagrams at a time, run them in one RCU
+  // critical section, and send the replies together.
+  enum { bufsz = 4096 };
+  String buf[max_udp_batch];
+  struct sockaddr_in sins[max_udp_batch];
+  socklen_t sinlens[max_udp_batch];
+  unsigned lens[max_udp_batch];
+  int replyto[max_udp_batch];
+  int replypos[max_udp_batch + 1];
+  for (int i = 0; i != udp_batch; ++i)
+      buf[i] = String::make_uninitialized(bufsz);
+#if HAVE_RECVMMSG && HAVE_SENDMMSG
+  struct mmsghdr msgs[max_udp_batch], replies[max_udp_batch];
+  struct iovec iovs[max_udp_batch], reply_iovs[max_udp_batch];
+#endif
+  udp_stats& st = udp_thread_stats[ti->index()];
   msgpack::streaming_parser parser;
   StringAccum sa;
 
   query<row_type> q;
   while(1){
-    struct sockaddr_in sin;
-    socklen_t sinlen = sizeof(sin);
-    ssize_t cc = recvfrom(s, const_cast<char*>(buf.data()), buf.length(),
-                          0, (struct sockaddr *) &sin, &sinlen);
-    if(cc < 0){
+    int n;
+#if HAVE_RECVMMSG && HAVE_SENDMMSG
+    for (int i = 0; i != udp_batch; ++i) {
+        iovs[i].iov_base = const_cast<char*>(buf[i].data());
+        iovs[i].iov_len = bufsz;
+        bzero(&msgs[i].msg_hdr, sizeof(msgs[i].msg_hdr));
+        msgs[i].msg_hdr.msg_name = &sins[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(sins[i]);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    n = recvmmsg(s, msgs, udp_batch, MSG_WAITFORONE, NULL);
+    for (int i = 0; i < n; ++i) {
+        lens[i] = msgs[i].msg_len;
+        sinlens[i] = msgs[i].msg_hdr.msg_namelen;
+    }
+#else
+    sinlens[0] = sizeof(sins[0]);
+    n = recvfrom(s, const_cast<char*>(buf[0].data()), bufsz,
+                 0, (struct sockaddr *) &sins[0], &sinlens[0]);
+    if (n >= 0) {
+        lens[0] = n;
+        n = 1;
+    }
+#endif
+    if (n < 0 && errno == EINTR)
+        continue;
+    else if (n < 0) {
       perror("udpgo read");
       exit(EXIT_FAILURE);
     }
-    kvout_reset(kvout);
 
-    parser.reset();
-    unsigned consumed = parser.consume(buf.data(), buf.length(), buf);
-
-    // Fail if we received a partial request
-    if (parser.success() && parser.result().is_a()) {
-        ti->rcu_start();
-        if (onego(q, parser.result(), Str(buf.data(), consumed), *ti) >= 0) {
-            sa.clear();
-            msgpack::unparser<StringAccum> cu(sa);
-            cu << parser.result();
-            cc = sendto(s, sa.data(), sa.length(), 0,
-                        (struct sockaddr*) &sin, sinlen);
-            always_assert(cc == (ssize_t) sa.length());
+    sa.clear();
+    int nreply = 0;
+    ti->rcu_start();
+    for (int i = 0; i != n; ++i) {
+        parser.reset();
+        unsigned consumed = parser.consume(buf[i].data(), lens[i], buf[i]);
+
+        // Fail if we received a partial request
+        if (parser.success() && parser.result().is_a()) {
+            if (onego(q, parser.result(), Str(buf[i].data(), consumed), *ti) >= 0) {
+                replyto[nreply] = i;
+                replypos[nreply] = sa.length();
+                msgpack::unparser<StringAccum> cu(sa);
+                cu << parser.result();
+                ++nreply;
+            }
+        } else {
+            printf("onego failed\n");
+            ++st.failed;
         }
-        ti->rcu_stop();
-    } else
-      printf("onego failed\n");
+    }
+    ti->rcu_stop();
+    parser.reset();
+    replypos[nreply] = sa.length();
+
+#if HAVE_RECVMMSG && HAVE_SENDMMSG
+    for (int j = 0; j != nreply; ++j) {
+        reply_iovs[j].iov_base = sa.data() + replypos[j];
+        reply_iovs[j].iov_len = replypos[j + 1] - replypos[j];
+        bzero(&replies[j].msg_hdr, sizeof(replies[j].msg_hdr));
+        replies[j].msg_hdr.msg_name = &sins[replyto[j]];
+        replies[j].msg_hdr.msg_namelen = sinlens[replyto[j]];
+        replies[j].msg_hdr.msg_iov = &reply_iovs[j];
+        replies[j].msg_hdr.msg_iovlen = 1;
+    }
+    for (int sent = 0; sent != nreply; ) {
+        int r = sendmmsg(s, replies + sent, nreply - sent, 0);
+        ++st.send_calls;
+        if (r < 0 && errno == EINTR)
+            continue;
+        always_assert(r > 0);
+        sent += r;
+    }
+#else
+    for (int j = 0; j != nreply; ++j) {
+        ssize_t cc = sendto(s, sa.data() + replypos[j],
+                            replypos[j + 1] - replypos[j], 0,
+                            (struct sockaddr*) &sins[replyto[j]],
+                            sinlens[replyto[j]]);
+        ++st.send_calls;
+        always_assert(cc == (ssize_t) (replypos[j + 1] - replypos[j]));
+    }
+#endif
+    st.requests += n;
+    st.batch_size.add_relaxed(n);
   }
   return 0;
 }
@@ -1266,13 +2164,15 @@ void log_init() {
   }
 }
 
-// read a checkpoint, insert key/value pairs into tree.
+// read a checkpoint file into part.entries, in key order.
+// the keys point into part.map, which stays mapped until the tree is built.
 // must be followed by a read of the log!
 // since checkpoint is not consistent
 // with any one point in time.
 // returns the timestamp of the first log record that needs
 // to come from the log.
-kvepoch_t read_checkpoint(threadinfo *ti, const char *path) {
+kvepoch_t read_checkpoint(threadinfo *ti, const char *path,
+                          ckp_partition &part) {
     double t0 = now();
 
     int fd = open(path, 0);
@@ -1286,6 +2186,8 @@ kvepoch_t read_checkpoint(threadinfo *ti, const char *path) {
     char *p = (char *) mmap(0, sb.st_size, PROT_READ, MAP_FILE|MAP_PRIVATE, fd, 0);
     always_assert(p != MAP_FAILED);
     close(fd);
+    part.map = p;
+    part.mapsize = sb.st_size;
 
     msgpack::parser par(String::make_stable(p, sb.st_size));
     Json j;
@@ -1297,10 +2199,12 @@ kvepoch_t read_checkpoint(threadinfo *ti, const char *path) {
     printf("reading checkpoint with %" PRIu64 " nodes\n", n);
 
     // read data
-    for (uint64_t i = 0; i != n; ++i)
-        ckstate::insert(tree->table(), par, *ti);
+    part.entries.resize(n);
+    for (uint64_t i = 0; i != n; ++i) {
+        ckp_loader::entry &e = part.entries[i];
+        e.value = ckstate::read(par, e.key, *ti);
+    }
 
-    munmap(p, sb.st_size);
     double t1 = now();
     printf("%.1f MB, %.2f sec, %.1f MB/sec\n",
            sb.st_size / 1000000.0,
@@ -1309,6 +2213,70 @@ kvepoch_t read_checkpoint(threadinfo *ti, const char *path) {
     return gen;
 }
 
+// build the leaves for this thread's checkpoint file.
+// leaves can't divide keys with the same top-layer ikey, so a file gives
+// up leading keys that share an ikey with the previous file's last key,
+// and takes on such keys from the files after it.
+static void
+build_checkpoint_leaves(threadinfo *ti)
+{
+    typedef ckp_loader::entry entry;
+    ckp_partition &part = rec_ckp_parts[ti->index()];
+    const entry *first = part.entries.data();
+    const entry *last = first + part.entries.size();
+    for (int j = ti->index() - 1; j >= 0 && first != last; --j)
+        if (!rec_ckp_parts[j].entries.empty()) {
+            uint64_t ikey = ckp_loader::ikey(rec_ckp_parts[j].entries.back().key);
+            while (first != last && ckp_loader::ikey(first->key) == ikey)
+                ++first;
+            break;
+        }
+    if (first == last)
+        return;
+
+    double t0 = now();
+    uint64_t ikey = ckp_loader::ikey(last[-1].key);
+    std::vector<entry> borrowed;
+    for (int j = ti->index() + 1; j < nckthreads; ++j) {
+        const std::vector<entry> &e = rec_ckp_parts[j].entries;
+        size_t k = 0;
+        while (k != e.size() && ckp_loader::ikey(e[k].key) == ikey)
+            ++k;
+        borrowed.insert(borrowed.end(), e.begin(), e.begin() + k);
+        if (k != e.size())
+            break;
+    }
+    if (!borrowed.empty()) {
+        const entry *group = last;
+        while (group != first && ckp_loader::ikey(group[-1].key) == ikey)
+            --group;
+        borrowed.insert(borrowed.begin(), group, last);
+        part.loader.add_leaves(first, group, *ti);
+        part.loader.add_leaves(borrowed.data(),
+                               borrowed.data() + borrowed.size(), *ti);
+    } else
+        part.loader.add_leaves(first, last, *ti);
+    printf("built %zu leaves, %.2f sec\n", part.loader.nleaves(), now() - t0);
+}
+
+// stitch the per-file leaf chains together and install the tree.
+static void
+install_checkpoint(threadinfo *ti)
+{
+    double t0 = now();
+    ckp_loader loader;
+    for (int i = 0; i < nckthreads; ++i)
+        loader.splice(rec_ckp_parts[i].loader, *ti);
+    if (!loader.empty())
+        loader.install(tree->table(), *ti);
+    for (int i = 0; i < nckthreads; ++i)
+        if (rec_ckp_parts[i].map)
+            munmap(rec_ckp_parts[i].map, rec_ckp_parts[i].mapsize);
+    delete[] rec_ckp_parts;
+    rec_ckp_parts = 0;
+    printf("installed checkpoint tree, %.2f sec\n", now() - t0);
+}
+
 void
 waituntilphase(int phase)
 {
@@ -1327,14 +2295,80 @@ inactive(void)
   always_assert(pthread_mutex_unlock(&rec_mu) == 0);
 }
 
+static void
+checkpoint_filename(char *path, uint64_t gen, int i)
+{
+    sprintf(path, "%s/kvd-ckp-%" PRId64 "-%d",
+            ckpdirs[i % ckpdirs.size()], gen, i);
+}
+
+// install one delta checkpoint row unless the tree has a newer version.
+// tombstones become remove markers, just as in log replay, so deltas can
+// be applied in any order.
+static void
+apply_checkpoint_row(Str key, row_slot<row_type>::type value, threadinfo &ti)
+{
+    typedef row_slot<row_type> slot;
+    Masstree::server_table::cursor_type lp(tree->table(), key);
+    bool found = lp.find_insert(ti);
+    if (found && !circular_int<kvtimestamp_t>::less(slot::row(lp.value())->timestamp(),
+                                                     slot::row(value)->timestamp()))
+        slot::row(value)->deallocate(ti);
+    else if (found) {
+        slot::row(lp.value())->deallocate(ti);
+        lp.assign_value(value);
+    } else
+        lp.value() = value;
+    lp.finish(1, ti);
+}
+
+// apply this thread's share of the delta checkpoint files.
+static void
+apply_checkpoint_deltas(threadinfo *ti)
+{
+    uint64_t n = 0;
+    double t0 = now();
+    for (uint64_t gen : rec_ckp_deltas)
+        for (int i = ti->index(); i < rec_ckp_nfiles; i += nckthreads) {
+            char path[256];
+            checkpoint_filename(path, gen, i);
+            ckp_partition part;
+            part.map = 0;
+            kvepoch_t g = read_checkpoint(ti, path, part);
+            always_assert(g == gen);
+            ti->rcu_start();
+            for (ckp_loader::entry &e : part.entries)
+                apply_checkpoint_row(e.key, e.value, *ti);
+            ti->rcu_stop();
+            n += part.entries.size();
+            munmap(part.map, part.mapsize);
+        }
+    if (n)
+        printf("applied %" PRIu64 " delta checkpoint rows, %.2f sec\n",
+               n, now() - t0);
+}
+
 void recovercheckpoint(threadinfo *ti) {
     waituntilphase(REC_CKP);
     char path[256];
-    sprintf(path, "%s/kvd-ckp-%" PRId64 "-%d",
-            ckpdirs[ti->index() % ckpdirs.size()],
-            ckp_gen.value(), ti->index());
-    kvepoch_t gen = read_checkpoint(ti, path);
-    always_assert(ckp_gen == gen);
+    checkpoint_filename(path, rec_ckp_base.value(), ti->index());
+    kvepoch_t gen = read_checkpoint(ti, path, rec_ckp_parts[ti->index()]);
+    always_assert(rec_ckp_base == gen);
+    inactive();
+
+    waituntilphase(REC_CKP_BUILD);
+    build_checkpoint_leaves(ti);
+    inactive();
+
+    waituntilphase(REC_CKP_DELTA);
+    apply_checkpoint_deltas(ti);
+    inactive();
+
+    // help apply log records
+    waituntilphase(REC_LOG_APPLY);
+    ti->rcu_start();
+    logreplay::apply(nlogger + ti->index(), ti);
+    ti->rcu_stop();
     inactive();
 }
 
@@ -1354,7 +2388,7 @@ recphase(int nactive, int state)
 // less than what was in the entry from the checkpoint file.
 // so we don't have to do an explicit merge by time of the log files.
 void
-recover(threadinfo *)
+recover(threadinfo *ti)
 {
   recovering = true;
   // XXX: discard temporary checkpoint and ckp-gen files generated before crash
@@ -1362,8 +2396,9 @@ recover(threadinfo *)
   // get the generation of the checkpoint from ckp-gen, if any
   char path[256];
   sprintf(path, "%s/kvd-ckp-gen", ckpdirs[0]);
-  ckp_gen = 0;
+  ckp_gen = rec_ckp_base = 0;
   rec_ckp_min_epoch = rec_ckp_max_epoch = 0;
+  rec_ckp_nfiles = 0;
   int fd = open(path, O_RDONLY);
   if (fd >= 0) {
       Json ckpj = Json::parse(read_file_contents(fd));
@@ -1372,15 +2407,32 @@ recover(threadinfo *)
           ckp_gen = ckpj["generation"].to_u64();
           rec_ckp_min_epoch = ckpj["min_epoch"].to_u64();
           rec_ckp_max_epoch = ckpj["max_epoch"].to_u64();
-          printf("recover from checkpoint %" PRIu64 " [%" PRIu64 ", %" PRIu64 "]\n", ckp_gen.value(), rec_ckp_min_epoch.value(), rec_ckp_max_epoch.value());
+          // a delta checkpoint names its full base and the deltas since
+          rec_ckp_base = ckpj["base"] ? ckpj["base"].to_u64() : ckp_gen.value();
+          for (int i = 0; i < ckpj["deltas"].size(); ++i)
+              rec_ckp_deltas.push_back(ckpj["deltas"][i].to_u64());
+          rec_ckp_nfiles = ckpj["nckthreads"].to_i();
+          ckp_manifest = ckpj;
+          printf("recover from checkpoint %" PRIu64 " [%" PRIu64 ", %" PRIu64 "]", ckp_gen.value(), rec_ckp_min_epoch.value(), rec_ckp_max_epoch.value());
+          if (!rec_ckp_deltas.empty())
+              printf(", base %" PRIu64 " + %zu deltas", rec_ckp_base.value(), rec_ckp_deltas.size());
+          printf("\n");
       }
   } else {
     printf("no %s\n", path);
   }
   always_assert(pthread_mutex_lock(&rec_mu) == 0);
 
-  // recover from checkpoint, and set timestamp of the checkpoint
+  // recover from checkpoint, and set timestamp of the checkpoint.
+  // each checkpoint file is sorted, and the files are disjoint, so the
+  // tree is bulk-loaded: files are read and built into leaves in
+  // parallel, then stitched together at the pivots.
+  rec_ckp_parts = new ckp_partition[nckthreads]();
   recphase(nckthreads, REC_CKP);
+  recphase(nckthreads, REC_CKP_BUILD);
+  install_checkpoint(ti);
+  // then apply delta checkpoints, in parallel
+  recphase(nckthreads, REC_CKP_DELTA);
 
   // find minimum maximum timestamp of entries in each log
   rec_log_infos = new logreplay::info_type[nlogger];
@@ -1469,10 +2521,23 @@ recover(threadinfo *)
               rec_ckp_min_epoch.value(), rec_ckp_max_epoch.value());
   }
 
-  // Actually replay.
+  // Actually replay: the loggers route their records by key hash, then
+  // the loggers and checkpoint threads apply them, then the loggers
+  // rewrite their logs.
   delete[] rec_log_infos;
   rec_log_infos = 0;
+  logreplay::prepare(nlogger, nlogger + nckthreads);
+  double t0 = now();
   recphase(nlogger, REC_LOG_REPLAY);
+  recphase(nlogger + nckthreads, REC_LOG_APPLY);
+  ti->rcu_start();
+  uint64_t nranged = logreplay::apply_ranges(ti);
+  ti->rcu_stop();
+  if (nranged)
+      printf("range tombstones removed %" PRIu64 " keys\n", nranged);
+  recphase(nlogger, REC_LOG_REWRITE);
+  logreplay::cleanup();
+  printf("replayed logs with %d workers, %.2f sec\n", nlogger + nckthreads, now() - t0);
 
   // done recovering
   recphase(0, REC_DONE);
@@ -1497,64 +2562,177 @@ recover(threadinfo *)
       exit(0);
 }
 
+typedef std::map<Str, row_slot<row_type>::type> ckp_rowmap;
+
+// write the rows in [c->startkey, c->endkey) to a checkpoint file, or
+// only those changed since c->min_ts plus the removed keys, or, if
+// rows is nonnull, exactly those rows.
 void
-writecheckpoint(const char *path, ckstate *c, double t0)
+writecheckpoint(const char *path, ckstate *c, threadinfo *ti,
+                const ckp_rowmap *rows = 0)
 {
-  double t1 = now();
-  printf("memory phase: %" PRIu64 " nodes, %.2f sec\n", c->count, t1 - t0);
-
-  int fd = creat(path, 0666);
+  double t0 = now();
+  int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+  if (ckp_direct)
+      flags |= O_DIRECT;
+#endif
+  int fd = open(path, flags, 0666);
+#ifdef O_DIRECT
+  if (fd < 0 && errno == EINVAL && ckp_direct) // e.g., tmpfs
+      fd = open(path, flags & ~O_DIRECT, 0666);
+#endif
   always_assert(fd >= 0);
+  c->writer = new ckwriter(fd, ckp_chunk_size, ckp_direct);
 
   // checkpoint file format, all msgpack:
   //   {"generation": generation, "size": size, ...}
   //   then `size` triples of key (string), timestmap (int), value (whatever)
-  Json j = Json().set("generation", ckp_gen.value())
-      .set("size", c->count)
-      .set("firstkey", c->startkey);
-  StringAccum sa;
-  msgpack::unparse(sa, j);
-  checked_write(fd, sa.data(), sa.length());
-  checked_write(fd, c->vals->buf, c->vals->n);
+  // A delta also has tombstones: key, odd timestamp, null.
+  // The size isn't known until the scan completes, so it is written
+  // wide and patched in place afterwards.
+  {
+      msgpack::unparser<kvout> up(*c->writer->out());
+      up << msgpack::object(4)
+         << Str("delta") << Json(rows || c->min_ts)
+         << Str("generation") << ckp_gen.value()
+         << Str("size");
+  }
+  off_t size_pos = c->writer->out()->n;
+  {
+      msgpack::unparser<kvout> up(*c->writer->out());
+      up.write_wide(uint64_t(0))
+         << Str("firstkey") << c->startkey;
+  }
+
+  // the writer flushes full chunks while the scan continues
+  if (rows)
+      for (auto &r : *rows)
+          c->write(r.first, row_slot<row_type>::row(r.second));
+  else {
+      tree->table().scan(c->startkey, true, *c, *ti);
+      if (c->min_ts) {
+          auto key_less = [](const ckp_tombstone &t, Str key) {
+              return Str(t.first) < key;
+          };
+          auto t = std::lower_bound(ckp_tombstones.begin(), ckp_tombstones.end(),
+                                    c->startkey, key_less);
+          auto tend = c->endkey ? std::lower_bound(t, ckp_tombstones.end(),
+                                                   c->endkey, key_less)
+              : ckp_tombstones.end();
+          for (; t != tend; ++t)
+              c->write_tombstone(t->first, t->second);
+      }
+  }
+  c->bytes = c->writer->finish();
+  double t1 = now();
 
+  char sizebuf[9];
+  msgpack::format::write_wide_int64(sizebuf, uint64_t(c->count));
+  ssize_t w = pwrite(fd, sizebuf, sizeof(sizebuf), size_pos);
+  always_assert(w == (ssize_t) sizeof(sizebuf));
   int ret = fsync(fd);
   always_assert(ret == 0);
   ret = close(fd);
   always_assert(ret == 0);
 
   double t2 = now();
-  c->bytes = c->vals->n;
-  printf("file phase (%s): %" PRIu64 " bytes, %.2f sec, %.1f MB/sec\n",
-         path,
-         c->bytes,
-         t2 - t1,
-         (c->bytes / 1000000.0) / (t2 - t1));
+  printf("checkpoint (%s%s): %" PRIu64 " nodes, %" PRIu64 " bytes, %.2f sec"
+         " (%.2f sec waiting for disk, %.2f sec fsync), %.1f MB/sec\n",
+         path, rows || c->min_ts ? ", delta" : "",
+         c->count, c->bytes, t2 - t0,
+         c->writer->stall_time(), t2 - t1,
+         (c->bytes / 1000000.0) / (t2 - t0));
+  delete c->writer;
+  c->writer = 0;
+}
+
+// merge this thread's files from the deltas in ckp_merge_gens, and the
+// delta just written to tmppath, into path. The newest version of each
+// key wins, tombstones included, since the base may still hold the key.
+static void
+merge_checkpoint_deltas(const char *path, const char *tmppath, ckstate *c,
+                        threadinfo *ti)
+{
+    size_t nparts = ckp_merge_gens.size() + 1;
+    ckp_partition *parts = new ckp_partition[nparts]();
+    typedef row_slot<row_type> slot;
+    ckp_rowmap rows;
+    for (size_t g = 0; g != nparts; ++g) {
+        char inpath[256];
+        if (g != nparts - 1)
+            checkpoint_filename(inpath, ckp_merge_gens[g], ti->index());
+        else
+            strcpy(inpath, tmppath);
+        read_checkpoint(ti, inpath, parts[g]);
+        for (ckp_loader::entry &e : parts[g].entries) {
+            auto it = rows.find(e.key);
+            if (it == rows.end())
+                rows.insert(std::make_pair(e.key, e.value));
+            else if (circular_int<kvtimestamp_t>::less(slot::row(it->second)->timestamp(),
+                                                       slot::row(e.value)->timestamp())) {
+                slot::row(it->second)->deallocate(*ti);
+                it->second = e.value;
+            } else
+                slot::row(e.value)->deallocate(*ti);
+        }
+    }
+
+    c->count = 0;
+    writecheckpoint(path, c, ti, &rows);
+    for (auto &r : rows)
+        slot::row(r.second)->deallocate(*ti);
+    for (size_t g = 0; g != nparts; ++g)
+        if (parts[g].map)
+            munmap(parts[g].map, parts[g].mapsize);
+    delete[] parts;
+    unlink(tmppath);
 }
 
 void
 conc_filecheckpoint(threadinfo *ti)
 {
     ckstate *c = &cks[ti->index()];
-    c->vals = new_bufkvout();
-    double t0 = now();
-    tree->table().scan(c->startkey, true, *c, *ti);
     char path[256];
-    sprintf(path, "%s/kvd-ckp-%" PRId64 "-%d",
-            ckpdirs[ti->index() % ckpdirs.size()],
-            ckp_gen.value(), ti->index());
-    writecheckpoint(path, c, t0);
+    checkpoint_filename(path, ckp_gen.value(), ti->index());
+    if (!ckp_merge_gens.empty()) {
+        char tmppath[sizeof(path) + 4];
+        sprintf(tmppath, "%s.tmp", path);
+        writecheckpoint(tmppath, c, ti);
+        merge_checkpoint_deltas(path, tmppath, c, ti);
+    } else
+        writecheckpoint(path, c, ti);
     c->count = 0;
-    free(c->vals);
 }
 
+// return the generations a checkpoint manifest depends on.
+static std::vector<uint64_t>
+checkpoint_generations(const Json &ckpj)
+{
+    std::vector<uint64_t> gens;
+    if (ckpj) {
+        gens.push_back(ckpj["base"] ? ckpj["base"].to_u64()
+                       : ckpj["generation"].to_u64());
+        for (int i = 0; i < ckpj["deltas"].size(); ++i)
+            gens.push_back(ckpj["deltas"][i].to_u64());
+    }
+    return gens;
+}
+
+// base is the generation of the full checkpoint this one builds on, or
+// this generation if it is full; deltas lists the delta generations
+// since base, ending with this one.
 static Json
-prepare_checkpoint(kvepoch_t min_epoch, int nckthreads, const Str *pv)
+prepare_checkpoint(kvepoch_t min_epoch, int nckthreads, const Str *pv,
+                   uint64_t base, const Json &deltas)
 {
     Json j;
     j.set("kvdb_checkpoint", true)
         .set("min_epoch", min_epoch.value())
         .set("max_epoch", global_log_epoch.value())
         .set("generation", ckp_gen.value())
+        .set("base", base)
+        .set("deltas", deltas)
         .set("nckthreads", nckthreads);
 
     Json pvj;
@@ -1578,14 +2756,19 @@ commit_checkpoint(Json ckpj)
             ckp_gen.value(), ckpj["min_epoch"].to_s().c_str(),
             ckpj["max_epoch"].to_s().c_str());
 
-    // delete old checkpoint files
-    for (int i = 0; i < nckthreads; i++) {
-        char path[256];
-        sprintf(path, "%s/kvd-ckp-%" PRId64 "-%d",
-                ckpdirs[i % ckpdirs.size()],
-                ckp_gen.value() - 1, i);
-        unlink(path);
-    }
+    // delete checkpoint files the new checkpoint doesn't depend on:
+    // everything after a full checkpoint, and merged deltas
+    std::vector<uint64_t> oldgens = checkpoint_generations(ckp_manifest),
+        newgens = checkpoint_generations(ckpj);
+    int nfiles = ckp_manifest["nckthreads"].to_i();
+    for (uint64_t gen : oldgens)
+        if (std::find(newgens.begin(), newgens.end(), gen) == newgens.end())
+            for (int i = 0; i < nfiles; i++) {
+                char path[256];
+                checkpoint_filename(path, gen, i);
+                unlink(path);
+            }
+    ckp_manifest = ckpj;
 }
 
 static kvepoch_t
@@ -1601,6 +2784,32 @@ max_flushed_epoch()
     return mfe;
 }
 
+// collect the keys removed so far, sorted, as this checkpoint's
+// tombstones. A full checkpoint doesn't need them, and frees them.
+static void
+collect_tombstones(bool full)
+{
+    ckp_tombstones.clear();
+    pthread_mutex_lock(&ckp_tombstone_mu);
+    for (ckp_tombstone_list *t : ckp_tombstone_lists) {
+        pthread_mutex_lock(&t->mu);
+        if (!full)
+            ckp_tombstones.insert(ckp_tombstones.end(),
+                                  t->removed.begin(), t->removed.end());
+        fetch_and_add(&ckp_ntombstones, -uint64_t(t->removed.size()));
+        if (full)
+            std::vector<ckp_tombstone>().swap(t->removed);
+        else
+            t->removed.clear();
+        pthread_mutex_unlock(&t->mu);
+    }
+    pthread_mutex_unlock(&ckp_tombstone_mu);
+    std::sort(ckp_tombstones.begin(), ckp_tombstones.end(),
+              [](const ckp_tombstone &a, const ckp_tombstone &b) {
+                  return Str(a.first) < Str(b.first);
+              });
+}
+
 // concurrent periodic checkpoint
 void* conc_checkpointer(void* x) {
   threadinfo* ti = reinterpret_cast<threadinfo*>(x);
@@ -1620,6 +2829,14 @@ void* conc_checkpointer(void* x) {
         ;
     Str *pv = new Str[nckthreads + 1];
     Json uncommitted_ckp;
+    // Delta checkpoints hold only rows and removes newer than the previous
+    // checkpoint's timestamp floor. Timestamps from before this run can't
+    // be compared with a floor, so the first checkpoint is full.
+    int since_full = -1;
+    kvtimestamp_t floor = 0;
+    ckp_deltas = ckp_full_every > 1
+        && checkpoint_interval <= ckp_delta_max_interval;
+    ckp_track_removes = ckp_deltas;
 
     while (1) {
       struct timespec ts;
@@ -1648,6 +2865,43 @@ void* conc_checkpointer(void* x) {
       }
 
       double t0 = now();
+      bool full = !ckp_deltas || since_full < 0
+          || since_full + 1 >= ckp_full_every;
+      kvtimestamp_t prev_floor = floor;
+      if (ckp_deltas) {
+          // Every write that starts after the floor is raised has a
+          // timestamp at least that large, and will go in the next
+          // delta. Wait for writes in flight, which might not, to finish
+          // so this checkpoint sees them.
+          floor = threadinfo::raise_timestamp_floor();
+          mrcu_epoch_type e = globalepoch;
+          while (mrcu_signed_epoch_type(threadinfo::min_active_epoch() - e) <= 0)
+              usleep(1000);
+          // removes older than the floor were all noted unless tracking
+          // stopped; then this checkpoint must be full
+          bool dropped = ckp_tombstones_dropped;
+          full = full || dropped;
+          collect_tombstones(full);
+          if (dropped) {
+              // later removes are in this checkpoint or noted
+              ckp_tombstones_dropped = false;
+              ckp_track_removes = true;
+          }
+      }
+      uint64_t gen = ckp_gen.next_nonzero().value(), base = gen;
+      Json deltas = Json::make_array();
+      ckp_merge_gens.clear();
+      if (!full) {
+          std::vector<uint64_t> gens = checkpoint_generations(ckp_manifest);
+          base = gens[0];
+          if (int(gens.size()) - 1 >= ckp_max_deltas)
+              ckp_merge_gens.assign(gens.begin() + 1, gens.end());
+          else
+              for (size_t i = 1; i < gens.size(); ++i)
+                  deltas.push_back(gens[i]);
+          deltas.push_back(gen);
+      }
+
       ti->rcu_start();
       for (int i = 0; i < nckthreads + 1; i++)
         pv[i].assign(NULL, 0);
@@ -1660,6 +2914,7 @@ void* conc_checkpointer(void* x) {
       for (int i = 0; i < nckthreads; i++) {
           cks[i].startkey = pv[i];
           cks[i].endkey = (i == nckthreads - 1 ? Str() : pv[i + 1]);
+          cks[i].min_ts = full ? 0 : prev_floor;
           cks[i].state = CKState_Go;
           pthread_cond_signal(&cks[i].state_cond);
       }
@@ -1679,15 +2934,19 @@ void* conc_checkpointer(void* x) {
       }
       pthread_mutex_unlock(&checkpoint_mu);
 
-      uncommitted_ckp = prepare_checkpoint(min_epoch, nckthreads, pv);
+      uncommitted_ckp = prepare_checkpoint(min_epoch, nckthreads, pv,
+                                           base, deltas);
+      since_full = full ? 0 : since_full + 1;
+      ckp_tombstones.clear();
 
       for (int i = 0; i < nckthreads + 1; i++)
         if (pv[i].s)
           free((void *)pv[i].s);
       double t = now() - t0;
-      fprintf(stderr, "kvd-ckp-%" PRIu64 " [%s,%s]: prepared (%.2f sec, %" PRIu64 " MB, %" PRIu64 " MB/sec)\n",
+      fprintf(stderr, "kvd-ckp-%" PRIu64 " [%s,%s]: prepared %s (%.2f sec, %" PRIu64 " MB, %" PRIu64 " MB/sec)\n",
               ckp_gen.value(), uncommitted_ckp["min_epoch"].to_s().c_str(),
               uncommitted_ckp["max_epoch"].to_s().c_str(),
+              full ? "full" : ckp_merge_gens.empty() ? "delta" : "merged delta",
               t, bytes / (1 << 20), (uint64_t)(bytes / t) >> 20);
     }
   } else {
@@ -87,6 +87,7 @@ static int tcpthreads = 0;
 
 static bool tree_stats = false;
 static bool json_stats = false;
+static int merge_fill = 0;
 static String gnuplot_yrange;
 static bool pinthreads = false;
 static nodeversion32 global_epoch_lock(false);
@@ -107,6 +108,12 @@ std::vector<mttest_numainfo> numa;
 volatile bool recovering = false; // so don't add log entries, and free old value immediately
 kvtimestamp_t initial_timestamp;
 
+// mttest threads have no logger, but query<R> refers to the log writer.
+uint64_t loginfo::record(int, const query_times&, Str, Str) {
+    always_assert(0 && "mttest doesn't log");
+    return 0;
+}
+
 static const char *threadcounter_names[(int) tc_max];
 
 /* running local tests */
@@ -133,6 +140,9 @@ void set_global_epoch(mrcu_epoch_type e) {
 template <typename T>
 struct kvtest_client {
     using table_type = T;
+    // integer-key tables store long keys as big-endian bytes
+    typedef typename std::conditional<T::parameters_type::ikey_only,
+                                      quick_bekey, quick_istr>::type ikey_string;
 
     kvtest_client()
         : limit_(test_limit), ncores_(udpthreads), kvo_() {
@@ -174,6 +184,16 @@ struct kvtest_client {
     int ncores() const {
         return ncores_;
     }
+    String row_type_name() const {
+        return row_type::name();
+    }
+    // leaves merged by this client's removes; null unless configured
+    // with --enable-counters
+    Json leaf_merges() const {
+        if (!ti_->has_counter(tc_leaf_merge))
+            return Json();
+        return Json(ti_->counter(tc_leaf_merge));
+    }
     double now() const {
         return ::now();
     }
@@ -190,8 +210,10 @@ struct kvtest_client {
     void get(long ikey);
     bool get_sync(Str key);
     bool get_sync(Str key, Str& value);
+    bool get_row_sync(Str key);
+    Json multiget_sync(const Str* keys, int n);
     bool get_sync(long ikey) {
-        quick_istr key(ikey);
+        ikey_string key(ikey);
         return get_sync(key.string());
     }
     bool get_sync_key16(long ikey) {
@@ -203,7 +225,8 @@ struct kvtest_client {
         get_check(Str(key), Str(expected));
     }
     void get_check(long ikey, long iexpected) {
-        quick_istr key(ikey), expected(iexpected);
+        ikey_string key(ikey);
+        quick_istr expected(iexpected);
         get_check(key.string(), expected.string());
     }
     void get_check(Str key, long iexpected) {
@@ -216,7 +239,8 @@ struct kvtest_client {
     }
     void get_col_check(Str key, int col, Str value);
     void get_col_check(long ikey, int col, long ivalue) {
-        quick_istr key(ikey), value(ivalue);
+        ikey_string key(ikey);
+        quick_istr value(ivalue);
         get_col_check(key.string(), col, value.string());
     }
     void get_col_check_key10(long ikey, int col, long ivalue) {
@@ -224,7 +248,7 @@ struct kvtest_client {
         get_col_check(key.string(), col, value.string());
     }
     void get_check_absent(Str key);
-    //void many_get_check(int nk, long ikey[], long iexpected[]);
+    void many_get_check(int nk, long ikey[], long iexpected[]);
 
     void scan_sync(Str firstkey, int n,
                    std::vector<Str>& keys, std::vector<Str>& values);
@@ -235,13 +259,17 @@ struct kvtest_client {
     const std::vector<uint64_t>& scan_versions() const {
         return scan_versions_;
     }
+    void scan_range_sync(Str firstkey, int n, const Json& options,
+                         std::vector<Str>& keys, std::vector<Str>& values);
 
     void put(Str key, Str value);
+    void put(Str key, Str value, int *status);
     void put(const char *key, const char *value) {
         put(Str(key), Str(value));
     }
     void put(long ikey, long ivalue) {
-        quick_istr key(ikey), value(ivalue);
+        ikey_string key(ikey);
+        quick_istr value(ivalue);
         put(key.string(), value.string());
     }
     void put(Str key, long ivalue) {
@@ -258,7 +286,8 @@ struct kvtest_client {
     }
     void put_col(Str key, int col, Str value);
     void put_col(long ikey, int col, long ivalue) {
-        quick_istr key(ikey), value(ivalue);
+        ikey_string key(ikey);
+        quick_istr value(ivalue);
         put_col(key.string(), col, value.string());
     }
     void put_col_key10(long ikey, int col, long ivalue) {
@@ -269,7 +298,7 @@ struct kvtest_client {
 
     void remove(Str key);
     void remove(long ikey) {
-        quick_istr key(ikey);
+        ikey_string key(ikey);
         remove(key.string());
     }
     void remove_key8(long ikey) {
@@ -282,10 +311,16 @@ struct kvtest_client {
     }
     bool remove_sync(Str key);
     bool remove_sync(long ikey) {
-        quick_istr key(ikey);
+        ikey_string key(ikey);
         return remove_sync(key.string());
     }
     void remove_check(Str key);
+    uint64_t remove_range_sync(Str first, Str last);
+
+    bool increment_sync(Str key, int col, int64_t delta, int64_t& value);
+    int append_sync(Str key, int col, Str suffix);
+    bool cas_sync(Str key, int col, const Json& expected, Str value,
+                  Json& current, uint64_t& ts);
 
     void print() {
         table_->print(stderr);
@@ -333,6 +368,10 @@ struct kvtest_client {
 
   private:
     void output_scan(const Json& req, std::vector<Str>& keys, std::vector<Str>& values) const;
+    void check_key(Str key) {
+        if (unlikely(!table_->table().key_fits(key)))
+            fail("key %s too long for %s\n", String(key).printable().c_str(), T::name());
+    }
 };
 
 static volatile int kvtest_printing;
@@ -350,7 +389,7 @@ template <typename T> inline void kvtest_json_stats(T& table, Json& j, threadinf
 
 template <typename T>
 void kvtest_client<T>::get(long ikey) {
-    quick_istr key(ikey);
+    ikey_string key(ikey);
     Str val;
     (void) q_[0].run_get1(table_->table(), key.string(), 0, val, *ti_);
 }
@@ -366,6 +405,20 @@ bool kvtest_client<T>::get_sync(Str key, Str& value) {
     return q_[0].run_get1(table_->table(), key, 0, value, *ti_);
 }
 
+template <typename T>
+bool kvtest_client<T>::get_row_sync(Str key) {
+    return q_[0].run_get_row(table_->table(), key, 0, 0, *ti_);
+}
+
+template <typename T>
+Json kvtest_client<T>::multiget_sync(const Str* keys, int n) {
+    req_ = Json::array(0, 0, Json::make_array_reserve(n));
+    for (int i = 0; i != n; ++i)
+        req_[2].push_back(keys[i]);
+    q_[0].run_multiget(table_->table(), req_, *ti_);
+    return req_[2];
+}
+
 template <typename T>
 void kvtest_client<T>::get_check(Str key, Str expected) {
     Str val;
@@ -402,24 +455,23 @@ void kvtest_client<T>::get_check_absent(Str key) {
     }
 }
 
-/*template <typename T>
+// check a batch of gets, interleaving their tree traversals.
+template <typename T>
 void kvtest_client<T>::many_get_check(int nk, long ikey[], long iexpected[]) {
-    std::vector<quick_istr> ka(2*nk, quick_istr());
-    for(int i = 0; i < nk; i++){
-      ka[i].set(ikey[i]);
-      ka[i+nk].set(iexpected[i]);
-      q_[i].begin_get1(ka[i].string());
-    }
-    table_->many_get(q_, nk, *ti_);
-    for(int i = 0; i < nk; i++){
-      Str val = q_[i].get1_value();
-      if (ka[i+nk] != val){
-        printf("get(%ld) returned unexpected value %.*s (expected %ld)\n",
-             ikey[i], std::min(val.len, 40), val.s, iexpected[i]);
-        exit(1);
-      }
-    }
-}*/
+    enum { max_batch = 64 };
+    always_assert(nk <= max_batch);
+    ikey_string ka[max_batch];
+    Str keys[max_batch];
+    for (int i = 0; i != nk; ++i) {
+        ka[i].set(ikey[i]);
+        keys[i] = ka[i].string();
+    }
+    table_->table().prefetch_paths(keys, nk, *ti_);
+    for (int i = 0; i != nk; ++i) {
+        quick_istr expected(iexpected[i]);
+        get_check(keys[i], expected.string());
+    }
+}
 
 template <typename T>
 void kvtest_client<T>::scan_sync(Str firstkey, int n,
@@ -449,6 +501,22 @@ void kvtest_client<T>::scan_versions_sync(Str firstkey, int n,
     output_scan(req_, keys, values);
 }
 
+template <typename T>
+void kvtest_client<T>::scan_range_sync(Str firstkey, int n,
+                                       const Json& options,
+                                       std::vector<Str>& keys,
+                                       std::vector<Str>& values) {
+    req_ = Json::array(0, 0, firstkey, n, options);
+    q_[0].run_scan(table_->table(), req_, *ti_);
+    if (options["keys"]) {
+        keys.clear();
+        values.clear();
+        for (int i = 2; i != req_.size(); ++i)
+            keys.push_back(req_[i].as_s());
+    } else
+        output_scan(req_, keys, values);
+}
+
 template <typename T>
 void kvtest_client<T>::output_scan(const Json& req, std::vector<Str>& keys,
                                    std::vector<Str>& values) const {
@@ -456,17 +524,27 @@ void kvtest_client<T>::output_scan(const Json& req, std::vector<Str>& keys,
     values.clear();
     for (int i = 2; i != req.size(); i += 2) {
         keys.push_back(req[i].as_s());
-        values.push_back(req[i + 1].as_s());
+        // rows with several columns report the first
+        values.push_back(req[i + 1].is_s() ? req[i + 1].as_s()
+                         : req[i + 1][0].as_s());
     }
 }
 
 template <typename T>
 void kvtest_client<T>::put(Str key, Str value) {
+    check_key(key);
     q_[0].run_replace(table_->table(), key, value, *ti_);
 }
 
+template <typename T>
+void kvtest_client<T>::put(Str key, Str value, int *status) {
+    check_key(key);
+    *status = q_[0].run_replace(table_->table(), key, value, *ti_);
+}
+
 template <typename T>
 void kvtest_client<T>::insert_check(Str key, Str value) {
+    check_key(key);
     if (unlikely(q_[0].run_replace(table_->table(), key, value, *ti_) != Inserted)) {
         fail("insert(%s) did not insert\n", String(key).printable().c_str());
     }
@@ -474,6 +552,7 @@ void kvtest_client<T>::insert_check(Str key, Str value) {
 
 template <typename T>
 void kvtest_client<T>::put_col(Str key, int col, Str value) {
+    check_key(key);
 #if !MASSTREE_ROW_TYPE_STR
     if (!kvo_) {
         kvo_ = new_kvout(-1, 2048);
@@ -507,6 +586,41 @@ void kvtest_client<T>::remove_check(Str key) {
     }
 }
 
+template <typename T>
+uint64_t kvtest_client<T>::remove_range_sync(Str first, Str last) {
+    auto note = [](Str, kvtimestamp_t) {};
+    return q_[0].run_remove_range(table_->table(), first, last, note, *ti_);
+}
+
+template <typename T>
+bool kvtest_client<T>::increment_sync(Str key, int col, int64_t delta,
+                                      int64_t& value) {
+    check_key(key);
+    req_ = Json::array(0, 0, key, col, delta);
+    q_[0].run_increment(table_->table(), req_, *ti_);
+    value = req_[2].as_i(0);
+    return !req_[2].is_null();
+}
+
+template <typename T>
+int kvtest_client<T>::append_sync(Str key, int col, Str suffix) {
+    check_key(key);
+    req_ = Json::array(0, 0, key, col, suffix);
+    q_[0].run_append(table_->table(), req_, *ti_);
+    return req_[2].as_i(-1);
+}
+
+template <typename T>
+bool kvtest_client<T>::cas_sync(Str key, int col, const Json& expected,
+                                Str value, Json& current, uint64_t& ts) {
+    check_key(key);
+    req_ = Json::array(0, 0, key, col, expected, value);
+    q_[0].run_cas(table_->table(), req_, *ti_);
+    current = req_[3];
+    ts = req_[4].to_u64();
+    return req_[2].to_b();
+}
+
 template <typename T>
 String kvtest_client<T>::make_message(lcdf::StringAccum &sa) const {
     const char *begin = sa.begin();
@@ -563,13 +677,14 @@ static pthread_mutex_t subtest_mutex;
 static pthread_cond_t subtest_cond;
 
 #define TESTRUNNER_CLIENT_TYPE kvtest_client<Masstree::default_table>&
+#define TESTRUNNER_CLIENT_TYPE_2 kvtest_client<Masstree::int_table>&
 #include "testrunner.hh"
 
 MAKE_TESTRUNNER(rw1, kvtest_rw1(client));
 // MAKE_TESTRUNNER(palma, kvtest_palma(client));
 // MAKE_TESTRUNNER(palmb, kvtest_palmb(client));
 MAKE_TESTRUNNER(rw1fixed, kvtest_rw1fixed(client));
-MAKE_TESTRUNNER(rw1long, kvtest_rw1long(client));
+MAKE_STRING_KEY_TESTRUNNER(rw1long, kvtest_rw1long(client));
 MAKE_TESTRUNNER(rw1puts, kvtest_rw1puts(client));
 MAKE_TESTRUNNER(rw2, kvtest_rw2(client));
 MAKE_TESTRUNNER(rw2fixed, kvtest_rw2fixed(client));
@@ -578,13 +693,14 @@ MAKE_TESTRUNNER(rw2fixedg90, kvtest_rw2fixedg90(client));
 MAKE_TESTRUNNER(rw2g98, kvtest_rw2g98(client));
 MAKE_TESTRUNNER(rw2fixedg98, kvtest_rw2fixedg98(client));
 MAKE_TESTRUNNER(rw3, kvtest_rw3(client));
-MAKE_TESTRUNNER(rw4, kvtest_rw4(client));
+MAKE_STRING_KEY_TESTRUNNER(rw4, kvtest_rw4(client));
 MAKE_TESTRUNNER(rw4fixed, kvtest_rw4fixed(client));
 MAKE_TESTRUNNER(wd1, kvtest_wd1(10000000, 1, client));
 MAKE_TESTRUNNER(wd1m1, kvtest_wd1(100000000, 1, client));
 MAKE_TESTRUNNER(wd1m2, kvtest_wd1(1000000000, 4, client));
 MAKE_TESTRUNNER(wd3, kvtest_wd3(client, 70 * client.nthreads()));
 MAKE_TESTRUNNER(same, kvtest_same(client));
+MAKE_TESTRUNNER(overwrite1, kvtest_overwrite1(client));
 MAKE_TESTRUNNER(rwsmall24, kvtest_rwsmall24(client));
 MAKE_TESTRUNNER(rwsep24, kvtest_rwsep24(client));
 MAKE_TESTRUNNER(wscale, kvtest_wscale(client));
@@ -592,19 +708,31 @@ MAKE_TESTRUNNER(ruscale_init, kvtest_ruscale_init(client));
 MAKE_TESTRUNNER(rscale, if (client.ti_->index() < ::rscale_ncores) kvtest_rscale(client));
 MAKE_TESTRUNNER(uscale, kvtest_uscale(client));
 MAKE_TESTRUNNER(bdb, kvtest_bdb(client));
-MAKE_TESTRUNNER(wcol1, kvtest_wcol1at(client, client.id() % 24, kvtest_first_seed + client.id() % 48, 5000000));
-MAKE_TESTRUNNER(rcol1, kvtest_rcol1at(client, client.id() % 24, kvtest_first_seed + client.id() % 48, 5000000));
-MAKE_TESTRUNNER(wcol1o1, kvtest_wcol1at(client, (client.id() + 1) % 24, kvtest_first_seed + client.id() % 48, 5000000));
-MAKE_TESTRUNNER(rcol1o1, kvtest_rcol1at(client, (client.id() + 1) % 24, kvtest_first_seed + client.id() % 48, 5000000));
-MAKE_TESTRUNNER(wcol1o2, kvtest_wcol1at(client, (client.id() + 2) % 24, kvtest_first_seed + client.id() % 48, 5000000));
-MAKE_TESTRUNNER(rcol1o2, kvtest_rcol1at(client, (client.id() + 2) % 24, kvtest_first_seed + client.id() % 48, 5000000));
+MAKE_STRING_KEY_TESTRUNNER(wcol1, kvtest_wcol1at(client, client.id() % 24, kvtest_first_seed + client.id() % 48, 5000000));
+MAKE_STRING_KEY_TESTRUNNER(rcol1, kvtest_rcol1at(client, client.id() % 24, kvtest_first_seed + client.id() % 48, 5000000));
+MAKE_STRING_KEY_TESTRUNNER(wcol1o1, kvtest_wcol1at(client, (client.id() + 1) % 24, kvtest_first_seed + client.id() % 48, 5000000));
+MAKE_STRING_KEY_TESTRUNNER(rcol1o1, kvtest_rcol1at(client, (client.id() + 1) % 24, kvtest_first_seed + client.id() % 48, 5000000));
+MAKE_STRING_KEY_TESTRUNNER(wcol1o2, kvtest_wcol1at(client, (client.id() + 2) % 24, kvtest_first_seed + client.id() % 48, 5000000));
+MAKE_STRING_KEY_TESTRUNNER(rcol1o2, kvtest_rcol1at(client, (client.id() + 2) % 24, kvtest_first_seed + client.id() % 48, 5000000));
 MAKE_TESTRUNNER(scan1, kvtest_scan1(client, 0));
 MAKE_TESTRUNNER(scan1q80, kvtest_scan1(client, 0.8));
 MAKE_TESTRUNNER(rscan1, kvtest_rscan1(client, 0));
 MAKE_TESTRUNNER(rscan1q80, kvtest_rscan1(client, 0.8));
-MAKE_TESTRUNNER(splitremove1, kvtest_splitremove1(client));
+MAKE_STRING_KEY_TESTRUNNER(splitremove1, kvtest_splitremove1(client));
 MAKE_TESTRUNNER(url, kvtest_url(client));
 MAKE_TESTRUNNER(conflictscan1, kvtest_conflictscan1(client));
+MAKE_STRING_KEY_TESTRUNNER(rmrange1, kvtest_rmrange1(client));
+MAKE_TESTRUNNER(rmw1, kvtest_rmw1(client));
+MAKE_STRING_KEY_TESTRUNNER(vlen1, kvtest_vlen1(client));
+MAKE_STRING_KEY_TESTRUNNER(scanrange1, kvtest_scanrange1(client));
+MAKE_STRING_KEY_TESTRUNNER(multiget1, kvtest_multiget1(client));
+MAKE_STRING_KEY_TESTRUNNER(merge1, kvtest_merge1(client));
+MAKE_STRING_KEY_TESTRUNNER(ycsba, kvtest_ycsb(client, 'a'));
+MAKE_STRING_KEY_TESTRUNNER(ycsbb, kvtest_ycsb(client, 'b'));
+MAKE_STRING_KEY_TESTRUNNER(ycsbc, kvtest_ycsb(client, 'c'));
+MAKE_STRING_KEY_TESTRUNNER(ycsbd, kvtest_ycsb(client, 'd'));
+MAKE_STRING_KEY_TESTRUNNER(ycsbe, kvtest_ycsb(client, 'e'));
+MAKE_STRING_KEY_TESTRUNNER(ycsbf, kvtest_ycsb(client, 'f'));
 
 
 enum {
@@ -627,6 +755,7 @@ struct test_thread {
             assert(!table_);
             table_ = new T;
             table_->initialize(*ti);
+            table_->table().set_merge_fill(merge_fill);
         } else if (action == test_thread_destroy) {
             assert(table_);
             delete table_;
@@ -713,17 +842,20 @@ template <typename T> T* test_thread<T>::table_;
 template <typename T> unsigned test_thread<T>::active_threads_;
 
 typedef test_thread<Masstree::default_table> masstree_test_thread;
+typedef test_thread<Masstree::int_table> int_masstree_test_thread;
 
 static struct {
     const char *treetype;
     void* (*go_func)(void*);
     void (*setup_func)(threadinfo*, int);
+    bool int_keys;
 } test_thread_map[] = {
-    { "masstree", masstree_test_thread::go, masstree_test_thread::setup },
-    { "mass", masstree_test_thread::go, masstree_test_thread::setup },
-    { "mbtree", masstree_test_thread::go, masstree_test_thread::setup },
-    { "mb", masstree_test_thread::go, masstree_test_thread::setup },
-    { "m", masstree_test_thread::go, masstree_test_thread::setup }
+    { "masstree", masstree_test_thread::go, masstree_test_thread::setup, false },
+    { "mass", masstree_test_thread::go, masstree_test_thread::setup, false },
+    { "mbtree", masstree_test_thread::go, masstree_test_thread::setup, false },
+    { "mb", masstree_test_thread::go, masstree_test_thread::setup, false },
+    { "m", masstree_test_thread::go, masstree_test_thread::setup, false },
+    { "mbint", int_masstree_test_thread::go, int_masstree_test_thread::setup, true }
 };
 
 
@@ -773,7 +905,7 @@ enum { opt_pin = 1, opt_port, opt_duration,
        opt_test, opt_test_name, opt_threads, opt_trials, opt_quiet, opt_print,
        opt_normalize, opt_limit, opt_notebook, opt_compare, opt_no_run,
        opt_gid, opt_tree_stats, opt_rscale_ncores, opt_cores,
-       opt_stats, opt_help, opt_yrange };
+       opt_stats, opt_help, opt_yrange, opt_merge_fill };
 static const Clp_Option options[] = {
     { "pin", 'p', opt_pin, 0, Clp_Negate },
     { "port", 0, opt_port, Clp_ValInt, 0 },
@@ -798,6 +930,7 @@ static const Clp_Option options[] = {
     { "compare", 'c', opt_compare, Clp_ValString, 0 },
     { "cores", 0, opt_cores, Clp_ValString, 0 },
     { "yrange", 0, opt_yrange, Clp_ValString, 0 },
+    { "merge-fill", 0, opt_merge_fill, Clp_ValInt, 0 },
     { "no-run", 'n', opt_no_run, 0, 0 },
     { "help", 0, opt_help, 0, 0 }
 };
@@ -817,6 +950,7 @@ Options:\n\
   -b, --notebook=FILE      Record JSON results in FILE (notebook-mttest.json).\n\
       --no-notebook        Do not record JSON results.\n\
       --print              Print table after test.\n\
+      --merge-fill=N       Merge leaves left with N or fewer keys by a remove.\n\
 \n\
   -n, --no-run             Do not run new tests.\n\
   -c, --compare=EXPERIMENT Generated plot compares to EXPERIMENT.\n\
@@ -826,12 +960,32 @@ Known TESTs:\n",
            (int) sysconf(_SC_NPROCESSORS_ONLN));
     testrunner_base::print_names(stdout, 5);
     printf("Or say TEST1,TEST2,... to run several tests in sequence\n\
-on the same tree.\n");
+on the same tree. Give a tree type, mb (the default) or mbint, to choose\n\
+the table; mbint holds keys of at most 8 bytes and stores integer keys\n\
+in big-endian order. Tests with longer string keys are rejected on mbint.\n");
     exit(0);
 }
 
 static void run_one_test(int trial, const char *treetype, const char *test,
                          const int *collectorpipe, int nruns);
+
+// Return the first test needing string keys among tests, each of which
+// may be a comma-separated sequence, or null if there is none.
+static testrunner* find_string_key_test(const std::vector<const char*>& tests) {
+    for (const char* test : tests) {
+        String t(test);
+        for (int pos = 0; pos < t.length(); ) {
+            int comma = t.find_left(',', pos);
+            comma = (comma < 0 ? t.length() : comma);
+            testrunner* tr = testrunner::find(t.substr(pos, comma - pos));
+            if (tr && tr->string_keys())
+                return tr;
+            pos = comma + 1;
+        }
+    }
+    return 0;
+}
+
 enum { normtype_none, normtype_pertest, normtype_firsttest };
 static void print_gnuplot(FILE *f, const char * const *types_begin, const char * const *types_end, std::vector<String> &comparisons, int normalizetype);
 static void update_labnotebook(String notebook);
@@ -866,6 +1020,10 @@ main(int argc, char *argv[])
     threadcounter_names[(int) tc_stable_internode_split] = "stable_internode_split";
     threadcounter_names[(int) tc_stable_leaf_insert] = "stable_leaf_insert";
     threadcounter_names[(int) tc_stable_leaf_split] = "stable_leaf_split";
+    threadcounter_names[(int) tc_leaf_merge] = "leaf_merge";
+    threadcounter_names[(int) tc_leaf_merge_skip] = "leaf_merge_skip";
+    threadcounter_names[(int) tc_finger_hit] = "finger_hit";
+    threadcounter_names[(int) tc_finger_miss] = "finger_miss";
     threadcounter_names[(int) tc_internode_lock] = "internode_lock_retry";
     threadcounter_names[(int) tc_leaf_lock] = "leaf_lock_retry";
 
@@ -931,6 +1089,9 @@ main(int argc, char *argv[])
         case opt_stats:
             json_stats = true;
             break;
+        case opt_merge_fill:
+            merge_fill = clp->val.i;
+            break;
         case opt_yrange:
             gnuplot_yrange = clp->vstr;
             break;
@@ -1030,6 +1191,16 @@ Try 'mttest --help' for options.\n");
         treetypes.push_back("m");
     if (tests.empty())
         tests.push_back("rw1");
+    // reject string-key tests on integer-key tables before running anything
+    for (const char* treetype : treetypes)
+        for (int i = 0; i < (int) arraysize(test_thread_map); ++i)
+            if (test_thread_map[i].int_keys
+                && strcmp(test_thread_map[i].treetype, treetype) == 0)
+                if (testrunner* tr = find_string_key_test(tests)) {
+                    fprintf(stderr, "mttest: test %s uses string keys, which table %s does not support\n",
+                            tr->name().c_str(), treetype);
+                    exit(EXIT_FAILURE);
+                }
 
     pthread_mutex_init(&subtest_mutex, 0);
     pthread_cond_init(&subtest_cond, 0);
@@ -182,7 +182,7 @@ struct scan_tester {
     template <typename SS, typename K>
     void visit_leaf(const SS&, const K&, threadinfo&) {
     }
-    bool visit_value(Str key, row_type*, threadinfo&) {
+    bool visit_value(Str key, const row_slot<row_type>::type&, threadinfo&) {
         memcpy(key_, key.s, key.len);
         keylen_ = key.len;
         const char *pos = (reverse_ ? vend_[-1] : vbegin_[0]);
@@ -338,5 +338,7 @@ void query_table<P>::print(FILE* f) const {
 
 template class basic_table<default_table::parameters_type>;
 template class query_table<default_table::parameters_type>;
+template class basic_table<int_table::parameters_type>;
+template class query_table<int_table::parameters_type>;
 
 }
@@ -64,7 +64,7 @@ class query_table {
     static void test(threadinfo& ti);
 
     static const char* name() {
-        return "mb";
+        return P::ikey_only ? "mbint" : "mb";
     }
 
   private:
@@ -72,12 +72,26 @@ class query_table {
 };
 
 struct default_query_table_params : public nodeparams<15, 15> {
-    typedef row_type* value_type;
+    typedef row_slot<row_type>::type value_type;
     typedef value_print<value_type> value_print_type;
     typedef ::threadinfo threadinfo_type;
 };
 
 typedef query_table<default_query_table_params> default_table;
 
+// For keys of at most 8 bytes, such as big-endian integers: no key
+// suffixes, no layers.
+struct int_query_table_params : public default_query_table_params {
+    static constexpr bool ikey_only = true;
+};
+
+typedef query_table<int_query_table_params> int_table;
+
+#if MASSTREE_SERVER_TABLE_INT
+typedef int_table server_table;
+#else
+typedef default_table server_table;
+#endif
+
 } // namespace Masstree
 #endif
@@ -0,0 +1,68 @@
+/* Masstree
+ * Eddie Kohler, Yandong Mao, Robert Morris
+ * Copyright (c) 2012-2014 President and Fellows of Harvard College
+ * Copyright (c) 2012-2014 Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Masstree LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Masstree LICENSE file; the license in that file
+ * is legally binding.
+ */
+#ifndef ROWVERSION_HH
+#define ROWVERSION_HH
+#include "compiler.hh"
+
+// Per-row seqlock for rows that are updated in place. Writers (who hold
+// the row's leaf lock) set dirty, modify the row, and bump the counter;
+// readers copy the row between stable() and has_changed().
+struct rowversion {
+    rowversion() {
+        v_.u = 0;
+    }
+    bool dirty() {
+        return v_.dirty;
+    }
+    void setdirty() {
+        v_.u = v_.u | 0x80000000;
+    }
+    void clear() {
+        v_.u = v_.u & 0x7fffffff;
+    }
+    void clearandbump() {
+        v_.u = (v_.u + 1) & 0x7fffffff;
+    }
+    rowversion stable() const {
+        value_t x = v_;
+        while (x.dirty) {
+            relax_fence();
+            x = v_;
+        }
+        acquire_fence();
+        return x;
+    }
+    bool has_changed(rowversion x) const {
+        fence();
+        return x.v_.ctr != v_.ctr;
+    }
+  private:
+    union value_t {
+        struct {
+            uint32_t ctr:31;
+            uint32_t dirty:1;
+        };
+        uint32_t u;
+    };
+    value_t v_;
+
+    rowversion(value_t v)
+        : v_(v) {
+    }
+
+};
+
+#endif
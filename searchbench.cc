@@ -0,0 +1,173 @@
+/* Masstree
+ * Eddie Kohler, Yandong Mao, Robert Morris
+ * Copyright (c) 2012-2014 President and Fellows of Harvard College
+ * Copyright (c) 2012-2014 Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Masstree LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Masstree LICENSE file; the license in that file
+ * is legally binding.
+ */
+// Microbenchmark for the node search methods (ksearch.hh).
+// Builds one tree per bound method from the same keys, checks that every
+// method finds the same positions, then times lookups.
+//
+// usage: searchbench [NKEYS [NLOOKUPS [KEYLEN]]]
+
+#include "masstree.hh"
+#include "kvthread.hh"
+#include "masstree_tcursor.hh"
+#include "masstree_insert.hh"
+#include "masstree_remove.hh"
+#include "masstree_print.hh"
+#include "kvrandom.hh"
+#include "string.hh"
+#include "straccum.hh"
+#include <set>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+volatile mrcu_epoch_type active_epoch = 1;
+volatile uint64_t globalepoch = 1;
+volatile bool recovering = false;
+
+template <int M> struct search_params : public Masstree::nodeparams<15, 15> {
+    static constexpr int bound_method = M;
+    typedef uint64_t value_type;
+    typedef Masstree::value_print<value_type> value_print_type;
+    typedef ::threadinfo threadinfo_type;
+};
+
+static const char* const method_names[] = {
+    "fast", "binary", "linear", "simd"
+};
+
+template <int M>
+class search_tester {
+  public:
+    typedef search_params<M> params_type;
+    typedef Masstree::basic_table<params_type> table_type;
+    typedef Masstree::leaf<params_type> leaf_type;
+    typedef Masstree::internode<params_type> internode_type;
+    typedef typename leaf_type::key_type key_type;
+
+    search_tester(const std::vector<lcdf::String>& keys, threadinfo& ti)
+        : keys_(keys), ti_(ti) {
+        table_.initialize(ti);
+        for (size_t i = 0; i != keys.size(); ++i) {
+            Masstree::tcursor<params_type> lp(table_, keys[i]);
+            lp.find_insert(ti);
+            lp.value() = i;
+            lp.finish(1, ti);
+        }
+    }
+
+    // Search every leaf and internode on the path to each key, with both
+    // this method and the reference binary search.
+    bool check(const std::vector<lcdf::String>& probes) const {
+        for (auto& k : probes) {
+            key_type ka(k);
+            const Masstree::node_base<params_type>* n = table_.root();
+            while (!n->is_root())
+                n = n->maybe_parent();
+            while (!n->isleaf()) {
+                const internode_type* in = static_cast<const internode_type*>(n);
+                int a = internode_type::bound_type::upper(ka, *in);
+                int b = key_bound_binary::upper(ka, *in);
+                if (a != b)
+                    return report(k, "internode", a, b);
+                n = in->child_[a];
+            }
+            const leaf_type* lf = static_cast<const leaf_type*>(n);
+            key_indexed_position a = leaf_type::bound_type::lower(ka, *lf);
+            key_indexed_position b = key_bound_binary::lower(ka, *lf);
+            if (a.i != b.i || a.p != b.p)
+                return report(k, "leaf", a.i, b.i);
+        }
+        return true;
+    }
+
+    double run(const std::vector<int>& order) const {
+        uint64_t sum = 0;
+        double t0 = now();
+        for (int i : order) {
+            Masstree::unlocked_tcursor<params_type> lp(table_, keys_[i]);
+            if (lp.find_unlocked(ti_))
+                sum += lp.value();
+        }
+        double t1 = now();
+        always_assert(sum == expected(order));
+        return (t1 - t0) * 1e9 / order.size();
+    }
+
+  private:
+    table_type table_;
+    const std::vector<lcdf::String>& keys_;
+    threadinfo& ti_;
+
+    static uint64_t expected(const std::vector<int>& order) {
+        uint64_t sum = 0;
+        for (int i : order)
+            sum += i;
+        return sum;
+    }
+    static bool report(const lcdf::String& k, const char* where, int a, int b) {
+        fprintf(stderr, "%s: %s mismatch on %s: %d vs. %d\n",
+                method_names[M], where, k.printable().c_str(), a, b);
+        return false;
+    }
+};
+
+template <int M>
+static bool run_method(const std::vector<lcdf::String>& keys,
+                       const std::vector<lcdf::String>& probes,
+                       const std::vector<int>& order, threadinfo& ti) {
+    search_tester<M> t(keys, ti);
+    if (!t.check(probes))
+        return false;
+    t.run(order);               // warm up
+    double ns = t.run(order);
+    printf("%-8s %8.1f ns/lookup\n", method_names[M], ns);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int nkeys = argc > 1 ? atoi(argv[1]) : 1000000;
+    int nlookups = argc > 2 ? atoi(argv[2]) : 4000000;
+    int keylen = argc > 3 ? atoi(argv[3]) : 8;
+    always_assert(nkeys > 0 && nlookups > 0 && keylen > 0);
+
+    threadinfo* ti = threadinfo::make(threadinfo::TI_MAIN, -1);
+    kvrandom_psdes_nr rand(8472);
+    std::vector<lcdf::String> keys, probes;
+    std::set<lcdf::String> seen;
+    while (int(keys.size()) != nkeys) {
+        lcdf::StringAccum sa;
+        for (int j = 0; j != keylen; ++j)
+            sa << char(rand());
+        auto it = seen.insert(sa.take_string());
+        if (it.second)
+            keys.push_back(*it.first);
+    }
+    // probes include existing keys, their prefixes, and extensions
+    for (int i = 0; i < nkeys; i += 7) {
+        probes.push_back(keys[i]);
+        probes.push_back(keys[i].substr(0, rand() % keylen));
+        probes.push_back(keys[i] + lcdf::String(char(rand())));
+    }
+    std::vector<int> order;
+    for (int i = 0; i != nlookups; ++i)
+        order.push_back(rand() % nkeys);
+
+    printf("%d keys of length %d, %d lookups\n", nkeys, keylen, nlookups);
+    bool ok = run_method<bound_method_binary>(keys, probes, order, *ti)
+        && run_method<bound_method_linear>(keys, probes, order, *ti)
+        && run_method<bound_method_simd>(keys, probes, order, *ti);
+    return ok ? 0 : 1;
+}
@@ -5,8 +5,8 @@
 
 class testrunner_base {
 public:
-    testrunner_base(const lcdf::String& name)
-        : name_(name), next_(0) {
+    testrunner_base(const lcdf::String& name, bool string_keys = false)
+        : name_(name), string_keys_(string_keys), next_(0) {
         thehead ? thetail->next_ = this : thehead = this;
         thetail = this;
     }
@@ -15,6 +15,10 @@ public:
     const lcdf::String& name() const {
         return name_;
     }
+    // true if the test's keys don't fit an integer-key table
+    bool string_keys() const {
+        return string_keys_;
+    }
     static testrunner_base* first() {
         return thehead;
     }
@@ -29,6 +33,7 @@ private:
     static testrunner_base* thehead;
     static testrunner_base* thetail;
     lcdf::String name_;
+    bool string_keys_;
     testrunner_base* next_;
 };
 
@@ -36,8 +41,8 @@ private:
 
 class testrunner : public testrunner_base {
 public:
-    inline testrunner(const lcdf::String& name)
-        : testrunner_base(name) {
+    inline testrunner(const lcdf::String& name, bool string_keys = false)
+        : testrunner_base(name, string_keys) {
     }
     static testrunner* first() {
         return static_cast<testrunner*>(testrunner_base::first());
@@ -46,14 +51,41 @@ public:
         return static_cast<testrunner*>(testrunner_base::find(name));
     }
     virtual void run(TESTRUNNER_CLIENT_TYPE) = 0;
+#ifdef TESTRUNNER_CLIENT_TYPE_2
+    virtual void run(TESTRUNNER_CLIENT_TYPE_2) = 0;
+#endif
 };
 
+// Programs whose tests run against two client types define
+// TESTRUNNER_CLIENT_TYPE_2 as well; each test is compiled for both.
+// String-key tests aren't compiled for the second type; the program
+// rejects them before running (see string_keys()).
+#ifdef TESTRUNNER_CLIENT_TYPE_2
+#define TESTRUNNER_RUN_2(text) \
+        void run(TESTRUNNER_CLIENT_TYPE_2 client) { text; client.finish(); }
+#define TESTRUNNER_RUN_2_UNSUPPORTED \
+        void run(TESTRUNNER_CLIENT_TYPE_2) { always_assert(0); }
+#else
+#define TESTRUNNER_RUN_2(text)
+#define TESTRUNNER_RUN_2_UNSUPPORTED
+#endif
+
 #define MAKE_TESTRUNNER(name, text)                    \
     namespace {                                        \
     class testrunner_##name : public testrunner {      \
     public:                                            \
         testrunner_##name() : testrunner(#name) {}     \
         void run(TESTRUNNER_CLIENT_TYPE client) { text; client.finish(); } \
+        TESTRUNNER_RUN_2(text)                         \
+    }; static testrunner_##name testrunner_##name##_instance; }
+
+#define MAKE_STRING_KEY_TESTRUNNER(name, text)         \
+    namespace {                                        \
+    class testrunner_##name : public testrunner {      \
+    public:                                            \
+        testrunner_##name() : testrunner(#name, true) {} \
+        void run(TESTRUNNER_CLIENT_TYPE client) { text; client.finish(); } \
+        TESTRUNNER_RUN_2_UNSUPPORTED                   \
     }; static testrunner_##name testrunner_##name##_instance; }
 
 #endif
@@ -160,6 +160,90 @@ private:
     }
 };
 
+// Counters stored inline in a 16-byte leaf slot. Readers check that no
+// update was seen half-written.
+class InlineValueWrapper {
+public:
+    static constexpr uint64_t nkeys = 64;
+    struct counter {
+        uint64_t count;
+        uint64_t check;
+    };
+    struct table_params : public Masstree::nodeparams<15,15> {
+        typedef counter value_type;
+        typedef threadinfo threadinfo_type;
+        typedef key_unparse_unsigned key_unparse_type;
+    };
+
+    typedef Masstree::Str Str;
+    typedef Masstree::basic_table<table_params> table_type;
+    typedef Masstree::unlocked_tcursor<table_params> unlocked_cursor_type;
+    typedef Masstree::tcursor<table_params> cursor_type;
+
+    InlineValueWrapper() {
+        always_assert(Masstree::leafvalue<table_params>(counter{0, 1}),
+                      "a slot whose first word is zero isn't empty");
+        always_assert(Masstree::leafvalue<table_params>::make_empty().empty(),
+                      "empty slots are empty");
+        table_.initialize(*MasstreeWrapper::ti);
+        for (uint64_t k = 0; k != nkeys; ++k) {
+            uint64_t key_buf;
+            cursor_type lp(table_, make_key(k, key_buf));
+            bool found = lp.find_insert(*MasstreeWrapper::ti);
+            always_assert(!found, "keys should all be unique");
+            lp.value() = counter{0, ~uint64_t(0)};
+            lp.finish(1, *MasstreeWrapper::ti);
+        }
+    }
+
+    void update_test(int thread_id, int nupdates) {
+        std::mt19937 gen(thread_id);
+        for (int i = 0; i != nupdates; ++i) {
+            uint64_t key_buf;
+            cursor_type lp(table_, make_key(gen() % nkeys, key_buf));
+            bool found = lp.find_locked(*MasstreeWrapper::ti);
+            always_assert(found, "keys must all exist");
+            counter c = lp.value();
+            ++c.count;
+            c.check = ~c.count;
+            lp.assign_value(c);
+            lp.finish(0, *MasstreeWrapper::ti);
+        }
+    }
+
+    void read_test(int thread_id, const volatile bool& done) {
+        std::mt19937 gen(thread_id);
+        while (!done) {
+            uint64_t key_buf;
+            unlocked_cursor_type lp(table_, make_key(gen() % nkeys, key_buf));
+            bool found = lp.find_unlocked(*MasstreeWrapper::ti);
+            always_assert(found, "keys must all exist");
+            counter c = lp.value();
+            always_assert(c.check == ~c.count, "torn inline value");
+        }
+    }
+
+    uint64_t total() {
+        uint64_t sum = 0;
+        for (uint64_t k = 0; k != nkeys; ++k) {
+            uint64_t key_buf;
+            counter c;
+            bool found = table_.get(make_key(k, key_buf), c, *MasstreeWrapper::ti);
+            always_assert(found, "keys must all exist");
+            sum += c.count;
+        }
+        return sum;
+    }
+
+private:
+    table_type table_;
+
+    static inline Str make_key(uint64_t int_key, uint64_t& key_buf) {
+        key_buf = __builtin_bswap64(int_key);
+        return Str((const char *)&key_buf, sizeof(key_buf));
+    }
+};
+
 __thread typename MasstreeWrapper::table_params::threadinfo_type* MasstreeWrapper::ti = nullptr;
 bool MasstreeWrapper::stopping = false;
 uint32_t MasstreeWrapper::printing = 0;
@@ -185,6 +269,28 @@ int main() {
     for (auto& t : ths)
         t.join();
 
+    std::cout << "inline_value_test..." << std::endl;
+    auto iv = new InlineValueWrapper();
+    constexpr int nupdates = 20000;
+    volatile bool done = false;
+    std::vector<std::thread> readers, writers;
+    for (int i = 0; i < 4; ++i)
+        readers.emplace_back([=, &done] {
+                MasstreeWrapper::thread_init(NUM_THREADS + i);
+                iv->read_test(i, done);
+            });
+    for (int i = 0; i < 4; ++i)
+        writers.emplace_back([=] {
+                MasstreeWrapper::thread_init(NUM_THREADS + 4 + i);
+                iv->update_test(i, nupdates);
+            });
+    for (auto& t : writers)
+        t.join();
+    done = true;
+    for (auto& t : readers)
+        t.join();
+    always_assert(iv->total() == 4 * nupdates, "lost inline updates");
+
     std::cout << "test pass." << std::endl;
     return 0;
 }
@@ -17,6 +17,7 @@
 #define VALUE_BAG_HH
 #include "kvthread.hh"
 #include "json.hh"
+#include "rowversion.hh"
 
 template <typename O>
 class value_bag {
@@ -57,6 +58,9 @@ class value_bag {
     template <typename ALLOC>
     inline value_bag<O>* update(int col, Str value,
                                 kvtimestamp_t ts, ALLOC& ti) const;
+    inline bool update_in_place(const Json* first, const Json* last,
+                                kvtimestamp_t ts);
+    inline void snapshot(value_bag<O>* dst) const;
     template <typename ALLOC>
     static value_bag<O>* create(const Json* first, const Json* last,
                                 kvtimestamp_t ts, ALLOC& ti);
@@ -78,9 +82,56 @@ class value_bag {
 
   private:
     kvtimestamp_t ts_;
+    rowversion ver_;
     bagdata d_;
+
+    static constexpr size_t header_size = sizeof(kvtimestamp_t) + sizeof(rowversion);
 };
 
+template <typename R> struct query_helper;
+
+// Readers copy rows before using them, since update_in_place() may
+// change a row's columns under them. The copy lives until the next
+// snapshot(); column() returns strings that outlive it.
+template <typename O>
+struct query_helper<value_bag<O> > {
+    typedef lcdf::Json Json;
+    value_bag<O>* snapshot_;
+    size_t capacity_;
+
+    query_helper()
+        : snapshot_(), capacity_(0) {
+    }
+    query_helper(const query_helper<value_bag<O> >&)
+        : snapshot_(), capacity_(0) {
+    }
+    ~query_helper() {
+        free(snapshot_);
+    }
+    inline const value_bag<O>* snapshot(const value_bag<O>* row,
+                                        const std::vector<typename value_bag<O>::index_type>&,
+                                        threadinfo&) {
+        if (row->size() > capacity_) {
+            capacity_ = std::max(row->size(), 2 * capacity_);
+            free(snapshot_);
+            snapshot_ = (value_bag<O>*) malloc(capacity_);
+        }
+        row->snapshot(snapshot_);
+        return snapshot_;
+    }
+    static inline lcdf::String column(lcdf::Str col) {
+        return lcdf::String(col);
+    }
+    inline value_bag<O>* update(value_bag<O>* row, const Json* first,
+                                const Json* last, kvtimestamp_t ts,
+                                threadinfo& ti) {
+        if (row->update_in_place(first, last, ts))
+            return row;
+        return row->update(first, last, ts, ti);
+    }
+  private:
+    query_helper<value_bag<O> >& operator=(const query_helper<value_bag<O> >&);
+};
 
 template <typename O>
 inline value_bag<O>::value_bag()
@@ -96,7 +147,7 @@ inline kvtimestamp_t value_bag<O>::timestamp() const {
 
 template <typename O>
 inline size_t value_bag<O>::size() const {
-    return sizeof(kvtimestamp_t) + d_.pos_[d_.ncol_];
+    return header_size + d_.pos_[d_.ncol_];
 }
 
 template <typename O>
@@ -154,11 +205,12 @@ value_bag<O>* value_bag<O>::update(const Json* first, const Json* last,
 
     value_bag<O>* row = (value_bag<O>*) ti.allocate(sz, memtag_value);
     row->ts_ = ts;
+    row->ver_ = rowversion();
 
     // Minor optimization: Replacing one small column without changing length
     if (ncol == d_.ncol_ && sz == size() && first + 2 == last
         && first[1].as_s().length() <= 16) {
-        memcpy(row->d_.s_, d_.s_, sz - sizeof(kvtimestamp_t));
+        memcpy(row->d_.s_, d_.s_, sz - header_size);
         memcpy(row->d_.s_ + d_.pos_[first[0].as_u()],
                first[1].as_s().data(), first[1].as_s().length());
         return row;
@@ -215,6 +267,44 @@ inline value_bag<O>* value_bag<O>::update(int col, Str value, kvtimestamp_t ts,
     return update(&change[0], &change[2], ts, ti);
 }
 
+// Overwrite columns in place if no change alters a column's length.
+// Returns false, leaving the row unchanged, otherwise. The caller holds
+// the row's leaf lock; concurrent readers must use snapshot().
+template <typename O>
+inline bool value_bag<O>::update_in_place(const Json* first, const Json* last,
+                                          kvtimestamp_t ts) {
+    for (auto it = first; it != last; it += 2) {
+        unsigned idx = it[0].as_u();
+        if (idx >= unsigned(d_.ncol_)
+            || it[1].as_s().length() != column_length(idx))
+            return false;
+    }
+    ver_.setdirty();
+    fence();
+    for (; first != last; first += 2) {
+        Str val = first[1].as_s();
+        memcpy(d_.s_ + d_.pos_[first[0].as_u()], val.data(), val.length());
+    }
+    ts_ = ts;
+    fence();
+    ver_.clearandbump();
+    return true;
+}
+
+// Copy the row to dst, which has room for size() bytes. In-place updates
+// never change the row's size.
+template <typename O>
+inline void value_bag<O>::snapshot(value_bag<O>* dst) const {
+    rowversion v1 = ver_.stable();
+    while (1) {
+        memcpy((void*) dst, (const void*) this, size());
+        rowversion v2 = ver_.stable();
+        if (!v1.has_changed(v2))
+            break;
+        v1 = v2;
+    }
+}
+
 template <typename O> template <typename ALLOC>
 inline value_bag<O>* value_bag<O>::create(const Json* first, const Json* last,
                                           kvtimestamp_t ts, ALLOC& ti) {
@@ -225,8 +315,9 @@ inline value_bag<O>* value_bag<O>::create(const Json* first, const Json* last,
 template <typename O> template <typename ALLOC>
 inline value_bag<O>* value_bag<O>::create1(Str str, kvtimestamp_t ts,
                                            ALLOC& ti) {
-    value_bag<O>* row = (value_bag<O>*) ti.allocate(sizeof(kvtimestamp_t) + sizeof(bagdata) + sizeof(O) + str.length(), memtag_value);
+    value_bag<O>* row = (value_bag<O>*) ti.allocate(header_size + sizeof(bagdata) + sizeof(O) + str.length(), memtag_value);
     row->ts_ = ts;
+    row->ver_ = rowversion();
     row->d_.ncol_ = 1;
     row->d_.pos_[0] = sizeof(bagdata) + sizeof(O);
     row->d_.pos_[1] = sizeof(bagdata) + sizeof(O) + str.length();
@@ -250,15 +341,28 @@ inline value_bag<O>* value_bag<O>::checkpoint_read(PARSER& par,
                                                    ALLOC& ti) {
     Str value;
     par >> value;
-    value_bag<O>* row = (value_bag<O>*) ti.allocate(sizeof(kvtimestamp_t) + value.length(), memtag_value);
+    value_bag<O>* row = (value_bag<O>*) ti.allocate(header_size + value.length(), memtag_value);
     row->ts_ = ts;
+    row->ver_ = rowversion();
     memcpy(row->d_.s_, value.data(), value.length());
     return row;
 }
 
 template <typename O> template <typename UNPARSER>
 inline void value_bag<O>::checkpoint_write(UNPARSER& unpar) const {
-    unpar << Str(d_.s_, d_.pos_[d_.ncol_]);
+    // checkpoints run concurrently with in-place updates
+    enum { local_size = 256 };
+    union {
+        char s[local_size];
+        kvtimestamp_t align;
+    } local;
+    value_bag<O>* copy = reinterpret_cast<value_bag<O>*>(local.s);
+    if (size() > local_size)
+        copy = (value_bag<O>*) malloc(size());
+    snapshot(copy);
+    unpar << copy->row_string();
+    if (copy != reinterpret_cast<value_bag<O>*>(local.s))
+        free(copy);
 }
 
 template <typename O>
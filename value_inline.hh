@@ -0,0 +1,212 @@
+/* Masstree
+ * Eddie Kohler, Yandong Mao, Robert Morris
+ * Copyright (c) 2012-2014 President and Fellows of Harvard College
+ * Copyright (c) 2012-2014 Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Masstree LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Masstree LICENSE file; the license in that file
+ * is legally binding.
+ */
+#ifndef VALUE_INLINE_HH
+#define VALUE_INLINE_HH
+#include "compiler.hh"
+#include "json.hh"
+#include "kvproto.hh"
+#include "masstree.hh"
+#include "timestamp.hh"
+
+// A row stored in the tree's leaf slot itself, with no allocation: a
+// timestamp and a value of up to 8 bytes, which suits counters and
+// flags. The value's length lives in the timestamp word's top byte;
+// timestamps count updates and never reach 2^56. Only column 0 exists:
+// queries reject longer values and writes to other columns.
+class value_inline {
+  public:
+    typedef unsigned index_type;
+    static const char *name() { return "Inline"; }
+    static constexpr int max_length = 8;
+
+    typedef lcdf::Str Str;
+    typedef lcdf::Json Json;
+
+    value_inline() = default;
+
+    inline kvtimestamp_t timestamp() const;
+    static inline bool fits(int col, Str value);
+    inline int ncol() const;
+    inline Str col(index_type idx) const;
+
+    // Inline rows own no memory, so these do nothing.
+    template <typename ALLOC>
+    inline void deallocate(ALLOC&) {
+    }
+    template <typename ALLOC>
+    inline void deallocate_rcu(ALLOC&) {
+    }
+    template <typename ALLOC>
+    inline void deallocate_rcu_after_update(const Json*, const Json*, ALLOC&) {
+    }
+    template <typename ALLOC>
+    inline void deallocate_after_failed_update(const Json*, const Json*, ALLOC&) {
+    }
+
+    inline value_inline update(const Json* first, const Json* last,
+                               kvtimestamp_t ts) const;
+    template <typename ALLOC>
+    static inline value_inline create(const Json* first, const Json* last,
+                                      kvtimestamp_t ts, ALLOC& ti);
+    template <typename ALLOC>
+    static inline value_inline create1(Str value, kvtimestamp_t ts, ALLOC& ti);
+
+    template <typename PARSER, typename ALLOC>
+    static inline value_inline checkpoint_read(PARSER& par, kvtimestamp_t ts,
+                                               ALLOC& ti);
+    template <typename UNPARSER>
+    inline void checkpoint_write(UNPARSER& unpar) const;
+
+    void print(FILE* f, const char* prefix, int indent, Str key,
+               kvtimestamp_t initial_ts, const char* suffix = "") const {
+        kvtimestamp_t adj_ts = timestamp_sub(timestamp(), initial_ts);
+        Str value = col(0);
+        fprintf(f, "%s%*s%.*s = %.*s @" PRIKVTSPARTS "%s\n", prefix, indent, "",
+                key.len, key.s, value.len, value.s,
+                KVTS_HIGHPART(adj_ts), KVTS_LOWPART(adj_ts), suffix);
+    }
+
+  private:
+    enum { len_shift = 56 };
+    uint64_t tslen_;
+    char s_[max_length];
+
+    inline int length() const;
+    inline void assign(Str value, kvtimestamp_t ts);
+};
+
+template <>
+struct row_slot<value_inline> {
+    typedef value_inline type;
+    static value_inline* row(value_inline& value) {
+        return &value;
+    }
+    static const value_inline* row(const value_inline& value) {
+        return &value;
+    }
+    static bool fits(int col, lcdf::Str value) {
+        return value_inline::fits(col, value);
+    }
+};
+
+template <typename R> struct query_helper;
+
+// Writers change inline rows in place, so readers copy them. The copy
+// lives until the next snapshot(); column() returns strings that
+// outlive it.
+template <>
+struct query_helper<value_inline> {
+    value_inline snapshot_;
+
+    inline const value_inline* snapshot(const value_inline* row,
+                                        const std::vector<value_inline::index_type>&,
+                                        threadinfo&) {
+        snapshot_ = *row;
+        return &snapshot_;
+    }
+    static inline lcdf::String column(lcdf::Str col) {
+        return lcdf::String(col);
+    }
+    inline value_inline update(const value_inline& row,
+                               const lcdf::Json* first, const lcdf::Json* last,
+                               kvtimestamp_t ts, threadinfo&) {
+        return row.update(first, last, ts);
+    }
+};
+
+namespace Masstree {
+template <>
+class value_print<value_inline> {
+  public:
+    static void print(const value_inline& value, FILE* f, const char* prefix,
+                      int indent, Str key, kvtimestamp_t initial_timestamp,
+                      char* suffix) {
+        value.print(f, prefix, indent, key, initial_timestamp, suffix);
+    }
+};
+} // namespace Masstree
+
+inline kvtimestamp_t value_inline::timestamp() const {
+    return tslen_ & ((uint64_t(1) << len_shift) - 1);
+}
+
+inline bool value_inline::fits(int col, Str value) {
+    return col == 0 && value.length() <= max_length;
+}
+
+inline int value_inline::length() const {
+    return tslen_ >> len_shift;
+}
+
+inline void value_inline::assign(Str value, kvtimestamp_t ts) {
+    assert(value.length() <= max_length && !(ts >> len_shift));
+    tslen_ = ts | (uint64_t(value.length()) << len_shift);
+    memset(s_, 0, max_length);
+    memcpy(s_, value.data(), value.length());
+}
+
+inline int value_inline::ncol() const {
+    return 1;
+}
+
+inline lcdf::Str value_inline::col(index_type idx) const {
+    if (idx != 0)
+        return Str();
+    return Str(s_, length());
+}
+
+inline value_inline value_inline::update(const Json* first, const Json* last,
+                                         kvtimestamp_t ts) const {
+    value_inline row = *this;
+    Str value = col(0);
+    for (; first != last; first += 2) {
+        assert(fits(first[0].as_i(), first[1].as_s()));
+        value = first[1].as_s();
+    }
+    row.assign(value, ts);
+    return row;
+}
+
+template <typename ALLOC>
+inline value_inline value_inline::create(const Json* first, const Json* last,
+                                         kvtimestamp_t ts, ALLOC&) {
+    value_inline empty = value_inline();
+    return empty.update(first, last, ts);
+}
+
+template <typename ALLOC>
+inline value_inline value_inline::create1(Str value, kvtimestamp_t ts,
+                                          ALLOC&) {
+    value_inline row = value_inline();
+    row.assign(value, ts);
+    return row;
+}
+
+template <typename PARSER, typename ALLOC>
+inline value_inline value_inline::checkpoint_read(PARSER& par,
+                                                  kvtimestamp_t ts,
+                                                  ALLOC& ti) {
+    Str value;
+    par >> value;
+    return create1(value, ts, ti);
+}
+
+template <typename UNPARSER>
+inline void value_inline::checkpoint_write(UNPARSER& unpar) const {
+    unpar << col(0);
+}
+
+#endif
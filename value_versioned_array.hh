@@ -17,51 +17,7 @@
 #define VALUE_VERSIONED_ARRAY_HH
 #include "compiler.hh"
 #include "value_array.hh"
-
-struct rowversion {
-    rowversion() {
-        v_.u = 0;
-    }
-    bool dirty() {
-        return v_.dirty;
-    }
-    void setdirty() {
-        v_.u = v_.u | 0x80000000;
-    }
-    void clear() {
-        v_.u = v_.u & 0x7fffffff;
-    }
-    void clearandbump() {
-        v_.u = (v_.u + 1) & 0x7fffffff;
-    }
-    rowversion stable() const {
-        value_t x = v_;
-        while (x.dirty) {
-            relax_fence();
-            x = v_;
-        }
-        acquire_fence();
-        return x;
-    }
-    bool has_changed(rowversion x) const {
-        fence();
-        return x.v_.ctr != v_.ctr;
-    }
-  private:
-    union value_t {
-        struct {
-            uint32_t ctr:31;
-            uint32_t dirty:1;
-        };
-        uint32_t u;
-    };
-    value_t v_;
-
-    rowversion(value_t v)
-        : v_(v) {
-    }
-
-};
+#include "rowversion.hh"
 
 class value_versioned_array {
   public:
@@ -129,6 +85,15 @@ struct query_helper<value_versioned_array> {
         row->snapshot(snapshot_, f, ti);
         return snapshot_;
     }
+    static inline lcdf::String column(Str col) {
+        return lcdf::String::make_stable(col);
+    }
+    inline value_versioned_array* update(value_versioned_array* row,
+                                         const lcdf::Json* first,
+                                         const lcdf::Json* last,
+                                         kvtimestamp_t ts, threadinfo& ti) {
+        return row->update(first, last, ts, ti);
+    }
 };
 
 inline value_versioned_array::value_versioned_array()